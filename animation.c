@@ -0,0 +1,94 @@
+#include "animation.h"
+#include "error.h"
+#include "memory.h"
+#include "strutils.h"
+#include "texture.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Animation*
+animation_from_files(
+	const char *pattern,
+	unsigned frame_count,
+	float fps,
+	int mode
+) {
+	assert(pattern != NULL);
+	assert(frame_count > 0);
+
+	struct Animation *anim = make(struct Animation);
+	if (!anim) {
+		return NULL;
+	}
+	char *filenames[frame_count];
+	memset(filenames, 0, sizeof(filenames));
+	anim->fps = fps;
+	anim->mode = mode;
+
+	// format frame file names
+	for (unsigned i = 0; i < frame_count; i++) {
+		if (!(filenames[i] = string_fmt(pattern, i))) {
+			error(ERR_NO_MEM);
+			goto error;
+		}
+	}
+
+	// load the frames into consecutive texture layers
+	anim->frames = calloc(frame_count, sizeof(struct Texture*));
+	if (!anim->frames) {
+		error(ERR_NO_MEM);
+		goto error;
+	}
+	anim->frame_count = frame_count;
+	int ok = texture_sequence_from_files(
+		(const char *const*)filenames,
+		frame_count,
+		anim->frames
+	);
+	if (!ok) {
+		goto error;
+	}
+	anim->width = anim->frames[0]->width;
+	anim->height = anim->frames[0]->height;
+
+cleanup:
+	for (unsigned i = 0; i < frame_count; i++) {
+		free(filenames[i]);
+	}
+	return anim;
+
+error:
+	animation_destroy(anim);
+	anim = NULL;
+	goto cleanup;
+}
+
+void
+animation_destroy(struct Animation *anim)
+{
+	if (anim) {
+		for (unsigned i = 0; i < anim->frame_count; i++) {
+			texture_destroy(anim->frames[i]);
+		}
+		free(anim->frames);
+		destroy(anim);
+	}
+}
+
+unsigned
+animation_get_frame(const struct Animation *anim, float start_time, float time)
+{
+	float elapsed = time > start_time ? time - start_time : 0;
+	unsigned frame = elapsed * anim->fps;
+	unsigned count = anim->frame_count;
+
+	if (anim->mode == ANIMATION_ONCE) {
+		return frame < count ? frame : count - 1;
+	} else if (anim->mode == ANIMATION_PING_PONG && count > 1) {
+		unsigned period = 2 * count - 2;
+		frame %= period;
+		return frame < count ? frame : period - frame;
+	}
+	return frame % count;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/**
+ * Playback modes.
+ *
+ * NOTE: Values are mirrored by `data/shaders/sprite_array.vert`.
+ */
+enum {
+	ANIMATION_LOOP,       // restart from the first frame
+	ANIMATION_ONCE,       // hold the last frame
+	ANIMATION_PING_PONG,  // play forwards, then backwards
+};
+
+/**
+ * Flipbook animation.
+ *
+ * Frames are stored in consecutive layers of an array texture, so that the
+ * current frame of each instance is computed by the vertex shader from the
+ * time it started playing and the time of the frame being rendered.
+ */
+struct Animation {
+	struct Texture **frames;
+	unsigned frame_count;
+	int width, height;
+	float fps;
+	int mode;
+};
+
+/**
+ * Load an animation from a sequence of images.
+ *
+ * The file names are formatted with `pattern`, given the frame number
+ * starting from zero, e.g. `"data/art/Effects/fire%02u.png"`.
+ */
+struct Animation*
+animation_from_files(
+	const char *pattern,
+	unsigned frame_count,
+	float fps,
+	int mode
+);
+
+/**
+ * Destroy an animation.
+ */
+void
+animation_destroy(struct Animation *anim);
+
+/**
+ * Get the frame shown at `time` by an instance started at `start_time`.
+ */
+unsigned
+animation_get_frame(const struct Animation *anim, float start_time, float time);
@@ -0,0 +1,244 @@
+#define _POSIX_C_SOURCE 200112L  // for mmap()
+
+#include "archive.h"
+#include "error.h"
+#include <SDL.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_LZ4
+# include <lz4.h>
+#endif
+
+static struct {
+	void *map;
+	size_t size;
+	const struct ArchiveEntry *entries;
+	uint32_t entry_count;
+	void **decompressed;  // contents of compressed entries, once accessed
+	SDL_mutex *lock;      // serializes decompression
+} archive;
+
+/**
+ * Validate the index of the mapped archive.
+ */
+static int
+check_index(void)
+{
+	const struct ArchiveHeader *hdr = archive.map;
+	if (archive.size < sizeof(struct ArchiveHeader) ||
+	    hdr->magic != ARCHIVE_MAGIC ||
+	    hdr->version != ARCHIVE_VERSION) {
+		return 0;
+	}
+	size_t index_end = (
+		sizeof(struct ArchiveHeader) +
+		sizeof(struct ArchiveEntry) * (size_t)hdr->entry_count
+	);
+	if (index_end > archive.size) {
+		return 0;
+	}
+
+	const struct ArchiveEntry *entries = (const void*)(hdr + 1);
+	for (uint32_t i = 0; i < hdr->entry_count; i++) {
+		const struct ArchiveEntry *e = &entries[i];
+		int compressed = e->flags & ARCHIVE_ENTRY_LZ4;
+		if (e->name < index_end ||
+		    e->name >= archive.size ||
+		    e->offset < index_end ||
+		    e->offset + e->size > archive.size ||
+		    (!compressed && e->size != e->raw_size)) {
+			return 0;
+		}
+
+		// names must be terminated within the archive
+		const char *name = (const char*)archive.map + e->name;
+		if (!memchr(name, 0, archive.size - e->name)) {
+			return 0;
+		}
+
+		uint64_t pixels_size = (uint64_t)e->width * e->height * 4;
+		if (e->type == ARCHIVE_ENTRY_IMAGE &&
+		    e->raw_size != pixels_size) {
+			return 0;
+		}
+	}
+
+	archive.entries = entries;
+	archive.entry_count = hdr->entry_count;
+	return 1;
+}
+
+int
+archive_mount(const char *filename)
+{
+	assert(filename != NULL);
+
+	archive_unmount();
+
+	int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		error(ERR_FILE_READ);
+		goto error;
+	}
+	archive.map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (archive.map == MAP_FAILED) {
+		archive.map = NULL;
+		error(ERR_FILE_READ);
+		goto error;
+	}
+	archive.size = st.st_size;
+	close(fd);
+	fd = -1;
+
+	if (!check_index()) {
+		fprintf(stderr, "bad archive `%s`\n", filename);
+		error(ERR_FILE_BAD);
+		goto error;
+	}
+
+	archive.decompressed = calloc(archive.entry_count, sizeof(void*));
+	archive.lock = SDL_CreateMutex();
+	if (!archive.decompressed || !archive.lock) {
+		error(ERR_NO_MEM);
+		goto error;
+	}
+
+	printf(
+		"mounted archive `%s` with %u entries\n",
+		filename,
+		archive.entry_count
+	);
+	return 1;
+
+error:
+	if (fd >= 0) {
+		close(fd);
+	}
+	archive_unmount();
+	return 0;
+}
+
+void
+archive_unmount(void)
+{
+	if (archive.decompressed) {
+		for (uint32_t i = 0; i < archive.entry_count; i++) {
+			free(archive.decompressed[i]);
+		}
+		free(archive.decompressed);
+	}
+	if (archive.lock) {
+		SDL_DestroyMutex(archive.lock);
+	}
+	if (archive.map) {
+		munmap(archive.map, archive.size);
+	}
+	memset(&archive, 0, sizeof(archive));
+}
+
+static int
+entry_cmp(const void *key, const void *elem)
+{
+	const struct ArchiveEntry *e = elem;
+	return strcmp(key, (const char*)archive.map + e->name);
+}
+
+/**
+ * Find an entry of given type and get its uncompressed data.
+ */
+static const void*
+get_entry(const char *name, int type, const struct ArchiveEntry **r_entry)
+{
+	if (!archive.map) {
+		return NULL;
+	}
+	const struct ArchiveEntry *e = bsearch(
+		name,
+		archive.entries,
+		archive.entry_count,
+		sizeof(struct ArchiveEntry),
+		entry_cmp
+	);
+	if (!e || e->type != type) {
+		return NULL;
+	}
+	*r_entry = e;
+
+	const char *data = (const char*)archive.map + e->offset;
+	if (!(e->flags & ARCHIVE_ENTRY_LZ4)) {
+		return data;
+	}
+
+	// decompress the entry on first access
+	size_t i = e - archive.entries;
+	SDL_LockMutex(archive.lock);
+	if (!archive.decompressed[i]) {
+#ifdef HAVE_LZ4
+		char *buf = malloc(e->raw_size);
+		if (!buf) {
+			error(ERR_NO_MEM);
+		} else if (LZ4_decompress_safe(
+			data,
+			buf,
+			e->size,
+			e->raw_size
+		) != (int)e->raw_size) {
+			fprintf(stderr, "bad archive entry `%s`\n", name);
+			error(ERR_FILE_BAD);
+			free(buf);
+		} else {
+			archive.decompressed[i] = buf;
+		}
+#else
+		fprintf(
+			stderr,
+			"archive entry `%s` is compressed, but LZ4 support "
+			"is not built in\n",
+			name
+		);
+		error(ERR_FILE_BAD);
+#endif
+	}
+	const void *raw = archive.decompressed[i];
+	SDL_UnlockMutex(archive.lock);
+	return raw;
+}
+
+const void*
+archive_get_file(const char *name, size_t *r_size)
+{
+	assert(name != NULL);
+	assert(r_size != NULL);
+
+	const struct ArchiveEntry *e;
+	const void *data = get_entry(name, ARCHIVE_ENTRY_FILE, &e);
+	if (data) {
+		*r_size = e->raw_size;
+	}
+	return data;
+}
+
+const void*
+archive_get_image(const char *name, unsigned *r_width, unsigned *r_height)
+{
+	assert(name != NULL);
+
+	const struct ArchiveEntry *e;
+	const void *data = get_entry(name, ARCHIVE_ENTRY_IMAGE, &e);
+	if (data) {
+		if (r_width) {
+			*r_width = e->width;
+		}
+		if (r_height) {
+			*r_height = e->height;
+		}
+	}
+	return data;
+}
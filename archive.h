@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Asset archive.
+ *
+ * An archive packs the files of the data directory into a single file,
+ * built offline by the `packer` tool and memory-mapped when mounted. Images
+ * are stored decoded, as RGBA8 pixels ready for upload, and all the other
+ * files as they are. Entries compressed with LZ4 are decompressed on first
+ * access and kept in memory until the archive is unmounted, the others are
+ * accessed straight from the mapping.
+ *
+ * While an archive is mounted, the files found in it are read from it
+ * rather than from the file system. The data returned for its entries stays
+ * valid until it's unmounted.
+ */
+
+#define ARCHIVE_MAGIC 0x4b505359  // "YSPK"
+#define ARCHIVE_VERSION 1
+
+// alignment of entry data within the archive
+#define ARCHIVE_ALIGN 16
+
+/**
+ * Archive entry types.
+ */
+enum {
+	ARCHIVE_ENTRY_FILE = 1,
+	ARCHIVE_ENTRY_IMAGE,
+};
+
+/**
+ * Archive entry flags.
+ */
+enum {
+	ARCHIVE_ENTRY_LZ4 = 1,
+};
+
+struct ArchiveHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_count;
+	uint32_t reserved;
+};
+
+/**
+ * Archive index entry.
+ *
+ * Entries follow the header, sorted by name. Names and data are referenced
+ * by their offset from the start of the archive.
+ */
+struct ArchiveEntry {
+	uint64_t offset;
+	uint64_t size;           // as stored
+	uint64_t raw_size;       // uncompressed
+	uint32_t name;           // NUL-terminated
+	uint16_t type;
+	uint16_t flags;
+	uint32_t width, height;  // of images
+};
+
+/**
+ * Mount an archive, replacing the one mounted before, if any.
+ */
+int
+archive_mount(const char *filename);
+
+void
+archive_unmount(void);
+
+/**
+ * Get the contents of a file from the mounted archive.
+ *
+ * Returns NULL if no archive is mounted or the file is not in it. Can be
+ * called from any thread.
+ */
+const void*
+archive_get_file(const char *name, size_t *r_size);
+
+/**
+ * Get the RGBA8 pixels of an image from the mounted archive, stored top to
+ * bottom.
+ *
+ * Returns NULL if no archive is mounted or the image is not in it. Can be
+ * called from any thread.
+ */
+const void*
+archive_get_image(const char *name, unsigned *r_width, unsigned *r_height);
@@ -1,9 +1,20 @@
 #include "game.h"
 #include "memory.h"
+#include "resource.h"
+#include "sprite.h"
+#include <assert.h>
 
 struct Asteroid*
-asteroid_new(float x, float y, float xvel, float yvel, float rot_speed)
-{
+asteroid_new(
+	float x,
+	float y,
+	float xvel,
+	float yvel,
+	float rot_speed,
+	struct Sprite *sprite
+) {
+	assert(sprite != NULL);
+
 	struct Asteroid *ast = make(struct Asteroid);
 	if (!ast) {
 		return NULL;
@@ -16,10 +27,16 @@ asteroid_new(float x, float y, float xvel, float yvel, float rot_speed)
 	ast->body.yvel = yvel;
 	ast->body.x = x;
 	ast->body.y = y;
-	ast->body.radius = 13;
+	ast->body.radius = (
+		sprite->width < sprite->height ?
+		sprite->width :
+		sprite->height
+	) / 2;
 	ast->body.type = BODY_TYPE_ASTEROID;
 	ast->body.collision_mask = BODY_TYPE_PLAYER;
 	ast->body.userdata = ast;
+	resource_retain(sprite);
+	ast->sprite = sprite;
 	return ast;
 }
 
@@ -27,6 +44,7 @@ void
 asteroid_destroy(struct Asteroid *ast)
 {
 	if (ast) {
+		resource_release(ast->sprite);
 		destroy(ast);
 	}
 }
\ No newline at end of file
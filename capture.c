@@ -0,0 +1,397 @@
+#include "capture.h"
+#include "error.h"
+#include "image.h"
+#include "memory.h"
+#include "strutils.h"
+#include <SDL.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// number of readbacks which can be in flight
+#define CAPTURE_PBO_COUNT 3
+
+// number of frames which can wait for the encoder
+#define CAPTURE_QUEUE_LEN 8
+
+// time to wait for pending readbacks on destruction (nanoseconds)
+#define CAPTURE_FENCE_TIMEOUT 1000000000
+
+struct CaptureFrame {
+	unsigned index;
+	int flip;
+	unsigned char *pixels;
+};
+
+struct Capture {
+	unsigned width, height;
+	size_t frame_size;
+	int format;
+	char *path;
+	FILE *raw;
+	unsigned frame_count;    // frames captured, including dropped ones
+	unsigned long dropped;
+	struct {
+		GLuint pbo;
+		GLsync fence;
+		unsigned index;
+	} slots[CAPTURE_PBO_COUNT];
+	unsigned next_slot;
+	struct {
+		SDL_Thread *thread;
+		SDL_mutex *lock;
+		SDL_cond *cond;
+		int quit;
+		int failed;
+		unsigned written;
+		struct CaptureFrame frames[CAPTURE_QUEUE_LEN];
+		struct CaptureFrame *free[CAPTURE_QUEUE_LEN];
+		size_t free_count;
+		struct CaptureFrame *queue[CAPTURE_QUEUE_LEN];
+		size_t queue_head, queue_len;
+	} encoder;
+};
+
+static int
+write_frame(struct Capture *cap, const struct CaptureFrame *frame)
+{
+	size_t stride = cap->width * 4;
+
+	if (cap->format == CAPTURE_FORMAT_RAW) {
+		// raw frames are always stored top to bottom
+		for (unsigned row = 0; row < cap->height; row++) {
+			unsigned src_row = frame->flip ? cap->height - row - 1 : row;
+			const unsigned char *src = frame->pixels + src_row * stride;
+			if (fwrite(src, 1, stride, cap->raw) != stride) {
+				fprintf(stderr, "failed to write raw capture frame\n");
+				return 0;
+			}
+		}
+		return 1;
+	}
+
+	char *filename = string_fmt("%s%06u.png", cap->path, frame->index);
+	if (!filename) {
+		return 0;
+	}
+	int ok = image_write_png(
+		filename,
+		cap->width,
+		cap->height,
+		frame->pixels,
+		stride,
+		frame->flip
+	);
+	free(filename);
+	return ok;
+}
+
+static int
+encoder_main(void *data)
+{
+	struct Capture *cap = data;
+
+	SDL_LockMutex(cap->encoder.lock);
+	for (;;) {
+		while (cap->encoder.queue_len == 0 && !cap->encoder.quit) {
+			SDL_CondWait(cap->encoder.cond, cap->encoder.lock);
+		}
+		if (cap->encoder.queue_len == 0) {
+			// asked to quit and the queue is drained
+			break;
+		}
+
+		// pop the oldest frame and encode it
+		struct CaptureFrame *frame = cap->encoder.queue[
+			cap->encoder.queue_head
+		];
+		cap->encoder.queue_head = (
+			(cap->encoder.queue_head + 1) %
+			CAPTURE_QUEUE_LEN
+		);
+		cap->encoder.queue_len--;
+		SDL_UnlockMutex(cap->encoder.lock);
+
+		int ok = write_frame(cap, frame);
+
+		SDL_LockMutex(cap->encoder.lock);
+		cap->encoder.free[cap->encoder.free_count++] = frame;
+		cap->encoder.failed |= !ok;
+		cap->encoder.written += ok;
+	}
+	SDL_UnlockMutex(cap->encoder.lock);
+
+	return 0;
+}
+
+/**
+ * Copy a frame and queue it for encoding, dropping it if the encoder is
+ * lagging behind.
+ */
+static int
+enqueue_frame(struct Capture *cap, const void *pixels, unsigned index, int flip)
+{
+	SDL_LockMutex(cap->encoder.lock);
+	struct CaptureFrame *frame = NULL;
+	if (cap->encoder.free_count > 0) {
+		frame = cap->encoder.free[--cap->encoder.free_count];
+	}
+	int ok = !cap->encoder.failed;
+	SDL_UnlockMutex(cap->encoder.lock);
+
+	if (!frame) {
+		cap->dropped++;
+		return ok;
+	}
+
+	// the copy is made outside of the lock, the frame is owned by the
+	// caller until it is queued
+	memcpy(frame->pixels, pixels, cap->frame_size);
+	frame->index = index;
+	frame->flip = flip;
+
+	SDL_LockMutex(cap->encoder.lock);
+	size_t tail = (
+		(cap->encoder.queue_head + cap->encoder.queue_len) %
+		CAPTURE_QUEUE_LEN
+	);
+	cap->encoder.queue[tail] = frame;
+	cap->encoder.queue_len++;
+	SDL_CondSignal(cap->encoder.cond);
+	SDL_UnlockMutex(cap->encoder.lock);
+
+	return ok;
+}
+
+/**
+ * Map the readbacks which have completed, in the order they were issued.
+ *
+ * With `wait` set, blocks until all of them complete.
+ */
+static int
+collect_readbacks(struct Capture *cap, int wait)
+{
+	int ok = 1;
+	for (unsigned i = 0; i < CAPTURE_PBO_COUNT; i++) {
+		unsigned s = (cap->next_slot + i) % CAPTURE_PBO_COUNT;
+		if (!cap->slots[s].fence) {
+			continue;
+		}
+
+		GLenum status = glClientWaitSync(
+			cap->slots[s].fence,
+			wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+			wait ? CAPTURE_FENCE_TIMEOUT : 0
+		);
+		if (status == GL_TIMEOUT_EXPIRED && !wait) {
+			// later readbacks can't be complete either
+			break;
+		}
+		glDeleteSync(cap->slots[s].fence);
+		cap->slots[s].fence = NULL;
+		if (status != GL_ALREADY_SIGNALED &&
+		    status != GL_CONDITION_SATISFIED) {
+			cap->dropped++;
+			continue;
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, cap->slots[s].pbo);
+		const void *pixels = glMapBufferRange(
+			GL_PIXEL_PACK_BUFFER,
+			0,
+			cap->frame_size,
+			GL_MAP_READ_BIT
+		);
+		if (pixels) {
+			ok &= enqueue_frame(cap, pixels, cap->slots[s].index, 1);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		} else {
+			cap->dropped++;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	return ok;
+}
+
+struct Capture*
+capture_new(unsigned width, unsigned height, int format, const char *path)
+{
+	assert(path != NULL);
+
+	struct Capture *cap = make(struct Capture);
+	if (!cap) {
+		error(ERR_NO_MEM);
+		return NULL;
+	}
+	cap->width = width;
+	cap->height = height;
+	cap->frame_size = width * height * 4;
+	cap->format = format;
+
+	if (!(cap->path = string_copy(path))) {
+		error(ERR_NO_MEM);
+		goto error;
+	}
+
+	if (format == CAPTURE_FORMAT_RAW && !(cap->raw = fopen(path, "wb"))) {
+		fprintf(stderr, "unable to open file '%s' for writing\n", path);
+		error(ERR_FILE_WRITE);
+		goto error;
+	}
+
+	// allocate encoder frames
+	for (unsigned i = 0; i < CAPTURE_QUEUE_LEN; i++) {
+		struct CaptureFrame *frame = &cap->encoder.frames[i];
+		if (!(frame->pixels = malloc(cap->frame_size))) {
+			error(ERR_NO_MEM);
+			goto error;
+		}
+		cap->encoder.free[cap->encoder.free_count++] = frame;
+	}
+
+	// start the encoder
+	cap->encoder.lock = SDL_CreateMutex();
+	cap->encoder.cond = SDL_CreateCond();
+	if (!cap->encoder.lock || !cap->encoder.cond) {
+		error(ERR_SDL);
+		goto error;
+	}
+	cap->encoder.thread = SDL_CreateThread(encoder_main, "capture", cap);
+	if (!cap->encoder.thread) {
+		fprintf(stderr, "failed to create capture encoder thread\n");
+		error(ERR_SDL);
+		goto error;
+	}
+
+	printf(
+		"capturing %ux%u frames to `%s` (%s)\n",
+		width,
+		height,
+		path,
+		format == CAPTURE_FORMAT_RAW ? "raw video" : "PNG sequence"
+	);
+
+	return cap;
+
+error:
+	capture_destroy(cap);
+	return NULL;
+}
+
+void
+capture_destroy(struct Capture *cap)
+{
+	if (!cap) {
+		return;
+	}
+
+	// flush the readbacks in flight and let the encoder drain its queue
+	if (cap->encoder.thread) {
+		collect_readbacks(cap, 1);
+
+		SDL_LockMutex(cap->encoder.lock);
+		cap->encoder.quit = 1;
+		SDL_CondSignal(cap->encoder.cond);
+		SDL_UnlockMutex(cap->encoder.lock);
+		SDL_WaitThread(cap->encoder.thread, NULL);
+
+		printf(
+			"captured %u frames, %lu dropped\n",
+			cap->encoder.written,
+			cap->dropped
+		);
+	}
+
+	for (unsigned i = 0; i < CAPTURE_PBO_COUNT; i++) {
+		if (cap->slots[i].fence) {
+			glDeleteSync(cap->slots[i].fence);
+		}
+		if (cap->slots[i].pbo) {
+			glDeleteBuffers(1, &cap->slots[i].pbo);
+		}
+	}
+	for (unsigned i = 0; i < CAPTURE_QUEUE_LEN; i++) {
+		free(cap->encoder.frames[i].pixels);
+	}
+	if (cap->encoder.cond) {
+		SDL_DestroyCond(cap->encoder.cond);
+	}
+	if (cap->encoder.lock) {
+		SDL_DestroyMutex(cap->encoder.lock);
+	}
+	if (cap->raw) {
+		fclose(cap->raw);
+	}
+	free(cap->path);
+	destroy(cap);
+}
+
+int
+capture_frame(struct Capture *cap)
+{
+	assert(cap != NULL);
+
+	// hand completed readbacks to the encoder
+	int ok = collect_readbacks(cap, 0);
+
+	// drop the frame if all pixel buffers are still in flight
+	unsigned index = cap->frame_count++;
+	unsigned s = cap->next_slot;
+	if (cap->slots[s].fence) {
+		cap->dropped++;
+		return ok;
+	}
+
+	// pixel buffers are created on first use, so that captures fed with
+	// `capture_submit()` don't need an OpenGL context
+	if (!cap->slots[s].pbo) {
+		glGenBuffers(1, &cap->slots[s].pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, cap->slots[s].pbo);
+		glBufferData(
+			GL_PIXEL_PACK_BUFFER,
+			cap->frame_size,
+			NULL,
+			GL_STREAM_READ
+		);
+	} else {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, cap->slots[s].pbo);
+	}
+
+	// issue the readback, which returns immediately since the target is
+	// a buffer object
+	glReadPixels(
+		0,
+		0,
+		cap->width,
+		cap->height,
+		GL_RGBA,
+		GL_UNSIGNED_BYTE,
+		NULL
+	);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	cap->slots[s].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	cap->slots[s].index = index;
+	cap->next_slot = (s + 1) % CAPTURE_PBO_COUNT;
+
+	if (!cap->slots[s].fence || glGetError() != GL_NO_ERROR) {
+		error(ERR_OPENGL);
+		return 0;
+	}
+	return ok;
+}
+
+int
+capture_submit(struct Capture *cap, const void *pixels)
+{
+	assert(cap != NULL);
+	assert(pixels != NULL);
+	return enqueue_frame(cap, pixels, cap->frame_count++, 0);
+}
+
+unsigned long
+capture_get_dropped(struct Capture *cap)
+{
+	assert(cap != NULL);
+	return cap->dropped;
+}
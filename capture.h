@@ -0,0 +1,62 @@
+#pragma once
+
+#include <GL/glew.h>
+
+/**
+ * Capture output formats.
+ */
+enum {
+	CAPTURE_FORMAT_PNG,  // a sequence of `<path>NNNNNN.png` files
+	CAPTURE_FORMAT_RAW,  // headerless RGBA8 frames, top to bottom, in one file
+};
+
+/**
+ * Frame capture.
+ *
+ * Reads the default framebuffer back into a ring of pixel buffer objects,
+ * which are mapped only once their fence is signaled, a frame or two later,
+ * so that the render thread never waits for the GPU. Mapped frames are
+ * copied and handed to a background thread which encodes them.
+ *
+ * Frames are dropped rather than waited for when either the readback ring
+ * or the encoder queue is full; PNG files are numbered by frame, thus drops
+ * show up as gaps in the sequence.
+ *
+ * Raw video can be encoded with e.g.:
+ *
+ *     ffmpeg -f rawvideo -pix_fmt rgba -s WxH -r 60 -i capture.raw out.mp4
+ */
+struct Capture;
+
+/**
+ * Create a frame capture writing to given path.
+ */
+struct Capture*
+capture_new(unsigned width, unsigned height, int format, const char *path);
+
+/**
+ * Destroy a frame capture, after writing all frames in flight.
+ */
+void
+capture_destroy(struct Capture *cap);
+
+/**
+ * Read back current contents of the default framebuffer.
+ *
+ * Must be called before presenting the frame, on the thread owning the
+ * OpenGL context.
+ */
+int
+capture_frame(struct Capture *cap);
+
+/**
+ * Submit a frame already in memory, with rows stored top to bottom.
+ */
+int
+capture_submit(struct Capture *cap, const void *pixels);
+
+/**
+ * Get the number of frames dropped so far.
+ */
+unsigned long
+capture_get_dropped(struct Capture *cap);
@@ -5,7 +5,19 @@ time = 0
 start_stage = 0
 stage = nil
 
--- Level stages
+-- Art of level stages
+art = {
+    meteor = "data/art/Meteors/meteorGrey_small2.png",
+    meteor_big1 = "data/art/Meteors/meteorBrown_big1.png",
+    meteor_big2 = "data/art/Meteors/meteorBrown_big2.png",
+    meteor_big3 = "data/art/Meteors/meteorBrown_big3.png",
+    enemy_black1 = "data/art/Enemies/enemyBlack1.png",
+    enemy_black2 = "data/art/Enemies/enemyBlack2.png",
+    enemy_blue1 = "data/art/Enemies/enemyBlue1.png",
+    enemy_blue2 = "data/art/Enemies/enemyBlue2.png",
+}
+
+-- Level stages, drawn with the art preloaded for them
 level = {
     [0] = function(offset)
         gen_random_asteroids(offset)
@@ -14,38 +26,83 @@ level = {
 
     [1] = function(offset)
         gen_random_asteroids(offset)
-        game.add_enemy(-100, offset - 300)
-        game.add_enemy(0, offset - 250)
-        game.add_enemy(100, offset - 300)
+        game.add_enemy(-100, offset - 300, art.enemy_black1)
+        game.add_enemy(0, offset - 250, art.enemy_black1)
+        game.add_enemy(100, offset - 300, art.enemy_black1)
     end,
 
     [2] = function(offset)
         gen_random_asteroids(offset)
-        game.add_enemy(-300, offset + 200)
-        game.add_enemy(-200, offset + 200)
-        game.add_enemy(300, offset + 100)
-        game.add_enemy(200, offset + 100)
+        game.add_enemy(-300, offset + 200, art.enemy_black2)
+        game.add_enemy(-200, offset + 200, art.enemy_black2)
+        game.add_enemy(300, offset + 100, art.enemy_blue1)
+        game.add_enemy(200, offset + 100, art.enemy_blue1)
     end,
 
     [3] = function(offset)
         gen_random_asteroids(offset)
-        game.add_enemy(-50, offset + 50)
-        game.add_enemy(50, offset - 50)
-        game.add_enemy(-350, offset + 250)
-        game.add_enemy(-250, offset + 150)
-        game.add_enemy(350, offset - 250)
-        game.add_enemy(250, offset - 150)
+        game.add_asteroid(0, offset - 250, 0, 0, 0.4, art.meteor_big1)
+        game.add_enemy(-50, offset + 50, art.enemy_blue2)
+        game.add_enemy(50, offset - 50, art.enemy_blue2)
+        game.add_enemy(-350, offset + 250, art.enemy_blue2)
+        game.add_enemy(-250, offset + 150, art.enemy_blue2)
+        game.add_enemy(350, offset - 250, art.enemy_blue2)
+        game.add_enemy(250, offset - 150, art.enemy_blue2)
     end,
 
     [4] = function(offset)
         gen_random_asteroids(offset)
+        game.add_asteroid(-200, offset - 100, 0, 0, 0.4, art.meteor_big2)
+        game.add_asteroid(200, offset + 150, 0, 0, -0.3, art.meteor_big2)
     end,
 
     [5] = function(offset)
         gen_random_asteroids(offset)
+        game.add_asteroid(-250, offset + 100, 0, 0, 0.3, art.meteor_big3)
+        game.add_asteroid(150, offset - 200, 0, 0, -0.4, art.meteor_big3)
     end,
 }
 
+--
+-- Collect the sprites spawned by a stage, by running it with spawn
+-- functions which only record them, so that they're never out of sync
+--
+function stage_sprites(index)
+    local sprites = {}
+    local seen = {}
+    local function record(sprite)
+        if sprite and not seen[sprite] then
+            seen[sprite] = true
+            table.insert(sprites, sprite)
+        end
+    end
+
+    local add_asteroid, add_enemy = game.add_asteroid, game.add_enemy
+    game.add_asteroid = function(x, y, xvel, yvel, rot_speed, sprite)
+        record(sprite)
+    end
+    game.add_enemy = function(x, y, sprite)
+        record(sprite)
+    end
+    local ok, err = pcall(level[index], 0)
+    game.add_asteroid, game.add_enemy = add_asteroid, add_enemy
+    if not ok then
+        error(err)
+    end
+    return sprites
+end
+
+--
+-- Preload the assets of a stage, if any, in the background while the stage
+-- before the previous one plays, as each stage is spawned ahead of time;
+-- they're released once the stage is over
+--
+function preload_stage(index)
+    if level[index] then
+        game.preload_assets(index, { sprites = stage_sprites(index) })
+    end
+end
+
 --
 -- Generate random world coordinate
 --
@@ -66,7 +123,7 @@ function gen_random_asteroids(offset)
     local max = 12
     for i = 1, math.random(min, max) do
         local coord = random_coord()
-        game.add_asteroid(coord.x, offset + coord.y, 0, 0, 1.38)
+        game.add_asteroid(coord.x, offset + coord.y, 0, 0, 1.38, art.meteor)
     end
 end
 
@@ -75,21 +132,30 @@ function tick()
     local current_stage = start_stage + math.floor(
         (time * game.SCROLL_SPEED) / game.SCREEN_HEIGHT)
     if stage ~= current_stage then
-        -- load current stage on first tick
+        -- load current stage on first tick, otherwise the past one is over
         if stage == nil then
             level[current_stage](0)
+        else
+            game.release_assets(stage)
         end
 
-        -- pre-load next stage with an offset
+        -- pre-load next stage with an offset, and the assets of the one
+        -- after it
         stage = current_stage
         local stage_factory = level[stage + 1]
         if stage_factory then
             stage_factory(-game.SCREEN_HEIGHT)
         end
+        preload_stage(stage + 2)
 
         print("Stage", stage)
     end
 
     -- advance time
     time = time + 1
-end
\ No newline at end of file
+end
+
+-- the first two stages are spawned on the first tick, thus their assets
+-- are loaded before it
+preload_stage(start_stage)
+preload_stage(start_stage + 1)
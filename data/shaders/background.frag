@@ -0,0 +1,65 @@
+#version 330 core
+
+out vec4 out_color;
+
+uniform float scroll;
+
+// star layers, from the farthest to the nearest
+const int LAYER_COUNT = 3;
+const float cell_size[LAYER_COUNT] = float[](24, 48, 96);
+const float parallax[LAYER_COUNT] = float[](0.2, 0.5, 1.0);
+const float density[LAYER_COUNT] = float[](0.15, 0.1, 0.08);
+const float radius[LAYER_COUNT] = float[](0.8, 1.3, 2.0);
+const float brightness[LAYER_COUNT] = float[](0.35, 0.6, 1.0);
+
+/**
+ * Integer hash of a grid cell.
+ */
+uint
+hash(ivec3 cell)
+{
+	uvec3 v = uvec3(cell);
+	uint h = v.x * 0x8da6b343u ^ v.y * 0xd8163841u ^ v.z * 0xcb1ab31fu;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
+/**
+ * Get a number in [0, 1) from given bits of a hash.
+ */
+float
+unorm(uint h, int shift)
+{
+	return float((h >> shift) & 0xffu) / 256.0;
+}
+
+void
+main()
+{
+	vec3 color = vec3(0);
+	for (int l = 0; l < LAYER_COUNT; l++) {
+		// scroll each layer at its own speed, moving stars downwards
+		vec2 p = gl_FragCoord.xy + vec2(0, scroll * parallax[l]);
+		ivec2 cell = ivec2(floor(p / cell_size[l]));
+		uint h = hash(ivec3(cell, l));
+		if (unorm(h, 0) >= density[l]) {
+			continue;
+		}
+
+		// place the star within its cell, away from the edges, and give
+		// it a slightly warm or cold tint
+		vec2 margin = vec2(radius[l] + 1);
+		vec2 offset = margin + vec2(unorm(h, 8), unorm(h, 16)) *
+			(cell_size[l] - 2 * margin);
+		vec2 center = vec2(cell) * cell_size[l] + offset;
+		float d = distance(p, center);
+		float intensity = brightness[l] * (1 - smoothstep(0.0, radius[l], d));
+		vec3 tint = mix(vec3(1, 0.9, 0.8), vec3(0.8, 0.9, 1), unorm(h, 24));
+		color += tint * intensity;
+	}
+	out_color = vec4(color, 1);
+}
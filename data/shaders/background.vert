@@ -0,0 +1,10 @@
+#version 330 core
+
+void
+main()
+{
+	// a single triangle covering the whole viewport, with vertices at
+	// (-1, -1), (3, -1) and (-1, 3)
+	vec2 v = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(v * 2 - 1, 0, 1);
+}
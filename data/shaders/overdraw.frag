@@ -0,0 +1,11 @@
+#version 330 core
+
+out vec4 out_color;
+
+uniform vec4 color;
+
+void
+main()
+{
+	out_color = color;
+}
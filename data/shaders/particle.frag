@@ -0,0 +1,13 @@
+#version 330 core
+
+in vec2 uv;
+flat in vec4 color;
+out vec4 out_color;
+
+uniform sampler2DRect tex;
+
+void
+main()
+{
+	out_color = texture(tex, uv * textureSize(tex)) * color;
+}
@@ -0,0 +1,38 @@
+#version 330 core
+
+layout(location=0) in vec2 in_position;
+layout(location=1) in float in_size;
+layout(location=2) in vec4 in_color;
+
+uniform mat4 projection;
+
+out vec2 uv;
+flat out vec4 color;
+
+const vec2 positions[4] = vec2[]
+(
+	vec2(-0.5, 0.5),
+	vec2(-0.5, -0.5),
+	vec2(0.5, 0.5),
+	vec2(0.5, -0.5)
+);
+
+const vec2 uvs[4] = vec2[]
+(
+	vec2(0, 0),
+	vec2(0, 1),
+	vec2(1, 0),
+	vec2(1, 1)
+);
+
+void
+main()
+{
+	vec2 v = positions[gl_VertexID] * in_size;
+	gl_Position = projection * vec4(in_position + v, 0, 1);
+
+	// texture coordinate is normalized, the whole texture is scaled to
+	// particle size
+	uv = uvs[gl_VertexID];
+	color = in_color;
+}
@@ -1,16 +1,19 @@
 #version 330 core
 
-uniform vec2 size;
-uniform mat4 transform;
+layout(location=0) in vec2 in_position;
+layout(location=1) in vec2 in_size;
+layout(location=2) in float in_angle;
+
+uniform mat4 projection;
 
 out vec2 uv;
 
 const vec2 positions[4] = vec2[]
 (
-	vec2(0, 0),
-	vec2(0, -1),
-	vec2(1, 0),
-	vec2(1, -1)
+	vec2(-0.5, 0.5),
+	vec2(-0.5, -0.5),
+	vec2(0.5, 0.5),
+	vec2(0.5, -0.5)
 );
 
 const vec2 uvs[4] = vec2[]
@@ -24,9 +27,13 @@ const vec2 uvs[4] = vec2[]
 void
 main()
 {
-	// compute vertex coordinate
-	gl_Position = transform * vec4(positions[gl_VertexID] * size, 0, 1);
+	// compute vertex coordinate, rotated around sprite center
+	vec2 v = positions[gl_VertexID] * in_size;
+	float s = sin(in_angle);
+	float c = cos(in_angle);
+	v = vec2(v.x * c - v.y * s, v.x * s + v.y * c);
+	gl_Position = projection * vec4(in_position + v, 0, 1);
 
 	// compute texture coordinate
-	uv = uvs[gl_VertexID] * size;
-}
\ No newline at end of file
+	uv = uvs[gl_VertexID] * in_size;
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+in vec2 uv;
+flat in vec2 size;
+flat in uint layer;
+out vec4 out_color;
+
+uniform sampler2DArray tex;
+
+void
+main()
+{
+	// the image occupies only a corner of its layer, never sample past it
+	ivec2 texel = clamp(ivec2(uv), ivec2(0), ivec2(size) - 1);
+	out_color = texelFetch(tex, ivec3(texel, layer), 0);
+}
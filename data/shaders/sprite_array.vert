@@ -0,0 +1,70 @@
+#version 330 core
+
+layout(location=0) in vec2 in_position;
+layout(location=1) in vec2 in_size;
+layout(location=2) in float in_angle;
+layout(location=3) in uint in_layer;
+layout(location=4) in uvec2 in_frames;
+layout(location=5) in vec2 in_timing;
+
+uniform mat4 projection;
+uniform float time;
+
+out vec2 uv;
+flat out vec2 size;
+flat out uint layer;
+
+// playback modes, see `animation.h`
+const uint ANIMATION_ONCE = 1u;
+const uint ANIMATION_PING_PONG = 2u;
+
+const vec2 positions[4] = vec2[]
+(
+	vec2(-0.5, 0.5),
+	vec2(-0.5, -0.5),
+	vec2(0.5, 0.5),
+	vec2(0.5, -0.5)
+);
+
+const vec2 uvs[4] = vec2[]
+(
+	vec2(0, 0),
+	vec2(0, 1),
+	vec2(1, 0),
+	vec2(1, 1)
+);
+
+/**
+ * Compute the flipbook frame shown, see `animation_get_frame()`.
+ */
+uint
+current_frame()
+{
+	uint count = in_frames.x;
+	uint frame = uint(max(time - in_timing.x, 0.0) * in_timing.y);
+	if (in_frames.y == ANIMATION_ONCE) {
+		return min(frame, count - 1u);
+	} else if (in_frames.y == ANIMATION_PING_PONG && count > 1u) {
+		uint period = 2u * count - 2u;
+		frame %= period;
+		return frame < count ? frame : period - frame;
+	}
+	return frame % count;
+}
+
+void
+main()
+{
+	// compute vertex coordinate, rotated around sprite center
+	vec2 v = positions[gl_VertexID] * in_size;
+	float s = sin(in_angle);
+	float c = cos(in_angle);
+	v = vec2(v.x * c - v.y * s, v.x * s + v.y * c);
+	gl_Position = projection * vec4(in_position + v, 0, 1);
+
+	// compute texture coordinate
+	uv = uvs[gl_VertexID] * in_size;
+
+	size = in_size;
+	layer = in_layer + current_frame();
+}
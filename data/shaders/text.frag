@@ -1,15 +1,27 @@
 #version 330 core
 
 uniform sampler2DRect atlas_tex;
-uniform uint atlas_offset;
 
-flat in uint char;
+flat in vec2 effect;
 in vec2 uv;
 out vec4 color;
 
 void main()
 {
-	float s = uv.s + char * atlas_offset;
-	float t = uv.t;
-	color = vec4(texture(atlas_tex, vec2(s, t)).r);
+	// glyph edges are at 0.5, antialiased over about a pixel at any scale
+	float dist = texture(atlas_tex, uv).r;
+	float aa = fwidth(dist) * 0.5;
+	float fill = smoothstep(0.5 - aa, 0.5 + aa, dist);
+
+	// the outline extends the glyph outwards in black, the glow fades out
+	// past it
+	float edge = 0.5 - effect.x;
+	float border = smoothstep(edge - aa, edge + aa, dist);
+	float glow = 0.0;
+	if (effect.y > 0.0) {
+		glow = 0.5 * smoothstep(edge - effect.y, edge, dist);
+	}
+
+	float luminance = border > 0.0 ? fill / border : 1.0;
+	color = vec4(vec3(luminance), max(border, glow));
 }
@@ -1,28 +1,28 @@
 #version 330 core
 
 layout(location=0) in vec2 in_coord;
-layout(location=1) in uint in_char;
+layout(location=1) in uvec4 in_rect;
+layout(location=2) in vec3 in_style;
 
-uniform mat4 transform;
-uniform usampler1D glyph_tex;
+uniform mat4 projection;
 
 out vec2 uv;
-flat out uint char;
+flat out vec2 effect;
 
 void main()
 {
-	char = in_char;
-
-	vec4 glyph = vec4(texelFetch(glyph_tex, int(in_char), 0));
-
 	// compute vertex coordinate based on vertex ID
-	float x = (gl_VertexID % 2) * glyph.r;
-	float y = (gl_VertexID < 2 ? 0 : 1) * glyph.g;
+	float x = (gl_VertexID % 2) * float(in_rect.z);
+	float y = (gl_VertexID < 2 ? 0 : 1) * float(in_rect.w);
+
+	// compute UV within glyph atlas rectangle
+	uv.s = in_rect.x + x;
+	uv.t = in_rect.y + y;
 
-	// compute UV
-	uv.s = x;
-	uv.t = y;
+	// outline and glow widths
+	effect = in_style.yz;
 
-	// compute position
-	gl_Position = transform * vec4(in_coord.x + x, in_coord.y + y, 0, 1);
+	// compute position, scaling the distance field to font size
+	vec2 pos = in_coord + vec2(x, y) * in_style.x;
+	gl_Position = projection * vec4(pos, 0, 1);
 }
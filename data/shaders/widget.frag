@@ -1,10 +1,10 @@
 #version 330 core
 
 in vec2 uv;
+flat in vec2 size;
+flat in uvec2 border;
 out vec4 out_color;
 
-uniform vec2 size;
-uniform uvec4 border;
 uniform sampler2DRect tex;
 
 void
@@ -1,9 +1,14 @@
 #version 330 core
 
-uniform vec2 size;
-uniform mat4 transform;
+layout(location=0) in vec2 in_position;
+layout(location=1) in vec2 in_size;
+layout(location=2) in uvec2 in_border;
+
+uniform mat4 projection;
 
 out vec2 uv;
+flat out vec2 size;
+flat out uvec2 border;
 
 const vec2 positions[4] = vec2[]
 (
@@ -25,8 +30,15 @@ void
 main()
 {
 	// compute vertex coordinate
-	gl_Position = transform * vec4(positions[gl_VertexID] * size, 0, 1);
+	gl_Position = projection * vec4(
+		in_position + positions[gl_VertexID] * in_size,
+		0,
+		1
+	);
 
 	// compute texture coordinate
-	uv = uvs[gl_VertexID] * size;
-}
\ No newline at end of file
+	uv = uvs[gl_VertexID] * in_size;
+
+	size = in_size;
+	border = in_border;
+}
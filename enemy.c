@@ -1,8 +1,10 @@
 #include "game.h"
 #include "memory.h"
+#include "resource.h"
+#include "sprite.h"
 
 struct Enemy*
-enemy_new(float x, float y)
+enemy_new(float x, float y, struct Sprite *sprite)
 {
 	struct Enemy *enemy = make(struct Enemy);
 	if (!enemy) {
@@ -15,6 +17,15 @@ enemy_new(float x, float y)
 	enemy->body.x = x;
 	enemy->body.y = y;
 	enemy->body.radius = 48;
+	if (sprite) {
+		resource_retain(sprite);
+		enemy->sprite = sprite;
+		enemy->body.radius = (
+			sprite->width < sprite->height ?
+			sprite->width :
+			sprite->height
+		) / 2;
+	}
 	enemy->body.type = BODY_TYPE_ENEMY;
 	enemy->body.collision_mask = BODY_TYPE_PLAYER | BODY_TYPE_PROJECTILE;
 	enemy->body.userdata = enemy;
@@ -25,6 +36,7 @@ void
 enemy_destroy(struct Enemy *enemy)
 {
 	if (enemy) {
+		resource_release(enemy->sprite);
 		destroy(enemy);
 	}
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "error.h"
+#include <SDL.h>
 #include <stdlib.h>
 
 #define MAX_ERRORS 64
@@ -12,6 +13,9 @@ static struct Error {
 
 static unsigned error_count = 0;
 
+// errors may be pushed by worker threads
+static SDL_SpinLock lock = 0;
+
 static const char *err_msgs[] = {
 	// ERR_NO_MEM
 	"out of memory",
@@ -23,6 +27,8 @@ static const char *err_msgs[] = {
 	"libpng internal error",
 	// ERR_FILE_READ
 	"file read error",
+	// ERR_FILE_WRITE
+	"file write error",
 	// ERR_FILE_BAD
 	"bad file",
 	// ERR_SCRIPT_INIT
@@ -36,6 +42,7 @@ static const char *err_msgs[] = {
 void
 error_push(int code, unsigned long line, const char *file, const char *where)
 {
+	SDL_AtomicLock(&lock);
 	if (error_count == MAX_ERRORS) {
 		fprintf(stderr, "maximum number of errors reached\n");
 		abort();
@@ -45,6 +52,7 @@ error_push(int code, unsigned long line, const char *file, const char *where)
 	e->line = line;
 	e->file = file;
 	e->where = where;
+	SDL_AtomicUnlock(&lock);
 }
 
 int
@@ -8,6 +8,7 @@ enum {
 	ERR_OPENGL,
 	ERR_LIBPNG,
 	ERR_FILE_READ,
+	ERR_FILE_WRITE,
 	ERR_FILE_BAD,
 	ERR_SCRIPT_INIT,
 	ERR_SCRIPT_LOAD,
@@ -1,21 +1,138 @@
+#define _POSIX_C_SOURCE 200112L  // for mmap()
+
 #include <ft2build.h>
 #include FT_FREETYPE_H
-#include FT_GLYPH_H
 
+#include "archive.h"
+#include "error.h"
 #include "font.h"
+#include "ioutils.h"
+#include "strutils.h"
+#include "texture.h"
+#include "utils.h"
+#include <SDL.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// size of the atlas shared by all fonts, glyphs are evicted when they don't
+// fit in anymore
+#define FONT_ATLAS_WIDTH 1024
+#define FONT_ATLAS_HEIGHT 1024
+
+// glyphs are rasterized once per typeface at this pixel size, as distance
+// fields which are scaled to the size of each font
+#define FONT_SDF_SIZE 32
+
+// shelf heights are rounded up to multiples of this, so that a shelf is
+// shared by glyphs of similar height
+#define FONT_SHELF_GRANULARITY 4
+#define FONT_MAX_SHELVES 64
+
+#define FONT_HASH_SIZE 256
+#define FONT_INITIAL_GLYPHS 128
+
+// shelf index of glyphs not in the atlas
+#define NOT_RESIDENT -1
+
+#define FONT_CACHE_MAGIC 0x43465359  // "YSFC"
+#define FONT_CACHE_VERSION 1
 
 static int ft_initialized = 0;
 static FT_Library ft;
 
+// glyph cache directory, NULL if disabled
+static char *cache_dir = NULL;
+
+/**
+ * Glyph cache file header, followed by glyph records and then by their
+ * distance fields.
+ */
+struct FontCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t glyph_count;
+	uint32_t size;  // of the whole file
+};
+
+struct FontCacheGlyph {
+	uint32_t code;
+	uint16_t size[2];
+	int32_t bearing[2];
+	uint32_t advance;
+	uint32_t offset;  // of the distance field, from the start of the file
+};
+
+/**
+ * Cached glyph, its metrics are kept also when evicted from the atlas.
+ */
+struct Glyph {
+	uint32_t code;
+	struct Character ch;  // metrics at `FONT_SDF_SIZE`
+	const unsigned char *field;  // padded distance field, bottom to top
+	int owned;            // whether the field is allocated, not mapped
+	int shelf;            // atlas shelf or `NOT_RESIDENT`
+	unsigned short x;     // first column in the shelf
+	unsigned next;        // next glyph in hash bucket, plus one
+};
+
+/**
+ * Horizontal strip of the atlas, filled left to right.
+ */
+struct Shelf {
+	unsigned short y;
+	unsigned short height;
+	unsigned short x;           // first free column
+	unsigned long last_used;    // frame the shelf was last drawn in
+};
+
+/**
+ * Font file loaded once and shared by the fonts of all sizes created from
+ * it.
+ */
+struct Typeface {
+	char *filename;
+	FT_Face face;       // opened on the first glyph missing from cache
+	SDL_mutex *face_lock;
+	uint64_t key;       // cache key, zero if cache is disabled
+	void *map;          // mapped cache file
+	size_t map_size;
+	int modified;       // whether glyphs were added to the cache
+	unsigned refs;
+	struct Glyph *glyphs;
+	size_t glyph_count;
+	size_t glyph_cap;
+	unsigned buckets[FONT_HASH_SIZE];  // first glyph of bucket, plus one
+	struct Typeface *next;
+};
+
 struct Font {
-	struct Character charmap[128];
-	GLuint tex_glyph;
-	GLuint tex_atlas;
-	unsigned tex_atlas_offset;
+	struct Typeface *typeface;
+	float scale;  // from `FONT_SDF_SIZE` to font size
 };
 
+/**
+ * Glyph atlas shared by all fonts, so that texts of any font are drawn
+ * from the same texture. It exists as long as there are fonts.
+ */
+static struct {
+	SDL_mutex *lock;  // serializes main and render thread lookups
+	struct Typeface *typefaces;
+	struct Shelf shelves[FONT_MAX_SHELVES];
+	unsigned shelf_count;
+	unsigned shelves_height;  // atlas rows taken by shelves
+	GLuint tex;
+	unsigned char *bitmap;
+	unsigned dirty[2];        // range of atlas rows not uploaded yet
+} atlas;
+
 static void
 shutdown_freetype(void)
 {
@@ -35,96 +152,19 @@ init_freetype(void)
 }
 
 static int
-init_glyph_texture(struct Font *font, FT_Glyph *glyphs)
+init_atlas_texture(void)
 {
-	glGenTextures(1, &font->tex_glyph);
-	if (!font->tex_glyph) {
-		return 0;
-	}
-
-	GLubyte data[128][2];
-	for (unsigned char c = 0; c < 128; c++) {
-		struct Character *ch = &font->charmap[c];
-		data[c][0] = ch->size[0];
-		data[c][1] = ch->size[1];
-	}
-
-	glBindTexture(GL_TEXTURE_1D, font->tex_glyph);
-	// NOTE: `GL_NEAREST` is *mandatory* with integer textures.
-	// http://stackoverflow.com/a/39578132/324790
-	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_BASE_LEVEL, 0);
-	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAX_LEVEL, 0);
-	glTexImage1D(
-		GL_TEXTURE_1D,
-		0,
-		GL_RG16UI,
-		128,
-		0,
-		GL_RG_INTEGER,
-		GL_UNSIGNED_BYTE,
-		data
-	);
-	glBindTexture(GL_TEXTURE_1D, 0);
-
-	if (glGetError() != GL_NO_ERROR) {
-		glDeleteTextures(1, &font->tex_glyph);
-		font->tex_glyph = 0;
-		return 0;
-	}
-
-	return 1;
-}
-
-static int
-init_atlas_texture(struct Font *font, FT_Glyph *glyphs)
-{
-	// compute the atlas height and step between glyphs
-	unsigned atlas_w = 0, atlas_h = 0, atlas_s = 0;
-	for (unsigned c = 0; c < 128; c++) {
-		FT_Bitmap *bmp = &((FT_BitmapGlyph)glyphs[c])->bitmap;
-		unsigned width = abs(bmp->pitch);
-		unsigned height = bmp->rows;
-		if (height > atlas_h) {
-			atlas_h = height;
-		}
-		if (width > atlas_s) {
-			atlas_s = width;
-		}
-	}
-	font->tex_atlas_offset = atlas_s;
-	atlas_w = atlas_s * 128;
-
-	// texture data buffer
-	unsigned char data[atlas_w * atlas_h];
-	memset(data, 0, sizeof(data));
-
-	// blit each glyph to atlas
-	for (unsigned c = 0; c < 128; c++) {
-		FT_Bitmap *bmp = &((FT_BitmapGlyph)glyphs[c])->bitmap;
-		for (unsigned row = 0; row < bmp->rows; row++) {
-			// NOTE: both FreeType and OpenGL assume the origin in
-			// lower-left corner, thus, when copying the rows we
-			// start from lower one and go up
-			memcpy(
-				data + (bmp->rows - row - 1) * atlas_w + c * atlas_s,
-				bmp->buffer + row * bmp->pitch,
-				abs(bmp->pitch)  // NOTE: pitch can be negative
-			);
-		}
-	}
-
 	// create the atlas texture
-	glGenTextures(1, &font->tex_atlas);
-	if (!font->tex_atlas) {
+	glGenTextures(1, &atlas.tex);
+	if (!atlas.tex) {
 		return 0;
 	}
 
-	// setup the texture as single-component with no mipmaps
-	glBindTexture(GL_TEXTURE_RECTANGLE, font->tex_atlas);
-	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	// setup the texture as single-component with no mipmaps; distance
+	// fields are interpolated, glyphs are kept apart by their padding
+	glBindTexture(GL_TEXTURE_RECTANGLE, atlas.tex);
+	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_BASE_LEVEL, 0);
@@ -134,58 +174,368 @@ init_atlas_texture(struct Font *font, FT_Glyph *glyphs)
 		GL_TEXTURE_RECTANGLE,
 		0,
 		GL_R8,
-		atlas_w,
-		atlas_h,
+		FONT_ATLAS_WIDTH,
+		FONT_ATLAS_HEIGHT,
 		0,
 		GL_RED,
 		GL_UNSIGNED_BYTE,
-		data
+		atlas.bitmap
 	);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	glBindTexture(GL_TEXTURE_RECTANGLE, 0);
 
 	if (glGetError() != GL_NO_ERROR) {
-		glDeleteTextures(1, &font->tex_glyph);
-		font->tex_glyph = 0;
+		glDeleteTextures(1, &atlas.tex);
+		atlas.tex = 0;
 		return 0;
 	}
 
 	return 1;
 }
 
+static void
+release_atlas(void)
+{
+	if (atlas.tex) {
+		glDeleteTextures(1, &atlas.tex);
+	}
+	if (atlas.lock) {
+		SDL_DestroyMutex(atlas.lock);
+	}
+	free(atlas.bitmap);
+	memset(&atlas, 0, sizeof(atlas));
+}
+
 static int
-init_font(struct Font *font, FT_Face face)
+init_atlas(void)
+{
+	atlas.lock = SDL_CreateMutex();
+	atlas.bitmap = calloc(FONT_ATLAS_WIDTH * FONT_ATLAS_HEIGHT, 1);
+	if (!atlas.lock || !atlas.bitmap) {
+		error(ERR_NO_MEM);
+		release_atlas();
+		return 0;
+	}
+	if ((texture_get_storage() & TEXTURE_STORAGE_GPU) &&
+	    !init_atlas_texture()) {
+		error(ERR_OPENGL);
+		release_atlas();
+		return 0;
+	}
+	return 1;
+}
+
+static char*
+cache_filename(uint64_t key)
 {
-	// initialize the charmap table
-	memset(font->charmap, 0, sizeof(struct Character) * 128);
+	return string_fmt(
+		"%s/%016llx.glyphs",
+		cache_dir,
+		(unsigned long long)key
+	);
+}
 
-	// bitmaps copies
-	FT_Glyph glyphs[128];
+/**
+ * Compute the cache key of a typeface, which depends on its file contents
+ * and on the format of the distance fields.
+ */
+static uint64_t
+compute_cache_key(const char *filename)
+{
+	char *data = NULL;
+	size_t size = file_read(filename, &data);
+	if (!data) {
+		return 0;
+	}
+	const uint32_t params[] = {
+		FONT_CACHE_VERSION,
+		FONT_SDF_SIZE,
+		FONT_SDF_SPREAD,
+	};
+	uint64_t key = hash_fnv1a(HASH_FNV1A_INIT, data, size);
+	key = hash_fnv1a(key, params, sizeof(params));
+	free(data);
+	return key;
+}
 
-	for (unsigned char c = 0; c < 128; c++) {
-		if (FT_Load_Char(face, c, FT_LOAD_RENDER) != 0 ||
-		    FT_Get_Glyph(face->glyph, &glyphs[c]) != 0 ||
-		    FT_Glyph_To_Bitmap(&glyphs[c], FT_RENDER_MODE_NORMAL, NULL, 0) != 0) {
-			return 0;
+static struct Glyph*
+add_glyph(struct Typeface *tf, uint32_t code)
+{
+	if (tf->glyph_count == tf->glyph_cap) {
+		size_t cap = tf->glyph_cap * 2;
+		struct Glyph *glyphs = realloc(
+			tf->glyphs,
+			sizeof(struct Glyph) * cap
+		);
+		if (!glyphs) {
+			error(ERR_NO_MEM);
+			return NULL;
+		}
+		tf->glyphs = glyphs;
+		tf->glyph_cap = cap;
+	}
+
+	unsigned bucket = code % FONT_HASH_SIZE;
+	struct Glyph *glyph = &tf->glyphs[tf->glyph_count++];
+	memset(glyph, 0, sizeof(struct Glyph));
+	glyph->code = code;
+	glyph->shelf = NOT_RESIDENT;
+	glyph->next = tf->buckets[bucket];
+	tf->buckets[bucket] = tf->glyph_count;
+	return glyph;
+}
+
+static size_t
+field_size(const struct Character *ch)
+{
+	return (
+		(ch->size[0] + 2 * FONT_SDF_SPREAD) *
+		(ch->size[1] + 2 * FONT_SDF_SPREAD)
+	);
+}
+
+/**
+ * Map the glyph cache file of a typeface and add its glyphs.
+ *
+ * The distance fields are used straight from the mapping.
+ */
+static int
+load_cache(struct Typeface *tf)
+{
+	char *filename = cache_filename(tf->key);
+	int fd = filename ? open(filename, O_RDONLY) : -1;
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 ||
+	    st.st_size < (off_t)sizeof(struct FontCacheHeader)) {
+		goto error;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		goto error;
+	}
+	tf->map = map;
+	tf->map_size = st.st_size;
+
+	// validate the header and the records
+	const struct FontCacheHeader *hdr = map;
+	const struct FontCacheGlyph *records = (const void*)(hdr + 1);
+	size_t records_end = (
+		sizeof(struct FontCacheHeader) +
+		sizeof(struct FontCacheGlyph) * (size_t)hdr->glyph_count
+	);
+	if (hdr->magic != FONT_CACHE_MAGIC ||
+	    hdr->version != FONT_CACHE_VERSION ||
+	    hdr->key != tf->key ||
+	    hdr->size != tf->map_size ||
+	    records_end > tf->map_size) {
+		goto corrupt;
+	}
+
+	for (uint32_t i = 0; i < hdr->glyph_count; i++) {
+		const struct FontCacheGlyph *rec = &records[i];
+		struct Character ch = {
+			.size = { rec->size[0], rec->size[1] },
+			.bearing = { rec->bearing[0], rec->bearing[1] },
+			.advance = rec->advance,
+		};
+		size_t size = ch.size[0] && ch.size[1] ? field_size(&ch) : 0;
+		if (rec->offset < records_end ||
+		    rec->offset + size > tf->map_size) {
+			goto corrupt;
+		}
+		struct Glyph *glyph = add_glyph(tf, rec->code);
+		if (!glyph) {
+			goto error;
+		}
+		glyph->ch = ch;
+		if (size > 0) {
+			glyph->field = (unsigned char*)map + rec->offset;
 		}
-		struct Character *ch = &font->charmap[c];
-		ch->size[0] = face->glyph->bitmap.width;
-		ch->size[1] = face->glyph->bitmap.rows;
-		ch->bearing[0] = face->glyph->bitmap_left;
-		ch->bearing[1] = face->glyph->bitmap_top;
-		ch->advance = face->glyph->advance.x;
 	}
 
-	int ok = (
-		init_glyph_texture(font, glyphs) &&
-		init_atlas_texture(font, glyphs)
+	printf(
+		"loaded %u glyphs of `%s` from cache\n",
+		hdr->glyph_count,
+		tf->filename
 	);
+	close(fd);
+	free(filename);
+	return 1;
 
-	for (unsigned char c = 0; c < 128; c++) {
-		FT_Done_Glyph(glyphs[c]);
+corrupt:
+	fprintf(stderr, "bad glyph cache file `%s`\n", filename);
+error:
+	// drop the glyphs added so far, they are rasterized instead
+	tf->glyph_count = 0;
+	memset(tf->buckets, 0, sizeof(tf->buckets));
+	if (tf->map) {
+		munmap(tf->map, tf->map_size);
+		tf->map = NULL;
 	}
+	if (fd >= 0) {
+		close(fd);
+	}
+	free(filename);
+	return 0;
+}
 
-	return ok;
+/**
+ * Store all glyphs of a typeface to its cache file.
+ *
+ * Failures are reported but not propagated, since the cache is only an
+ * optimization.
+ */
+static void
+store_cache(const struct Typeface *tf)
+{
+	size_t size = (
+		sizeof(struct FontCacheHeader) +
+		sizeof(struct FontCacheGlyph) * tf->glyph_count
+	);
+	for (size_t i = 0; i < tf->glyph_count; i++) {
+		if (tf->glyphs[i].field) {
+			size += field_size(&tf->glyphs[i].ch);
+		}
+	}
+
+	char *filename = cache_filename(tf->key);
+	unsigned char *buf = malloc(size);
+	if (!buf || !filename) {
+		fprintf(stderr, "failed to store glyph cache\n");
+		goto cleanup;
+	}
+
+	struct FontCacheHeader *hdr = (void*)buf;
+	hdr->magic = FONT_CACHE_MAGIC;
+	hdr->version = FONT_CACHE_VERSION;
+	hdr->key = tf->key;
+	hdr->glyph_count = tf->glyph_count;
+	hdr->size = size;
+
+	struct FontCacheGlyph *records = (void*)(hdr + 1);
+	size_t offset = (unsigned char*)&records[tf->glyph_count] - buf;
+	for (size_t i = 0; i < tf->glyph_count; i++) {
+		const struct Glyph *glyph = &tf->glyphs[i];
+		struct FontCacheGlyph *rec = &records[i];
+		rec->code = glyph->code;
+		rec->size[0] = glyph->ch.size[0];
+		rec->size[1] = glyph->ch.size[1];
+		rec->bearing[0] = glyph->ch.bearing[0];
+		rec->bearing[1] = glyph->ch.bearing[1];
+		rec->advance = glyph->ch.advance;
+		rec->offset = offset;
+		if (glyph->field) {
+			size_t field_len = field_size(&glyph->ch);
+			memcpy(buf + offset, glyph->field, field_len);
+			offset += field_len;
+		}
+	}
+
+	if (!file_write(filename, buf, size)) {
+		fprintf(stderr, "failed to store glyph cache\n");
+	}
+
+cleanup:
+	free(filename);
+	free(buf);
+}
+
+static void
+typeface_destroy(struct Typeface *tf)
+{
+	if (tf) {
+		if (tf->modified && tf->key && cache_dir) {
+			store_cache(tf);
+		}
+		if (tf->face) {
+			FT_Done_Face(tf->face);
+		}
+		if (tf->face_lock) {
+			SDL_DestroyMutex(tf->face_lock);
+		}
+		for (size_t i = 0; i < tf->glyph_count; i++) {
+			if (tf->glyphs[i].owned) {
+				free((void*)tf->glyphs[i].field);
+			}
+		}
+		if (tf->map) {
+			munmap(tf->map, tf->map_size);
+		}
+		free(tf->filename);
+		free(tf->glyphs);
+		free(tf);
+	}
+}
+
+/**
+ * Open the FreeType face of a typeface, for rasterizing glyphs.
+ */
+static int
+open_face(struct Typeface *tf)
+{
+	if (!ft_initialized && !init_freetype()) {
+		return 0;
+	}
+
+	// faces in the mounted archive are read from its mapping
+	size_t size;
+	const void *data = archive_get_file(tf->filename, &size);
+	int err = (
+		data ?
+		FT_New_Memory_Face(ft, data, size, 0, &tf->face) :
+		FT_New_Face(ft, tf->filename, 0, &tf->face)
+	);
+	if (err != 0) {
+		tf->face = NULL;
+		error(ERR_FILE_BAD);
+		return 0;
+	}
+	FT_Set_Pixel_Sizes(tf->face, 0, FONT_SDF_SIZE);
+	return 1;
+}
+
+/**
+ * Get the typeface of given file, loading it if not loaded yet.
+ */
+static struct Typeface*
+get_typeface(const char *filename)
+{
+	struct Typeface *tf = atlas.typefaces;
+	while (tf && strcmp(tf->filename, filename) != 0) {
+		tf = tf->next;
+	}
+	if (tf) {
+		tf->refs++;
+		return tf;
+	}
+
+	tf = calloc(1, sizeof(struct Typeface));
+	if (tf) {
+		tf->filename = string_copy(filename);
+		tf->glyphs = malloc(sizeof(struct Glyph) * FONT_INITIAL_GLYPHS);
+		tf->glyph_cap = FONT_INITIAL_GLYPHS;
+		tf->face_lock = SDL_CreateMutex();
+	}
+	if (!tf || !tf->filename || !tf->glyphs || !tf->face_lock) {
+		error(ERR_NO_MEM);
+		typeface_destroy(tf);
+		return NULL;
+	}
+
+	// glyphs found in the cache need no FreeType at all, otherwise the
+	// face is kept open for rasterizing glyphs on demand
+	if (cache_dir) {
+		tf->key = compute_cache_key(filename);
+	}
+	if ((!tf->key || !load_cache(tf)) && !open_face(tf)) {
+		typeface_destroy(tf);
+		return NULL;
+	}
+
+	tf->refs = 1;
+	tf->next = atlas.typefaces;
+	atlas.typefaces = tf;
+	return tf;
 }
 
 struct Font*
@@ -193,58 +543,475 @@ font_from_file(const char *filename, unsigned size)
 {
 	assert(filename != NULL);
 	assert(strlen(filename) > 0);
+	assert(size > 0);
+
+	if (!atlas.bitmap && !init_atlas()) {
+		return NULL;
+	}
 
-	FT_Face face;
+	struct Font *font = calloc(1, sizeof(struct Font));
+	if (!font) {
+		error(ERR_NO_MEM);
+	} else {
+		SDL_LockMutex(atlas.lock);
+		font->typeface = get_typeface(filename);
+		SDL_UnlockMutex(atlas.lock);
+		font->scale = (float)size / FONT_SDF_SIZE;
+	}
 
-	if ((!ft_initialized && !init_freetype()) ||
-	    FT_New_Face(ft, filename, 0, &face) != 0) {
+	if (!font || !font->typeface) {
+		free(font);
+		if (!atlas.typefaces) {
+			release_atlas();
+		}
 		return NULL;
 	}
+	return font;
+}
+
+static int
+is_inside(const FT_Bitmap *bmp, int x, int y)
+{
+	return (
+		x >= 0 && y >= 0 &&
+		x < (int)bmp->width && y < (int)bmp->rows &&
+		bmp->buffer[y * bmp->pitch + x] >= 128
+	);
+}
 
-	FT_Set_Pixel_Sizes(face, 0, size);
+/**
+ * Compute the signed distance field of a glyph bitmap.
+ *
+ * The field is padded by `FONT_SDF_SPREAD` texels on each side and maps the
+ * distances within the spread to [0, 255], with the glyph edge at 128. The
+ * nearest texel across the edge is found by brute force, which is cheap at
+ * `FONT_SDF_SIZE`.
+ */
+static void
+write_sdf(const FT_Bitmap *bmp, unsigned char *field)
+{
+	const int spread = FONT_SDF_SPREAD;
+	int w = bmp->width + 2 * spread;
+	int h = bmp->rows + 2 * spread;
+
+	for (int row = 0; row < h; row++) {
+		// NOTE: FreeType bitmap rows go top to bottom, while the
+		// atlas, as OpenGL, has the origin in lower-left corner
+		unsigned char *dst = field + (h - row - 1) * w;
+		for (int col = 0; col < w; col++) {
+			int bx = col - spread, by = row - spread;
+			int inside = is_inside(bmp, bx, by);
+			int min_d2 = 2 * spread * spread;
+			for (int dy = -spread; dy <= spread; dy++) {
+				for (int dx = -spread; dx <= spread; dx++) {
+					int d2 = dx * dx + dy * dy;
+					if (d2 < min_d2 &&
+					    is_inside(bmp, bx + dx, by + dy) !=
+					    inside) {
+						min_d2 = d2;
+					}
+				}
+			}
+			float d = sqrtf(min_d2) - 0.5f;
+			float value = 0.5f + (inside ? d : -d) / (2 * spread);
+			value = value < 0 ? 0 : (value > 1 ? 1 : value);
+			dst[col] = value * 255;
+		}
+	}
+}
 
-	struct Font *font = malloc(sizeof(struct Font));
-	if (!font || !init_font(font, face)) {
-		font_destroy(font);
-		font = NULL;
+static struct Glyph*
+find_glyph(struct Typeface *tf, uint32_t code)
+{
+	unsigned bucket = code % FONT_HASH_SIZE;
+	unsigned i = tf->buckets[bucket];
+	while (i && tf->glyphs[i - 1].code != code) {
+		i = tf->glyphs[i - 1].next;
 	}
+	return i ? &tf->glyphs[i - 1] : NULL;
+}
 
-	FT_Done_Face(face);
-	return font;
+/**
+ * Rasterize a glyph and compute its distance field.
+ *
+ * Only the FreeType calls are serialized, by the lock of the face, while
+ * the distance field is computed from a copy of the bitmap, thus glyphs
+ * can be rasterized by several threads at once.
+ */
+static int
+rasterize_glyph(
+	struct Typeface *tf,
+	uint32_t code,
+	struct Character *r_ch,
+	unsigned char **r_field
+) {
+	SDL_LockMutex(tf->face_lock);
+	if (FT_Load_Char(tf->face, code, FT_LOAD_RENDER) != 0) {
+		SDL_UnlockMutex(tf->face_lock);
+		return 0;
+	}
+	FT_GlyphSlot slot = tf->face->glyph;
+	struct Character ch = {
+		.size = { slot->bitmap.width, slot->bitmap.rows },
+		.bearing = { slot->bitmap_left, slot->bitmap_top },
+		.advance = slot->advance.x,
+	};
+	FT_Bitmap bmp = slot->bitmap;
+	unsigned char *pixels = NULL;
+	if (ch.size[0] > 0 && ch.size[1] > 0) {
+		pixels = malloc(bmp.width * bmp.rows);
+		if (!pixels) {
+			SDL_UnlockMutex(tf->face_lock);
+			error(ERR_NO_MEM);
+			return 0;
+		}
+		for (unsigned row = 0; row < bmp.rows; row++) {
+			memcpy(
+				pixels + row * bmp.width,
+				bmp.buffer + row * bmp.pitch,
+				bmp.width
+			);
+		}
+		bmp.buffer = pixels;
+		bmp.pitch = bmp.width;
+	}
+	SDL_UnlockMutex(tf->face_lock);
+
+	unsigned char *field = NULL;
+	if (pixels) {
+		field = malloc(field_size(&ch));
+		if (!field) {
+			free(pixels);
+			error(ERR_NO_MEM);
+			return 0;
+		}
+		write_sdf(&bmp, field);
+		free(pixels);
+	}
+	*r_ch = ch;
+	*r_field = field;
+	return 1;
 }
 
-const struct Character*
-font_get_char(struct Font *font, char c)
+/**
+ * Look up a glyph in the cache, rasterizing it on a miss.
+ *
+ * NOTE: Must be called with the atlas lock held, which is released while
+ * the glyph is rasterized.
+ */
+static struct Glyph*
+get_glyph(struct Typeface *tf, uint32_t code)
 {
-	assert(font != NULL);
-	return &font->charmap[(int)c];
+	struct Glyph *glyph = find_glyph(tf, code);
+	if (glyph) {
+		return glyph;
+	}
+	if (!tf->face && !open_face(tf)) {
+		return NULL;
+	}
+
+	SDL_UnlockMutex(atlas.lock);
+	struct Character ch;
+	unsigned char *field = NULL;
+	int ok = rasterize_glyph(tf, code, &ch, &field);
+	SDL_LockMutex(atlas.lock);
+	if (!ok) {
+		return NULL;
+	}
+
+	// another thread may have added the glyph meanwhile
+	if ((glyph = find_glyph(tf, code))) {
+		free(field);
+		return glyph;
+	}
+	if (!(glyph = add_glyph(tf, code))) {
+		free(field);
+		return NULL;
+	}
+	glyph->ch = ch;
+	glyph->field = field;
+	glyph->owned = 1;
+	tf->modified = 1;
+	return glyph;
 }
 
-GLuint
-font_get_glyph_texture(struct Font *font)
+/**
+ * Evict the glyphs of all typefaces from a shelf, making it empty.
+ */
+static void
+evict_shelf(int shelf)
+{
+	for (struct Typeface *tf = atlas.typefaces; tf; tf = tf->next) {
+		for (size_t i = 0; i < tf->glyph_count; i++) {
+			if (tf->glyphs[i].shelf == shelf) {
+				tf->glyphs[i].shelf = NOT_RESIDENT;
+			}
+		}
+	}
+	atlas.shelves[shelf].x = 0;
+}
+
+/**
+ * Find room for a glyph of given size, evicting a shelf if needed.
+ */
+static int
+find_shelf(unsigned w, unsigned h, unsigned long frame)
+{
+	unsigned height = (
+		(h + FONT_SHELF_GRANULARITY - 1) /
+		FONT_SHELF_GRANULARITY *
+		FONT_SHELF_GRANULARITY
+	);
+
+	// a shelf of the same height with room left
+	for (unsigned s = 0; s < atlas.shelf_count; s++) {
+		const struct Shelf *shelf = &atlas.shelves[s];
+		if (shelf->height == height &&
+		    shelf->x + w <= FONT_ATLAS_WIDTH) {
+			return s;
+		}
+	}
+
+	// a new shelf on top of the others
+	if (atlas.shelf_count < FONT_MAX_SHELVES &&
+	    atlas.shelves_height + height <= FONT_ATLAS_HEIGHT) {
+		struct Shelf *shelf = &atlas.shelves[atlas.shelf_count];
+		shelf->y = atlas.shelves_height;
+		shelf->height = height;
+		shelf->x = 0;
+		atlas.shelves_height += height;
+		return atlas.shelf_count++;
+	}
+
+	// the least recently used shelf tall enough, except those which are
+	// still referenced by current frame
+	int lru = NOT_RESIDENT;
+	for (unsigned s = 0; s < atlas.shelf_count; s++) {
+		const struct Shelf *shelf = &atlas.shelves[s];
+		if (shelf->height >= h &&
+		    shelf->last_used != frame &&
+		    (lru == NOT_RESIDENT ||
+		     shelf->last_used < atlas.shelves[lru].last_used)) {
+			lru = s;
+		}
+	}
+	if (lru != NOT_RESIDENT) {
+		evict_shelf(lru);
+	}
+	return lru;
+}
+
+/**
+ * Copy the distance field of a glyph into the atlas.
+ */
+static int
+place_glyph(struct Glyph *glyph, unsigned long frame)
+{
+	unsigned w = glyph->ch.size[0] + 2 * FONT_SDF_SPREAD;
+	unsigned h = glyph->ch.size[1] + 2 * FONT_SDF_SPREAD;
+	if (w > FONT_ATLAS_WIDTH) {
+		return 0;
+	}
+
+	int s = find_shelf(w, h, frame);
+	if (s == NOT_RESIDENT) {
+		return 0;
+	}
+
+	struct Shelf *shelf = &atlas.shelves[s];
+	unsigned char *dst = atlas.bitmap + shelf->y * FONT_ATLAS_WIDTH;
+	for (unsigned row = 0; row < h; row++) {
+		memcpy(
+			dst + row * FONT_ATLAS_WIDTH + shelf->x,
+			glyph->field + row * w,
+			w
+		);
+	}
+	glyph->shelf = s;
+	glyph->x = shelf->x;
+	shelf->x += w;
+
+	// extend the range of rows to upload
+	if (atlas.dirty[0] == atlas.dirty[1]) {
+		atlas.dirty[0] = shelf->y;
+		atlas.dirty[1] = shelf->y + h;
+	} else {
+		if (shelf->y < atlas.dirty[0]) {
+			atlas.dirty[0] = shelf->y;
+		}
+		if (shelf->y + h > atlas.dirty[1]) {
+			atlas.dirty[1] = shelf->y + h;
+		}
+	}
+
+	return 1;
+}
+
+int
+font_get_char(struct Font *font, uint32_t code, struct Character *r_char)
 {
 	assert(font != NULL);
-	return font->tex_glyph;
+	assert(r_char != NULL);
+
+	SDL_LockMutex(atlas.lock);
+	const struct Glyph *glyph = get_glyph(font->typeface, code);
+	memset(r_char, 0, sizeof(struct Character));
+	if (glyph) {
+		// scale the metrics to font size
+		float scale = font->scale;
+		r_char->size[0] = roundf(glyph->ch.size[0] * scale);
+		r_char->size[1] = roundf(glyph->ch.size[1] * scale);
+		r_char->bearing[0] = roundf(glyph->ch.bearing[0] * scale);
+		r_char->bearing[1] = roundf(glyph->ch.bearing[1] * scale);
+		r_char->advance = roundf(glyph->ch.advance * scale);
+	}
+	SDL_UnlockMutex(atlas.lock);
+
+	return glyph != NULL;
 }
 
-GLuint
-font_get_atlas_texture(struct Font *font)
+float
+font_get_scale(struct Font *font)
 {
 	assert(font != NULL);
-	return font->tex_atlas;
+	return font->scale;
 }
 
-unsigned
-font_get_atlas_offset(struct Font *font)
+int
+font_prepare_glyphs(struct Font *font, uint32_t first, uint32_t last)
 {
 	assert(font != NULL);
-	return font->tex_atlas_offset;
+	assert(first <= last);
+
+	// the lock is released while each glyph is rasterized, so that other
+	// threads rasterize or look up glyphs meanwhile
+	int ok = 1;
+	for (uint32_t code = first; code <= last && ok; code++) {
+		SDL_LockMutex(atlas.lock);
+		ok = get_glyph(font->typeface, code) != NULL;
+		SDL_UnlockMutex(atlas.lock);
+	}
+	return ok;
+}
+
+int
+font_cache_glyph(
+	struct Font *font,
+	uint32_t code,
+	unsigned long frame,
+	struct GlyphRect *r_rect
+) {
+	assert(font != NULL);
+	assert(r_rect != NULL);
+
+	SDL_LockMutex(atlas.lock);
+	struct Glyph *glyph = get_glyph(font->typeface, code);
+	int ok = glyph != NULL;
+	memset(r_rect, 0, sizeof(struct GlyphRect));
+	if (ok && glyph->ch.size[0] > 0 && glyph->ch.size[1] > 0) {
+		if (glyph->shelf == NOT_RESIDENT) {
+			ok = place_glyph(glyph, frame);
+		}
+		if (ok) {
+			struct Shelf *shelf = &atlas.shelves[glyph->shelf];
+			shelf->last_used = frame;
+			r_rect->x = glyph->x;
+			r_rect->y = shelf->y;
+			r_rect->w = glyph->ch.size[0] + 2 * FONT_SDF_SPREAD;
+			r_rect->h = glyph->ch.size[1] + 2 * FONT_SDF_SPREAD;
+		}
+	}
+	SDL_UnlockMutex(atlas.lock);
+
+	return ok;
+}
+
+int
+font_sync_atlas(void)
+{
+	int ok = 1;
+	SDL_LockMutex(atlas.lock);
+	if (atlas.tex && atlas.dirty[0] < atlas.dirty[1]) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(
+			GL_TEXTURE_RECTANGLE,
+			0,
+			0,
+			atlas.dirty[0],
+			FONT_ATLAS_WIDTH,
+			atlas.dirty[1] - atlas.dirty[0],
+			GL_RED,
+			GL_UNSIGNED_BYTE,
+			atlas.bitmap + atlas.dirty[0] * FONT_ATLAS_WIDTH
+		);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		atlas.dirty[0] = atlas.dirty[1] = 0;
+		ok = glGetError() == GL_NO_ERROR;
+	}
+	SDL_UnlockMutex(atlas.lock);
+
+	return ok;
+}
+
+GLuint
+font_get_atlas_texture(void)
+{
+	return atlas.tex;
+}
+
+const unsigned char*
+font_get_atlas_bitmap(unsigned *r_width, unsigned *r_height)
+{
+	if (r_width) {
+		*r_width = FONT_ATLAS_WIDTH;
+	}
+	if (r_height) {
+		*r_height = FONT_ATLAS_HEIGHT;
+	}
+	return atlas.bitmap;
+}
+
+int
+font_cache_init(const char *dir)
+{
+	assert(dir != NULL);
+	assert(cache_dir == NULL);
+
+	if (!dir_create(dir)) {
+		return 0;
+	}
+	cache_dir = string_copy(dir);
+	return cache_dir != NULL;
+}
+
+void
+font_cache_shutdown(void)
+{
+	free(cache_dir);
+	cache_dir = NULL;
 }
 
 void
 font_destroy(struct Font *font)
 {
 	if (font) {
+		// glyphs of the typeface left in the atlas are simply
+		// overwritten when their shelves are evicted
+		struct Typeface *tf = font->typeface;
+		SDL_LockMutex(atlas.lock);
+		if (--tf->refs == 0) {
+			struct Typeface **link = &atlas.typefaces;
+			while (*link != tf) {
+				link = &(*link)->next;
+			}
+			*link = tf->next;
+			typeface_destroy(tf);
+		}
+		SDL_UnlockMutex(atlas.lock);
 		free(font);
+
+		if (!atlas.typefaces) {
+			release_atlas();
+		}
 	}
 }
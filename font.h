@@ -1,6 +1,11 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <stdint.h>
+
+// padding of glyphs in the atlas, in texels, which is also the farthest
+// distance from glyph edges stored in their distance fields
+#define FONT_SDF_SPREAD 6
 
 struct Character {
 	unsigned short size[2];
@@ -8,22 +13,104 @@ struct Character {
 	unsigned advance;
 };
 
+/**
+ * Location of a glyph distance field in the atlas, in texels from its
+ * bottom-left corner, including the padding.
+ */
+struct GlyphRect {
+	unsigned short x;
+	unsigned short y;
+	unsigned short w;
+	unsigned short h;
+};
+
 struct Font;
 
+/**
+ * Load a font of given pixel size.
+ *
+ * Glyphs are stored as signed distance fields at a fixed size, which are
+ * shared by the fonts of all sizes loaded from the same file.
+ */
 struct Font*
 font_from_file(const char *filename, unsigned size);
 
-const struct Character*
-font_get_char(struct Font *font, char c);
+/**
+ * Get the metrics of the glyph of given Unicode code point, at font size.
+ *
+ * Can be called from any thread.
+ */
+int
+font_get_char(struct Font *font, uint32_t code, struct Character *r_char);
 
-GLuint
-font_get_glyph_texture(struct Font *font);
+/**
+ * Get the factor which scales atlas rectangles to font size.
+ */
+float
+font_get_scale(struct Font *font);
+
+/**
+ * Rasterize the glyphs of a range of Unicode code points ahead of use.
+ *
+ * Glyphs are cached by the typeface, but made resident in the atlas only
+ * when drawn. Can be called from any thread.
+ */
+int
+font_prepare_glyphs(struct Font *font, uint32_t first, uint32_t last);
 
+/**
+ * Make the glyph of given Unicode code point resident in the atlas.
+ *
+ * The atlas is shared by all fonts, so that texts of different fonts can be
+ * drawn together. Glyphs are rasterized on first use into shelves of similar
+ * height. When the atlas is full, the least recently used shelf is evicted,
+ * except those used during given `frame`, thus the rectangles returned for
+ * a frame stay valid until the next one. Changes to the atlas are uploaded
+ * to the texture by `font_sync_atlas()`.
+ *
+ * Empty glyphs, such as spaces, have an empty rectangle.
+ */
+int
+font_cache_glyph(
+	struct Font *font,
+	uint32_t code,
+	unsigned long frame,
+	struct GlyphRect *r_rect
+);
+
+/**
+ * Upload the atlas rows changed since last call to the atlas texture.
+ *
+ * The atlas texture must be bound to `GL_TEXTURE_RECTANGLE` target of the
+ * active texture unit.
+ */
+int
+font_sync_atlas(void);
+
+/**
+ * Get the atlas texture, which exists while any font does.
+ */
 GLuint
-font_get_atlas_texture(struct Font *font);
+font_get_atlas_texture(void);
+
+/**
+ * Get the atlas bitmap, with rows stored bottom to top.
+ */
+const unsigned char*
+font_get_atlas_bitmap(unsigned *r_width, unsigned *r_height);
 
-unsigned
-font_get_atlas_offset(struct Font *font);
+/**
+ * Enable the glyph cache in given directory.
+ *
+ * The distance fields of each typeface are stored to a file named after the
+ * hash of the font file when the typeface is released, and memory-mapped
+ * when it is loaded again, so that cached glyphs need no rasterization.
+ */
+int
+font_cache_init(const char *dir);
+
+void
+font_cache_shutdown(void);
 
 void
 font_destroy(struct Font *font);
@@ -40,6 +40,18 @@ add_event(struct World *world, const struct Event *evt)
 	return 1;
 }
 
+static void
+add_effect(struct World *world, int type, float x, float y, float value)
+{
+	if (world->effect_count < EFFECT_QUEUE_SIZE) {
+		struct Effect *effect = &world->effects[world->effect_count++];
+		effect->type = type;
+		effect->x = x;
+		effect->y = y;
+		effect->value = value;
+	}
+}
+
 static int
 handle_player_collision(struct Body *a, struct Body *b, void *userdata)
 {
@@ -210,6 +222,7 @@ world_add_asteroid(struct World *world, struct Asteroid *ast)
 int
 world_add_enemy(struct World *world, struct Enemy *enemy)
 {
+	enemy->spawn_time = world->time;
 	if (!list_add(world->enemy_list, enemy)) {
 		error(ERR_NO_MEM);
 		return 0;
@@ -244,7 +257,13 @@ update_enemy(void *enemy_ptr, void *ctx_ptr)
 	int destroy = 0;
 	if (enemy->hitpoints <= 0) {
 		destroy = 1;
-		struct Event evt = { EVENT_ENEMY_KILL };
+		struct Event evt = {
+			.type = EVENT_ENEMY_KILL,
+			.kill = {
+				.x = enemy->x,
+				.y = enemy->y
+			}
+		};
 		add_event(ctx->world, &evt);
 	} else if ((enemy->ttl -= ctx->dt) <= 0) {
 		destroy = 1;
@@ -315,6 +334,8 @@ int
 world_update(struct World *world, float dt)
 {
 	struct Player *plr = &world->player;
+	world->time += dt;
+	world->effect_count = 0;
 
 	// update physics
 	static float sim_acc = 0;
@@ -340,6 +361,13 @@ world_update(struct World *world, float dt)
 			enemy->hitpoints -= PLAYER_INITIAL_DAMAGE;
 			prj = evt->hit.projectile;
 			prj->ttl = 0;
+			add_effect(
+				world,
+				EFFECT_HIT,
+				enemy->x,
+				enemy->y,
+				PLAYER_INITIAL_DAMAGE
+			);
 			break;
 		case EVENT_PLAYER_COLLISION:
 			switch (evt->collision.second->type) {
@@ -354,12 +382,26 @@ world_update(struct World *world, float dt)
 				plr->hitpoints -= ASTEROID_COLLISION_DAMAGE;
 				ast = evt->collision.second->userdata;
 				ast->ttl = 0;
+				add_effect(
+					world,
+					EFFECT_DEBRIS,
+					ast->x,
+					ast->y,
+					0
+				);
 				break;
 			}
 			break;
 		case EVENT_ENEMY_KILL:
 			printf("enemy killed!\n");
 			plr->credits += ENEMY_CREDIT_YIELD;
+			add_effect(
+				world,
+				EFFECT_EXPLOSION,
+				evt->kill.x,
+				evt->kill.y,
+				0
+			);
 			break;
 		}
 	}
@@ -3,12 +3,15 @@
 #include "list.h"
 #include "physics.h"
 
+struct Sprite;
+
 #define SCREEN_WIDTH 800
 #define SCREEN_HEIGHT 800
 #define SCROLL_SPEED 30.0 // units / second
 #define SIMULATION_STEP 1.0 / 30
 #define TICK 1.0 // seconds
 #define EVENT_QUEUE_BASE_SIZE 20
+#define EFFECT_QUEUE_SIZE 32
 
 #define ENTITY_TTL (SCREEN_HEIGHT / SCROLL_SPEED) * 2.0 + 3.0 // seconds
 
@@ -53,6 +56,15 @@ enum {
 	EVENT_ENEMY_KILL,
 };
 
+/**
+ * Visual effect types.
+ */
+enum {
+	EFFECT_EXPLOSION = 1,
+	EFFECT_DEBRIS,
+	EFFECT_HIT,
+};
+
 /**
  * Player.
  */
@@ -72,8 +84,10 @@ struct Player {
 struct Enemy {
 	float x, y;
 	struct Body body;
+	struct Sprite *sprite;  // cached, or NULL for the default ship
 	float hitpoints;
 	float ttl;
+	float spawn_time;
 };
 
 /**
@@ -82,6 +96,7 @@ struct Enemy {
 struct Asteroid {
 	float x, y;
 	struct Body body;
+	struct Sprite *sprite;  // cached
 	float rot;
 	float rot_speed;
 	float ttl;
@@ -110,15 +125,28 @@ struct Event {
 			void *target;
 			struct Projectile *projectile;
 		} hit;
+		struct KillEvent {
+			float x, y;
+		} kill;
 	};
 };
 
+/**
+ * Visual effect, requested by the simulation to the presentation.
+ */
+struct Effect {
+	int type;
+	float x, y;
+	float value;  // amount of the effect, such as damage dealt
+};
+
 /**
  * World container.
  *
  * This struct holds all the objects which make up the game.
  */
 struct World {
+	float time;  // seconds elapsed since the world was created
 	struct Player player;
 	struct List *asteroid_list;
 	struct List *projectile_list;
@@ -129,6 +157,10 @@ struct World {
 	struct Event *event_queue;
 	size_t event_queue_size;
 	size_t event_count;
+
+	// effects requested by last update, further ones are dropped
+	struct Effect effects[EFFECT_QUEUE_SIZE];
+	size_t effect_count;
 };
 
 /**
@@ -174,10 +206,13 @@ int
 world_update(struct World *world, float dt);
 
 /**
- * Create an enemy.
+ * Create an enemy, drawn with given cached sprite, which also gives the
+ * size of its body, or with the default ship if NULL.
+ *
+ * The enemy holds a reference to the sprite, see `resource_retain()`.
  */
 struct Enemy*
-enemy_new(float x, float y);
+enemy_new(float x, float y, struct Sprite *sprite);
 
 /**
  * Destroy an enemy.
@@ -188,12 +223,22 @@ void
 enemy_destroy(struct Enemy *enemy);
 
 /**
- * Create an asteroid.
+ * Create an asteroid, drawn with given cached sprite, which also gives the
+ * size of its body.
+ *
+ * The asteroid holds a reference to the sprite, see `resource_retain()`.
  *
  * NOTE: Do not attempt to destroy an object owned by the world.
  */
 struct Asteroid*
-asteroid_new(float x, float y, float xvel, float yvel, float rot_speed);
+asteroid_new(
+	float x,
+	float y,
+	float xvel,
+	float yvel,
+	float rot_speed,
+	struct Sprite *sprite
+);
 
 /**
  * Destroy an asteroid.
@@ -0,0 +1,149 @@
+#include "error.h"
+#include "gputimer.h"
+#include "memory.h"
+#include <assert.h>
+#include <stdlib.h>
+
+struct GpuTimer {
+	unsigned section_count;
+	unsigned frame;
+	int active;              // section being timed, -1 if none
+	GLuint *queries;         // `GPU_TIMER_FRAMES` x `section_count`
+	int *issued;             // whether each query was issued
+	float *times;            // last collected results (ms)
+	unsigned long dropped;
+};
+
+struct GpuTimer*
+gpu_timer_new(unsigned section_count)
+{
+	assert(section_count > 0);
+
+	struct GpuTimer *timer = make(struct GpuTimer);
+	if (!timer) {
+		return NULL;
+	}
+	timer->section_count = section_count;
+	timer->frame = GPU_TIMER_FRAMES - 1;
+	timer->active = -1;
+
+	size_t query_count = GPU_TIMER_FRAMES * section_count;
+	timer->queries = calloc(query_count, sizeof(GLuint));
+	timer->issued = calloc(query_count, sizeof(int));
+	timer->times = calloc(section_count, sizeof(float));
+	if (!timer->queries || !timer->issued || !timer->times) {
+		error(ERR_NO_MEM);
+		gpu_timer_destroy(timer);
+		return NULL;
+	}
+
+	glGenQueries(query_count, timer->queries);
+	if (glGetError() != GL_NO_ERROR) {
+		error(ERR_OPENGL);
+		gpu_timer_destroy(timer);
+		return NULL;
+	}
+
+	return timer;
+}
+
+void
+gpu_timer_destroy(struct GpuTimer *timer)
+{
+	if (timer) {
+		if (timer->queries && timer->queries[0]) {
+			glDeleteQueries(
+				GPU_TIMER_FRAMES * timer->section_count,
+				timer->queries
+			);
+		}
+		free(timer->queries);
+		free(timer->issued);
+		free(timer->times);
+		destroy(timer);
+	}
+}
+
+void
+gpu_timer_begin_frame(struct GpuTimer *timer)
+{
+	assert(timer != NULL);
+	assert(timer->active == -1);
+
+	timer->frame = (timer->frame + 1) % GPU_TIMER_FRAMES;
+
+	// collect the results of the frame issued `GPU_TIMER_FRAMES` frames
+	// ago; results which are still not available are dropped rather than
+	// waited for
+	size_t base = timer->frame * timer->section_count;
+	int collected = 0;
+	for (unsigned s = 0; s < timer->section_count; s++) {
+		if (timer->issued[base + s]) {
+			collected = 1;
+			break;
+		}
+	}
+	if (!collected) {
+		return;
+	}
+
+	for (unsigned s = 0; s < timer->section_count; s++) {
+		GLuint query = timer->queries[base + s];
+		timer->times[s] = 0;
+		if (!timer->issued[base + s]) {
+			continue;
+		}
+		timer->issued[base + s] = 0;
+
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+			timer->times[s] = ns / 1000000.0f;
+		} else {
+			timer->dropped++;
+		}
+	}
+}
+
+void
+gpu_timer_begin(struct GpuTimer *timer, unsigned section)
+{
+	assert(timer != NULL);
+	assert(section < timer->section_count);
+
+	gpu_timer_end(timer);
+
+	size_t index = timer->frame * timer->section_count + section;
+	assert(!timer->issued[index]);
+	glBeginQuery(GL_TIME_ELAPSED, timer->queries[index]);
+	timer->issued[index] = 1;
+	timer->active = section;
+}
+
+void
+gpu_timer_end(struct GpuTimer *timer)
+{
+	assert(timer != NULL);
+
+	if (timer->active != -1) {
+		glEndQuery(GL_TIME_ELAPSED);
+		timer->active = -1;
+	}
+}
+
+float
+gpu_timer_get_time(struct GpuTimer *timer, unsigned section)
+{
+	assert(timer != NULL);
+	assert(section < timer->section_count);
+	return timer->times[section];
+}
+
+unsigned long
+gpu_timer_get_dropped(struct GpuTimer *timer)
+{
+	assert(timer != NULL);
+	return timer->dropped;
+}
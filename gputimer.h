@@ -0,0 +1,63 @@
+#pragma once
+
+#include <GL/glew.h>
+
+/**
+ * Number of frames a GPU timer can have in flight.
+ */
+#define GPU_TIMER_FRAMES 4
+
+/**
+ * GPU timer.
+ *
+ * Measures the GPU time spent on a fixed set of sections within each frame
+ * with `GL_TIME_ELAPSED` queries. Queries are ring-buffered over
+ * `GPU_TIMER_FRAMES` frames and their results are collected only when the
+ * ring wraps around, so that reading them never stalls the pipeline.
+ */
+struct GpuTimer;
+
+/**
+ * Create a GPU timer for given number of sections.
+ */
+struct GpuTimer*
+gpu_timer_new(unsigned section_count);
+
+/**
+ * Destroy a GPU timer.
+ */
+void
+gpu_timer_destroy(struct GpuTimer *timer);
+
+/**
+ * Begin a new frame, collecting the results of the oldest one in flight.
+ */
+void
+gpu_timer_begin_frame(struct GpuTimer *timer);
+
+/**
+ * Start timing a section, stopping the current one.
+ *
+ * Each section can be timed at most once per frame.
+ */
+void
+gpu_timer_begin(struct GpuTimer *timer, unsigned section);
+
+/**
+ * Stop timing current section, if any.
+ */
+void
+gpu_timer_end(struct GpuTimer *timer);
+
+/**
+ * Get the time in milliseconds spent by the GPU on given section, in the
+ * last collected frame.
+ */
+float
+gpu_timer_get_time(struct GpuTimer *timer, unsigned section);
+
+/**
+ * Get the number of results discarded because not available in time.
+ */
+unsigned long
+gpu_timer_get_dropped(struct GpuTimer *timer);
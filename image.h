@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Read a PNG file as RGBA8 pixels, stored top to bottom.
+ *
+ * The returned pixels are allocated with `malloc()`. Can be called from any
+ * thread.
+ */
+void*
+image_read_png(const char *filename, unsigned *r_width, unsigned *r_height);
+
+/**
+ * Write RGBA8 pixels to a PNG file.
+ *
+ * Rows are `stride` bytes apart and stored top to bottom, unless `flip` is
+ * set, in which case they're stored bottom to top, as OpenGL returns them.
+ * The alpha channel is discarded.
+ */
+int
+image_write_png(
+	const char *filename,
+	unsigned width,
+	unsigned height,
+	const void *pixels,
+	size_t stride,
+	int flip
+);
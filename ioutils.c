@@ -1,7 +1,14 @@
+#define _POSIX_C_SOURCE 200809L  // for mkdir()
+
+#include "archive.h"
 #include "ioutils.h"
+#include "strutils.h"
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 size_t
 file_read(const char *filename, char **r_buf)
@@ -13,6 +20,18 @@ file_read(const char *filename, char **r_buf)
 
 	size_t size = 0;
 
+	// copy the file from the mounted archive, if it's there
+	const void *data = archive_get_file(filename, &size);
+	if (data) {
+		if (!(*r_buf = malloc(size + 1))) {
+			fprintf(stderr, "could not allocate file contents\n");
+			return 0;
+		}
+		memcpy(*r_buf, data, size);
+		(*r_buf)[size] = 0;
+		return size;
+	}
+
 	FILE *fp = fopen(filename, "r");
 	if (!fp) {
 		fprintf(stderr, "unable to open file '%s'\n", filename);
@@ -50,3 +69,46 @@ error:
 	free(*r_buf);
 	goto cleanup;
 }
+
+int
+file_write(const char *filename, const void *buf, size_t size)
+{
+	assert(filename != NULL);
+	assert(buf != NULL || size == 0);
+
+	// write to a temporary file first, so that readers never see a
+	// partially written one
+	char *tmp_filename = string_fmt("%s.tmp", filename);
+	if (!tmp_filename) {
+		return 0;
+	}
+
+	int ok = 0;
+	FILE *fp = fopen(tmp_filename, "wb");
+	if (!fp) {
+		fprintf(stderr, "unable to open file '%s'\n", tmp_filename);
+	} else {
+		ok = fwrite(buf, 1, size, fp) == size;
+		ok &= fclose(fp) == 0;
+		ok = ok && rename(tmp_filename, filename) == 0;
+		if (!ok) {
+			fprintf(stderr, "failed to write file '%s'\n", filename);
+			remove(tmp_filename);
+		}
+	}
+	free(tmp_filename);
+
+	return ok;
+}
+
+int
+dir_create(const char *path)
+{
+	assert(path != NULL);
+
+	if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "unable to create directory '%s'\n", path);
+		return 0;
+	}
+	return 1;
+}
@@ -2,5 +2,22 @@
 
 #include <stddef.h>
 
+/**
+ * Read a whole file into a NUL-terminated buffer.
+ *
+ * Files in the mounted archive are read from it.
+ */
 size_t
 file_read(const char *filename, char **r_buf);
+
+/**
+ * Write a buffer to a file, replacing it atomically.
+ */
+int
+file_write(const char *filename, const void *buf, size_t size);
+
+/**
+ * Create a directory, unless it already exists.
+ */
+int
+dir_create(const char *path);
@@ -0,0 +1,84 @@
+#include "error.h"
+#include "label.h"
+#include "memory.h"
+#include "text.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct LabelPool*
+label_pool_new(struct Font *font, size_t capacity, float life)
+{
+	assert(font != NULL);
+	assert(capacity > 0);
+	assert(life > 0);
+
+	struct LabelPool *pool = make(struct LabelPool);
+	if (!pool) {
+		return NULL;
+	}
+	pool->font = font;
+	pool->life = life;
+	pool->capacity = capacity;
+	pool->layout = text_new(font);
+	pool->labels = malloc(sizeof(struct Label) * capacity);
+	if (!pool->layout || !pool->labels) {
+		error(ERR_NO_MEM);
+		label_pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void
+label_pool_destroy(struct LabelPool *pool)
+{
+	if (pool) {
+		text_destroy(pool->layout);
+		free(pool->labels);
+		destroy(pool);
+	}
+}
+
+unsigned
+label_pool_spawn(struct LabelPool *pool, float x, float y, const char *str)
+{
+	if (pool->count == pool->capacity ||
+	    !text_set_string(pool->layout, str)) {
+		return 0;
+	}
+
+	// copy the layout of the string, centering it on the label position
+	const struct Text *text = pool->layout;
+	struct Label *label = &pool->labels[pool->count++];
+	label->x = x;
+	label->y = y;
+	label->life = pool->life;
+	label->len = text->len < LABEL_MAX_CHARS ? text->len : LABEL_MAX_CHARS;
+	for (unsigned c = 0; c < label->len; c++) {
+		label->chars[c] = text->chars[c];
+		label->coords[c][0] = text->coords[c][0] - text->width / 2.0f;
+		label->coords[c][1] = text->coords[c][1] + text->height / 2.0f;
+	}
+
+	return 1;
+}
+
+void
+label_pool_update(struct LabelPool *pool, float dt)
+{
+	// move the labels, replacing the expired ones with the last
+	size_t i = 0;
+	while (i < pool->count) {
+		struct Label *label = &pool->labels[i];
+		label->life -= dt;
+		if (label->life <= 0) {
+			*label = pool->labels[--pool->count];
+			continue;
+		}
+		label->x += pool->vx * dt;
+		label->y += pool->vy * dt;
+		i++;
+	}
+}
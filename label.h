@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// characters of a label exceeding this are dropped
+#define LABEL_MAX_CHARS 8
+
+struct Font;
+struct Text;
+
+/**
+ * Short-lived label, such as a damage number.
+ */
+struct Label {
+	float x, y;
+	float life;  // remaining lifetime (seconds)
+	unsigned len;
+	uint32_t chars[LABEL_MAX_CHARS];
+	float coords[LABEL_MAX_CHARS][2];  // relative to label center
+};
+
+/**
+ * Pool of labels of the same font, which drift with a constant velocity
+ * and expire after a fixed lifetime.
+ *
+ * Labels are stored in an array of fixed capacity and laid out once, when
+ * spawned. They own no resources, the renderer draws the glyphs of all of
+ * them in a single batch with the other texts.
+ */
+struct LabelPool {
+	struct Font *font;
+	struct Text *layout;  // scratch text for laying out labels
+	float vx, vy;         // velocity (units/second)
+	float life;           // lifetime (seconds)
+	float outline;        // as in `struct Text`, in pixels
+	float glow;
+	size_t capacity;
+	size_t count;
+	struct Label *labels;
+};
+
+/**
+ * Create a label pool holding up to `capacity` live labels.
+ */
+struct LabelPool*
+label_pool_new(struct Font *font, size_t capacity, float life);
+
+/**
+ * Destroy a label pool.
+ */
+void
+label_pool_destroy(struct LabelPool *pool);
+
+/**
+ * Spawn a label centered at given position.
+ *
+ * Labels exceeding the capacity of the pool are dropped. Returns the number
+ * of labels spawned.
+ */
+unsigned
+label_pool_spawn(struct LabelPool *pool, float x, float y, const char *str);
+
+/**
+ * Advance the labels by given delta time, removing the expired ones.
+ */
+void
+label_pool_update(struct LabelPool *pool, float dt);
@@ -0,0 +1,419 @@
+#include "archive.h"
+#include "error.h"
+#include "font.h"
+#include "image.h"
+#include "loader.h"
+#include "memory.h"
+#include "resource.h"
+#include "sprite.h"
+#include "strutils.h"
+#include "texture.h"
+#include <GL/glew.h>
+#include <SDL.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOADER_MAX_THREADS 16
+#define LOADER_INITIAL_JOBS 32
+
+enum {
+	JOB_TEXTURE = 1,
+	JOB_SPRITE,
+	JOB_GLYPHS,
+};
+
+struct Job {
+	int type;
+	char *name;           // file name or description
+	void **result;        // where the loaded asset is stored
+	struct Font *font;
+	uint32_t range[2];    // of glyphs to rasterize
+	unsigned width, height;
+	void *pixels;         // decoded by the worker
+	int ok;
+};
+
+struct Loader {
+	struct Job *jobs;
+	size_t job_count;
+	size_t job_cap;
+	SDL_atomic_t next_job;  // first job not taken by any worker
+	SDL_mutex *lock;
+	SDL_cond *done_cond;
+	size_t *done;           // indices of completed jobs, in order
+	size_t done_count;
+	size_t finished;        // completed jobs whose assets are created
+	SDL_Thread *threads[LOADER_MAX_THREADS];
+	GLuint pbo;
+	int running;
+	int ok;
+};
+
+struct Loader*
+loader_new(void)
+{
+	struct Loader *ldr = make(struct Loader);
+	if (!ldr) {
+		return NULL;
+	}
+	ldr->lock = SDL_CreateMutex();
+	ldr->done_cond = SDL_CreateCond();
+	if (!ldr->lock || !ldr->done_cond) {
+		error(ERR_SDL);
+		loader_destroy(ldr);
+		return NULL;
+	}
+	return ldr;
+}
+
+static void
+stop(struct Loader *ldr)
+{
+	for (unsigned t = 0; t < LOADER_MAX_THREADS; t++) {
+		if (ldr->threads[t]) {
+			SDL_WaitThread(ldr->threads[t], NULL);
+			ldr->threads[t] = NULL;
+		}
+	}
+	if (ldr->pbo) {
+		glDeleteBuffers(1, &ldr->pbo);
+		ldr->pbo = 0;
+	}
+	free(ldr->done);
+	ldr->done = NULL;
+	ldr->running = 0;
+}
+
+static void
+clear_jobs(struct Loader *ldr)
+{
+	for (size_t i = 0; i < ldr->job_count; i++) {
+		free(ldr->jobs[i].name);
+		free(ldr->jobs[i].pixels);
+	}
+	ldr->job_count = 0;
+}
+
+void
+loader_destroy(struct Loader *ldr)
+{
+	if (ldr) {
+		stop(ldr);
+		clear_jobs(ldr);
+		free(ldr->jobs);
+		if (ldr->done_cond) {
+			SDL_DestroyCond(ldr->done_cond);
+		}
+		if (ldr->lock) {
+			SDL_DestroyMutex(ldr->lock);
+		}
+		destroy(ldr);
+	}
+}
+
+static struct Job*
+add_job(struct Loader *ldr, int type, char *name, void **result)
+{
+	assert(!ldr->running);
+
+	if (!name) {
+		error(ERR_NO_MEM);
+		return NULL;
+	}
+	if (ldr->job_count == ldr->job_cap) {
+		size_t cap = ldr->job_cap * 2;
+		cap = cap ? cap : LOADER_INITIAL_JOBS;
+		struct Job *jobs = realloc(ldr->jobs, sizeof(struct Job) * cap);
+		if (!jobs) {
+			error(ERR_NO_MEM);
+			free(name);
+			return NULL;
+		}
+		ldr->jobs = jobs;
+		ldr->job_cap = cap;
+	}
+
+	struct Job *job = &ldr->jobs[ldr->job_count++];
+	memset(job, 0, sizeof(struct Job));
+	job->type = type;
+	job->name = name;
+	job->result = result;
+	if (result) {
+		*result = NULL;
+	}
+	return job;
+}
+
+int
+loader_add_texture(
+	struct Loader *ldr,
+	const char *filename,
+	struct Texture **r_texture
+) {
+	assert(filename != NULL);
+	assert(r_texture != NULL);
+	if ((*r_texture = resource_find(RESOURCE_TEXTURE, filename))) {
+		return 1;
+	}
+	char *name = string_copy(filename);
+	return add_job(ldr, JOB_TEXTURE, name, (void**)r_texture) != NULL;
+}
+
+int
+loader_add_sprite(
+	struct Loader *ldr,
+	const char *filename,
+	struct Sprite **r_sprite
+) {
+	assert(filename != NULL);
+	assert(r_sprite != NULL);
+	if ((*r_sprite = resource_find(RESOURCE_SPRITE, filename))) {
+		return 1;
+	}
+	char *name = string_copy(filename);
+	return add_job(ldr, JOB_SPRITE, name, (void**)r_sprite) != NULL;
+}
+
+int
+loader_add_glyphs(
+	struct Loader *ldr,
+	struct Font *font,
+	uint32_t first,
+	uint32_t last
+) {
+	assert(font != NULL);
+	assert(first <= last);
+	char *name = string_fmt("glyphs U+%04X-U+%04X", first, last);
+	struct Job *job = add_job(ldr, JOB_GLYPHS, name, NULL);
+	if (!job) {
+		return 0;
+	}
+	job->font = font;
+	job->range[0] = first;
+	job->range[1] = last;
+	return 1;
+}
+
+/**
+ * Execute the CPU side of a job.
+ */
+static int
+exec_job(struct Job *job)
+{
+	switch (job->type) {
+	case JOB_TEXTURE:
+	case JOB_SPRITE:
+		// images in the mounted archive need no decoding
+		if (archive_get_image(job->name, NULL, NULL)) {
+			return 1;
+		}
+		job->pixels = image_read_png(
+			job->name,
+			&job->width,
+			&job->height
+		);
+		return job->pixels != NULL;
+	case JOB_GLYPHS:
+		return font_prepare_glyphs(
+			job->font,
+			job->range[0],
+			job->range[1]
+		);
+	}
+	return 0;
+}
+
+/**
+ * Create the asset of a job from its decoded data, on the calling thread.
+ */
+static int
+finish_job(struct Job *job)
+{
+	if (!job->ok) {
+		return 0;
+	}
+
+	// the file may have been queued more than once
+	int type = (
+		job->type == JOB_TEXTURE ? RESOURCE_TEXTURE :
+		job->type == JOB_SPRITE ? RESOURCE_SPRITE :
+		0
+	);
+	if (!type) {
+		return 1;
+	}
+	if ((*job->result = resource_find(type, job->name))) {
+		return 1;
+	}
+
+	// the ownership of the pixels is passed to the asset, while those
+	// from the archive are uploaded from its mapping
+	void *pixels = job->pixels;
+	unsigned w = job->width, h = job->height;
+	void *asset = NULL;
+	job->pixels = NULL;
+	if (job->type == JOB_TEXTURE) {
+		asset = (
+			pixels ?
+			texture_from_pixels(w, h, pixels) :
+			texture_from_file(job->name)
+		);
+	} else {
+		asset = (
+			pixels ?
+			sprite_from_pixels(w, h, pixels) :
+			sprite_from_file(job->name)
+		);
+	}
+	if (!asset || !resource_add(type, job->name, asset)) {
+		return 0;
+	}
+	*job->result = asset;
+	return 1;
+}
+
+static int
+worker_main(void *data)
+{
+	struct Loader *ldr = data;
+
+	for (;;) {
+		size_t i = (unsigned)SDL_AtomicAdd(&ldr->next_job, 1);
+		if (i >= ldr->job_count) {
+			break;
+		}
+		struct Job *job = &ldr->jobs[i];
+		job->ok = exec_job(job);
+
+		SDL_LockMutex(ldr->lock);
+		ldr->done[ldr->done_count++] = i;
+		SDL_CondSignal(ldr->done_cond);
+		SDL_UnlockMutex(ldr->lock);
+	}
+
+	return 0;
+}
+
+int
+loader_start(struct Loader *ldr)
+{
+	assert(ldr != NULL);
+	assert(!ldr->running);
+
+	ldr->ok = 1;
+	ldr->done_count = 0;
+	ldr->finished = 0;
+	SDL_AtomicSet(&ldr->next_job, 0);
+	if (ldr->job_count == 0) {
+		return 1;
+	}
+	if (!(ldr->done = malloc(sizeof(size_t) * ldr->job_count))) {
+		error(ERR_NO_MEM);
+		clear_jobs(ldr);
+		return 0;
+	}
+	ldr->running = 1;
+
+	// stage texture uploads through a pixel unpack buffer, if possible
+	if (texture_get_storage() & TEXTURE_STORAGE_GPU) {
+		glGenBuffers(1, &ldr->pbo);
+	}
+
+	// spawn a worker for each CPU core, unless there are fewer jobs;
+	// should none be spawned, the jobs are executed on this thread
+	int cpu_count = SDL_GetCPUCount();
+	unsigned thread_count = cpu_count < 1 ? 1 : cpu_count;
+	if (thread_count > LOADER_MAX_THREADS) {
+		thread_count = LOADER_MAX_THREADS;
+	}
+	if (thread_count > ldr->job_count) {
+		thread_count = ldr->job_count;
+	}
+	unsigned spawned = 0;
+	for (unsigned t = 0; t < thread_count; t++) {
+		ldr->threads[t] = SDL_CreateThread(worker_main, "loader", ldr);
+		spawned += ldr->threads[t] != NULL;
+	}
+	if (spawned == 0) {
+		worker_main(ldr);
+	}
+	return 1;
+}
+
+/**
+ * Create the assets of up to `max_jobs` completed jobs, in order of
+ * completion, optionally waiting for them to complete.
+ */
+static void
+finish_jobs(
+	struct Loader *ldr,
+	size_t max_jobs,
+	int wait,
+	LoaderProgressFunc progress,
+	void *userdata
+) {
+	texture_set_upload_buffer(ldr->pbo);
+	for (size_t n = 0; n < max_jobs; n++) {
+		SDL_LockMutex(ldr->lock);
+		while (wait && ldr->done_count == ldr->finished) {
+			SDL_CondWait(ldr->done_cond, ldr->lock);
+		}
+		if (ldr->done_count == ldr->finished) {
+			SDL_UnlockMutex(ldr->lock);
+			break;
+		}
+		struct Job *job = &ldr->jobs[ldr->done[ldr->finished]];
+		SDL_UnlockMutex(ldr->lock);
+
+		ldr->finished++;
+		if (!finish_job(job)) {
+			fprintf(stderr, "failed to load `%s`\n", job->name);
+			ldr->ok = 0;
+		} else if (progress) {
+			progress(
+				job->name,
+				ldr->finished,
+				ldr->job_count,
+				userdata
+			);
+		}
+	}
+	texture_set_upload_buffer(0);
+}
+
+size_t
+loader_poll(
+	struct Loader *ldr,
+	size_t max_jobs,
+	LoaderProgressFunc progress,
+	void *userdata
+) {
+	assert(ldr != NULL);
+
+	if (ldr->running) {
+		finish_jobs(ldr, max_jobs, 0, progress, userdata);
+	}
+	return ldr->job_count - ldr->finished;
+}
+
+int
+loader_finish(struct Loader *ldr, LoaderProgressFunc progress, void *userdata)
+{
+	assert(ldr != NULL);
+
+	if (ldr->running) {
+		size_t left = ldr->job_count - ldr->finished;
+		finish_jobs(ldr, left, 1, progress, userdata);
+		stop(ldr);
+	}
+	clear_jobs(ldr);
+	return ldr->ok;
+}
+
+int
+loader_run(struct Loader *ldr, LoaderProgressFunc progress, void *userdata)
+{
+	return loader_start(ldr) && loader_finish(ldr, progress, userdata);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Font;
+struct Sprite;
+struct Texture;
+
+/**
+ * Asset loader.
+ *
+ * Assets are queued and then loaded all together: images are decoded and
+ * glyphs rasterized by a pool of worker threads, one for each CPU core,
+ * while the calling thread uploads the decoded images as they complete,
+ * through a pixel unpack buffer. Thus it must own the OpenGL context.
+ */
+struct Loader;
+
+/**
+ * Called after each loaded asset, with the number of assets loaded so far.
+ */
+typedef void (*LoaderProgressFunc)(
+	const char *name,
+	unsigned done,
+	unsigned total,
+	void *userdata
+);
+
+struct Loader*
+loader_new(void);
+
+void
+loader_destroy(struct Loader *ldr);
+
+/**
+ * Queue a texture, stored to `*r_texture` when loaded.
+ *
+ * Textures and sprites are cached by the resource manager, those already
+ * cached are stored right away. Each must be released by
+ * `resource_release()`.
+ */
+int
+loader_add_texture(
+	struct Loader *ldr,
+	const char *filename,
+	struct Texture **r_texture
+);
+
+/**
+ * Queue a sprite, stored to `*r_sprite` when loaded, see
+ * `loader_add_texture()`.
+ */
+int
+loader_add_sprite(
+	struct Loader *ldr,
+	const char *filename,
+	struct Sprite **r_sprite
+);
+
+/**
+ * Queue the rasterization of a range of glyphs of a font, see
+ * `font_prepare_glyphs()`.
+ */
+int
+loader_add_glyphs(
+	struct Loader *ldr,
+	struct Font *font,
+	uint32_t first,
+	uint32_t last
+);
+
+/**
+ * Load the queued assets, emptying the queue.
+ *
+ * All of them are attempted also after a failure, those which fail are
+ * left NULL. Returns whether all of them succeeded.
+ */
+int
+loader_run(struct Loader *ldr, LoaderProgressFunc progress, void *userdata);
+
+/**
+ * Start loading the queued assets in the background.
+ *
+ * The workers decode them while the caller goes on, creating the assets
+ * with `loader_poll()` as they complete and then `loader_finish()`. No
+ * assets can be queued until then.
+ */
+int
+loader_start(struct Loader *ldr);
+
+/**
+ * Create the assets of up to `max_jobs` assets completed so far, without
+ * waiting for the others.
+ *
+ * Returns the number of assets still to create.
+ */
+size_t
+loader_poll(
+	struct Loader *ldr,
+	size_t max_jobs,
+	LoaderProgressFunc progress,
+	void *userdata
+);
+
+/**
+ * Wait for the started assets and create those left, emptying the queue.
+ *
+ * Returns whether all of them succeeded, see `loader_run()`.
+ */
+int
+loader_finish(struct Loader *ldr, LoaderProgressFunc progress, void *userdata);
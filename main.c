@@ -1,11 +1,20 @@
+#include "animation.h"
+#include "archive.h"
+#include "capture.h"
 #include "error.h"
 #include "font.h"
 #include "game.h"
+#include "label.h"
+#include "loader.h"
 #include "matlib.h"
 #include "memory.h"
+#include "particles.h"
+#include "preload.h"
 #include "renderer.h"
+#include "resource.h"
 #include "script.h"
 #include "shader.h"
+#include "ship.h"
 #include "sprite.h"
 #include "strutils.h"
 #include "text.h"
@@ -14,22 +23,39 @@
 #include <GL/glew.h>
 #include <SDL.h>
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define PARTICLE_TRAIL_RATE 2000  // particles/second
+#define DAMAGE_LABEL_CAPACITY 1024
+#define DAMAGE_LABEL_LIFE 0.8    // seconds
+#define DAMAGE_LABEL_SPEED 60.0  // units/second
 
 /*** RESOURCES ***/
 static struct Sprite *spr_player = NULL;
 static struct Sprite *spr_enemy_01 = NULL;
-static struct Sprite *spr_asteroid_01 = NULL;
 static struct Sprite *spr_projectile_01 = NULL;
+static struct Animation *anim_engine_fire = NULL;
 static struct Font *font_dbg = NULL;
 static struct Font *font_hud = NULL;
 static struct Text *fps_text = NULL;
 static struct Text *render_time_text = NULL;
+static struct Text *pass_time_text = NULL;
+static struct Text *counters_text = NULL;
 static struct Text *credits_text = NULL;
 static struct Widget *hp_bar = NULL;
 static struct Widget *hp_bar_bg = NULL;
 static struct Texture *tex_hp_bar_green = NULL;
 static struct Texture *tex_hp_bar_bg = NULL;
+static struct Texture *tex_spark = NULL;
+static struct Texture *tex_trail = NULL;
+static struct Texture *tex_debris = NULL;
+static struct ParticleEmitter *em_sparks = NULL;
+static struct ParticleEmitter *em_trail = NULL;
+static struct ParticleEmitter *em_debris = NULL;
+static struct LabelPool *damage_labels = NULL;
+static struct Preloader *preloader = NULL;
 
 // TEXTURES
 static const struct TextureRes {
@@ -38,6 +64,9 @@ static const struct TextureRes {
 } textures[] = {
 	{ "data/art/UI/squareGreen.png", &tex_hp_bar_green },
 	{ "data/art/UI/squareRed.png", &tex_hp_bar_bg },
+	{ "data/art/Effects/star1.png", &tex_spark },
+	{ "data/art/Effects/star3.png", &tex_trail },
+	{ "data/art/Meteors/meteorGrey_tiny1.png", &tex_debris },
 	{ NULL }
 };
 
@@ -47,12 +76,58 @@ static const struct {
 	struct Sprite **var;
 } sprites[] = {
 	{ "data/art/playerShip1_blue.png", &spr_player },
-	{ "data/art/Enemies/enemyBlack2.png", &spr_enemy_01 },
-	{ "data/art/Meteors/meteorGrey_small2.png", &spr_asteroid_01 },
 	{ "data/art/Lasers/laserBlue07.png", &spr_projectile_01 },
 	{ NULL }
 };
 
+// SHIP DESIGNS
+static const struct ShipPart raider_parts[] = {
+	{ "data/art/Parts/engine1.png", 0, 42, 0 },
+	{ "data/art/Parts/gun00.png", 40, -18, 1 },
+	{ "data/art/Parts/wingRed_0.png", 38, 4, 1 },
+	{ "data/art/Parts/cockpitRed_0.png", 0, 0, 0 },
+	{ NULL }
+};
+
+static const struct {
+	const struct ShipPart *parts;
+	struct Sprite **var;
+} ships[] = {
+	{ raider_parts, &spr_enemy_01 },
+	{ NULL }
+};
+
+// ANIMATIONS
+static const struct {
+	const char *pattern;
+	unsigned frame_count;
+	float fps;
+	int mode;
+	struct Animation **var;
+} animations[] = {
+	{
+		"data/art/Effects/fire%02u.png",
+		20,
+		30,
+		ANIMATION_LOOP,
+		&anim_engine_fire
+	},
+	{ NULL }
+};
+
+// PARTICLE EMITTERS
+static const struct {
+	struct Texture **texture;
+	size_t capacity;
+	float size;
+	struct ParticleEmitter **var;
+} emitters[] = {
+	{ &tex_spark, 64 * 1024, 10, &em_sparks },
+	{ &tex_trail, 32 * 1024, 6, &em_trail },
+	{ &tex_debris, 8 * 1024, 8, &em_debris },
+	{ NULL }
+};
+
 // FONTS
 static const struct {
 	const char *file;
@@ -64,56 +139,126 @@ static const struct {
 	{ NULL }
 };
 
+static void
+print_progress(const char *name, unsigned done, unsigned total, void *userdata)
+{
+	printf("[%u/%u] loaded `%s`\n", done, total, name);
+}
+
 static int
-load_resources(void)
+load_resources(void *userdata)
 {
-	// load textures
-	for (unsigned i = 0; textures[i].file != NULL; i++) {
-		struct TextureRes res = textures[i];
-		if (!(*res.var = texture_from_file(res.file))) {
+	// load fonts
+	for (unsigned i = 0; fonts[i].file != NULL; i++) {
+		*fonts[i].var = resource_get_font(fonts[i].file, fonts[i].size);
+		if (!*fonts[i].var) {
 			fprintf(
 				stderr,
-				"failed to load texture `%s`\n",
-				res.file
+				"failed to load font `%s`\n",
+				fonts[i].file
 			);
 			return 0;
 		}
-		printf("loaded texure `%s`\n", res.file);
+		printf("loaded font `%s`\n", fonts[i].file);
 	}
 
-	// load sprites
+	// decode textures and sprites, and rasterize printable ASCII glyphs of
+	// fonts, in parallel
+	struct Loader *ldr = loader_new();
+	if (!ldr) {
+		return 0;
+	}
+	int ok = 1;
+	for (unsigned i = 0; textures[i].file != NULL; i++) {
+		ok &= loader_add_texture(ldr, textures[i].file, textures[i].var);
+	}
 	for (unsigned i = 0; sprites[i].file != NULL; i++) {
-		if (!(*sprites[i].var = sprite_from_file(sprites[i].file))) {
-			fprintf(
-				stderr,
-				"failed to load sprite `%s`\n",
-				sprites[i].file
-			);
+		ok &= loader_add_sprite(ldr, sprites[i].file, sprites[i].var);
+	}
+	for (unsigned i = 0; fonts[i].file != NULL; i++) {
+		ok &= loader_add_glyphs(ldr, *fonts[i].var, 0x20, 0x7e);
+	}
+	ok = ok && loader_run(ldr, print_progress, NULL);
+	loader_destroy(ldr);
+	if (!ok) {
+		return 0;
+	}
+
+	// assemble ships, which are drawn as a single sprite each
+	for (unsigned i = 0; ships[i].parts != NULL; i++) {
+		if (!(*ships[i].var = ship_assemble(ships[i].parts))) {
+			fprintf(stderr, "failed to assemble ship %u\n", i);
 			return 0;
 		}
-		printf("loaded sprite `%s`\n", sprites[i].file);
+		printf(
+			"assembled %dx%d ship from parts\n",
+			(*ships[i].var)->width,
+			(*ships[i].var)->height
+		);
 	}
 
-	// load fonts
-	for (unsigned i = 0; fonts[i].file != NULL; i++) {
-		if (!(*fonts[i].var = font_from_file(fonts[i].file, fonts[i].size))) {
+	// load animations
+	for (unsigned i = 0; animations[i].pattern != NULL; i++) {
+		*animations[i].var = animation_from_files(
+			animations[i].pattern,
+			animations[i].frame_count,
+			animations[i].fps,
+			animations[i].mode
+		);
+		if (!*animations[i].var) {
 			fprintf(
 				stderr,
-				"failed to load font `%s`\n",
-				fonts[i].file
+				"failed to load animation `%s`\n",
+				animations[i].pattern
 			);
 			return 0;
 		}
-		printf("loaded font `%s`\n", fonts[i].file);
+		printf("loaded animation `%s`\n", animations[i].pattern);
+	}
+
+	// create particle emitters
+	for (unsigned i = 0; emitters[i].texture != NULL; i++) {
+		*emitters[i].var = particle_emitter_new(
+			*emitters[i].texture,
+			emitters[i].capacity,
+			emitters[i].size
+		);
+		if (!*emitters[i].var) {
+			return 0;
+		}
 	}
 
 	// create text renderables
 	fps_text = text_new(font_dbg);
 	render_time_text = text_new(font_dbg);
+	pass_time_text = text_new(font_dbg);
+	counters_text = text_new(font_dbg);
 	credits_text = text_new(font_hud);
-	if (!fps_text || !render_time_text || !credits_text) {
+	if (!fps_text || !render_time_text || !pass_time_text ||
+	    !counters_text || !credits_text) {
+		return 0;
+	}
+	credits_text->outline = 1;
+	credits_text->glow = 2;
+
+	// create the pool of damage numbers, which float upwards
+	damage_labels = label_pool_new(
+		font_hud,
+		DAMAGE_LABEL_CAPACITY,
+		DAMAGE_LABEL_LIFE
+	);
+	if (!damage_labels) {
 		return 0;
 	}
+	damage_labels->vy = -DAMAGE_LABEL_SPEED;
+	damage_labels->outline = 1;
+
+	// create the preloader of the assets of level stages
+	if (!(preloader = preloader_new())) {
+		return 0;
+	}
+
+	resource_report(stdout);
 
 	// create widgets
 	hp_bar = widget_new();
@@ -139,34 +284,91 @@ load_resources(void)
 	return 1;
 }
 
-static void
-cleanup_resources(void)
+static int
+update_preloader(void *userdata)
 {
+	return preloader_update(preloader);
+}
+
+static int
+flush_preloader(void *userdata)
+{
+	return preloader_flush(preloader);
+}
+
+static int
+collect_resources(void *userdata)
+{
+	resource_collect();
+	return 1;
+}
+
+static int
+cleanup_resources(void *userdata)
+{
+	preloader_destroy(preloader);
 	widget_destroy(hp_bar_bg);
 	widget_destroy(hp_bar);
 	text_destroy(fps_text);
 	text_destroy(render_time_text);
+	text_destroy(pass_time_text);
+	text_destroy(counters_text);
 	text_destroy(credits_text);
+	label_pool_destroy(damage_labels);
 
-	// destroy fonts
+	// release fonts
 	for (unsigned i = 0; fonts[i].file; i++) {
-		font_destroy(*fonts[i].var);
+		resource_release(*fonts[i].var);
+	}
+
+	// destroy particle emitters
+	for (unsigned i = 0; emitters[i].texture; i++) {
+		particle_emitter_destroy(*emitters[i].var);
+	}
+
+	// destroy animations
+	for (unsigned i = 0; animations[i].pattern; i++) {
+		animation_destroy(*animations[i].var);
 	}
 
-	// destroy sprites
+	// release sprites, ships are not cached
 	for (unsigned i = 0; sprites[i].file; i++) {
-		sprite_destroy(*sprites[i].var);
+		resource_release(*sprites[i].var);
+	}
+	for (unsigned i = 0; ships[i].parts; i++) {
+		sprite_destroy(*ships[i].var);
 	}
 
-	// destroy textures
+	// release textures
 	for (unsigned i = 0; textures[i].file; i++) {
-		texture_destroy(*textures[i].var);
+		resource_release(*textures[i].var);
 	}
+
+	// destroy the assets kept idle, while there's an OpenGL context
+	resource_purge();
+
+	return 1;
 }
 
 static void
 render_world(struct RenderList *rndr_list, struct World *world)
 {
+	render_list_set_time(rndr_list, world->time);
+	render_list_set_scroll(rndr_list, world->time * SCROLL_SPEED);
+
+	// engine flames are drawn below the ships, which they're attached to
+	float player_flame_y = (
+		world->player.y +
+		(spr_player->height + anim_engine_fire->height) / 2
+	);
+	render_list_add_animation(
+		rndr_list,
+		anim_engine_fire,
+		world->player.x,
+		player_flame_y,
+		0.0f,
+		0.0f
+	);
 	render_list_add_sprite(
 		rndr_list,
 		spr_player,
@@ -180,7 +382,7 @@ render_world(struct RenderList *rndr_list, struct World *world)
 		struct Asteroid *ast = ast_node->data;
 		render_list_add_sprite(
 			rndr_list,
-			spr_asteroid_01,
+			ast->sprite,
 			ast->x,
 			ast->y,
 			ast->rot
@@ -203,18 +405,130 @@ render_world(struct RenderList *rndr_list, struct World *world)
 		prj_node = prj_node->next;
 	}
 
+	// all the flames are added first, so that they're drawn in one batch;
+	// enemies fly downwards, their flames point up
 	struct ListNode *enemy_node = world->enemy_list->head;
 	while (enemy_node) {
 		struct Enemy *enemy = enemy_node->data;
+		struct Sprite *sprite = (
+			enemy->sprite ? enemy->sprite : spr_enemy_01
+		);
+		float flame_y = (
+			enemy->y -
+			(sprite->height + anim_engine_fire->height) / 2
+		);
+		render_list_add_animation(
+			rndr_list,
+			anim_engine_fire,
+			enemy->x,
+			flame_y,
+			M_PI,
+			enemy->spawn_time
+		);
+		enemy_node = enemy_node->next;
+	}
+
+	enemy_node = world->enemy_list->head;
+	while (enemy_node) {
+		struct Enemy *enemy = enemy_node->data;
+		struct Sprite *sprite = (
+			enemy->sprite ? enemy->sprite : spr_enemy_01
+		);
+		// ship designs face upwards, enemies fly downwards
 		render_list_add_sprite(
 			rndr_list,
-			spr_enemy_01,
+			sprite,
 			enemy->x,
 			enemy->y,
-			0
+			M_PI
 		);
 		enemy_node = enemy_node->next;
 	}
+
+	// particles are drawn on top of the ships
+	for (unsigned i = 0; emitters[i].texture != NULL; i++) {
+		render_list_add_particles(rndr_list, *emitters[i].var);
+	}
+
+	// and damage numbers on top of everything
+	render_list_add_labels(rndr_list, damage_labels);
+}
+
+/**
+ * Spawn particles for the effects requested by the world and advance them.
+ */
+static void
+update_particles(struct World *world, float dt)
+{
+	for (size_t i = 0; i < world->effect_count; i++) {
+		const struct Effect *effect = &world->effects[i];
+		if (effect->type == EFFECT_HIT) {
+			continue;
+		} else if (effect->type == EFFECT_EXPLOSION) {
+			struct ParticleBurst sparks = {
+				.x = effect->x,
+				.y = effect->y,
+				.vy = SCROLL_SPEED,
+				.speed = { 50, 300 },
+				.life = { 0.5, 1.5 },
+				.color = { 1.0, 0.6, 0.2, 1.0 },
+				.count = 2000
+			};
+			particle_emitter_emit(em_sparks, &sparks);
+		}
+
+		// both explosions and collisions leave debris
+		struct ParticleBurst debris = {
+			.x = effect->x,
+			.y = effect->y,
+			.vy = SCROLL_SPEED,
+			.speed = { 30, 150 },
+			.life = { 0.5, 1.0 },
+			.color = { 0.8, 0.8, 0.8, 1.0 },
+			.count = 100
+		};
+		particle_emitter_emit(em_debris, &debris);
+	}
+
+	// the engine leaves a trail behind the player at a constant rate
+	static float trail_acc = 0;
+	trail_acc += dt * PARTICLE_TRAIL_RATE;
+	struct ParticleBurst trail = {
+		.x = world->player.x,
+		.y = world->player.y + spr_player->height / 2,
+		.vy = 200,
+		.speed = { 0, 40 },
+		.life = { 0.3, 0.6 },
+		.color = { 0.4, 0.7, 1.0, 0.8 },
+		.count = trail_acc
+	};
+	trail_acc -= particle_emitter_emit(em_trail, &trail);
+
+	for (unsigned i = 0; emitters[i].texture != NULL; i++) {
+		particle_emitter_update(*emitters[i].var, dt);
+	}
+}
+
+/**
+ * Spawn damage numbers for the hits reported by the world and advance them.
+ */
+static void
+update_labels(struct World *world, float dt)
+{
+	for (size_t i = 0; i < world->effect_count; i++) {
+		const struct Effect *effect = &world->effects[i];
+		if (effect->type == EFFECT_HIT) {
+			char str[LABEL_MAX_CHARS + 1];
+			snprintf(str, sizeof(str), "%.0f", effect->value);
+			label_pool_spawn(
+				damage_labels,
+				effect->x,
+				effect->y,
+				str
+			);
+		}
+	}
+	label_pool_update(damage_labels, dt);
 }
 
 static void
@@ -236,6 +550,24 @@ render_ui(struct RenderList *rndr_list)
 		-SCREEN_HEIGHT / 2 + 80
 	);
 
+	// render per-pass timings indicator
+	render_list_add_text(
+		rndr_list,
+		pass_time_text,
+		-SCREEN_WIDTH / 2,
+		-SCREEN_HEIGHT / 2 + 100
+	);
+
+	// render per-frame counters, when requested
+	if (renderer_get_debug() & RENDER_DEBUG_STATS) {
+		render_list_add_text(
+			rndr_list,
+			counters_text,
+			-SCREEN_WIDTH / 2,
+			-SCREEN_HEIGHT / 2 + 120
+		);
+	}
+
 	// render credits counter
 	render_list_add_text(
 		rndr_list,
@@ -291,43 +623,129 @@ main(int argc, char *argv[])
 {
 	int ok = 1;
 	struct World *world = NULL;
+	struct ScriptEnv *env = NULL;
+
+	// parse command line options
+	int backend = RENDER_BACKEND_OPENGL;
+	unsigned max_frames = 0;
+	const char *dump_prefix = NULL;
+	const char *capture_path = NULL;
+	const char *stats_path = NULL;
+	const char *archive_path = NULL;
+	unsigned long vram_budget = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--software") == 0) {
+			backend = RENDER_BACKEND_SOFTWARE;
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			max_frames = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+			dump_prefix = argv[++i];
+		} else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			capture_path = argv[++i];
+		} else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+			stats_path = argv[++i];
+		} else if (strcmp(argv[i], "--archive") == 0 && i + 1 < argc) {
+			archive_path = argv[++i];
+		} else if (strcmp(argv[i], "--vram-budget") == 0 &&
+		           i + 1 < argc) {
+			vram_budget = strtoul(argv[++i], NULL, 10);
+		} else {
+			fprintf(
+				stderr,
+				"usage: %s [--software] [--frames N] [--dump PREFIX] "
+				"[--capture PATH] [--stats PATH] "
+				"[--archive PATH] [--vram-budget MB]\n",
+				argv[0]
+			);
+			return EXIT_FAILURE;
+		}
+	}
+	if (dump_prefix && backend != RENDER_BACKEND_SOFTWARE) {
+		fprintf(stderr, "frame dumping requires --software\n");
+		return EXIT_FAILURE;
+	}
 
-	// initialize renderer
-	if (!renderer_init(SCREEN_WIDTH, SCREEN_HEIGHT)) {
+	if (vram_budget > 0) {
+		resource_set_budget((size_t)vram_budget << 20);
+	}
+
+	// mount the asset archive before loading anything, shaders included
+	if (archive_path && !archive_mount(archive_path)) {
+		error_dump(stdout);
 		return EXIT_FAILURE;
 	}
 
-	// create a render list
-	struct RenderList *rndr_list = render_list_new();
+	// initialize renderer
+	if (!renderer_init(SCREEN_WIDTH, SCREEN_HEIGHT, backend)) {
+		archive_unmount();
+		return EXIT_FAILURE;
+	}
+	renderer_set_frame_dump(dump_prefix);
+	if (stats_path && !renderer_set_stats_file(stats_path)) {
+		ok = 0;
+		goto cleanup;
+	}
 
 	// create Lua script environment
-	struct ScriptEnv *env = script_env_new();
-	if (!env) {
+	if (!(env = script_env_new())) {
 		ok = 0;
 		goto cleanup;
 	}
 
-	if (!(ok = load_resources())) {
+	// enable the glyph cache in user's data directory
+	char *pref_path = SDL_GetPrefPath("V0idExp", "yass");
+	if (pref_path) {
+		char *cache_dir = string_fmt("%sfonts", pref_path);
+		SDL_free(pref_path);
+		if (!cache_dir || !font_cache_init(cache_dir)) {
+			printf("glyph cache disabled\n");
+		}
+		free(cache_dir);
+	}
+
+	// resources own OpenGL objects, thus they're loaded on render thread
+	if (!(ok = renderer_call(load_resources, NULL))) {
 		goto cleanup;
 	}
 
+	// stream the assets of the next stages in between frames
+	renderer_set_frame_call(update_preloader, NULL);
+
+	// start capturing, as raw video if the path looks like a file
+	if (capture_path) {
+		const char *ext = strrchr(capture_path, '.');
+		int format = (
+			ext && strcmp(ext, ".raw") == 0 ?
+			CAPTURE_FORMAT_RAW :
+			CAPTURE_FORMAT_PNG
+		);
+		if (!renderer_start_capture(format, capture_path)) {
+			ok = 0;
+			goto cleanup;
+		}
+	}
+
 	if (!(world = world_new())) {
 		ok = 0;
 		goto cleanup;
 	}
 
-	// initialize script environment and perform initial tick
-	if (!script_env_init(env, world) ||
+	// initialize script environment and perform initial tick, once the
+	// assets the script preloads for the first stages are there
+	if (!script_env_init(env, world, preloader) ||
 	    !script_env_load_file(env, "data/scripts/game.lua") ||
+	    !renderer_call(flush_preloader, NULL) ||
 	    !script_env_tick(env)) {
 		ok = 0;
 		goto cleanup;
 	}
 
 	int run = 1;
-	Uint32 last_update = SDL_GetTicks();
+	Uint32 start_time = SDL_GetTicks();
+	Uint32 last_update = start_time;
 	float tick = 0, time_acc = 0;
-	unsigned frame_count = 0, current_credits;
+	unsigned frame_count = 0, total_frames = 0, current_credits;
+	int ui_dirty = 1;
 	while (ok && run) {
 		// compute timers and counters
 		Uint32 now = SDL_GetTicks();
@@ -345,6 +763,21 @@ main(int argc, char *argv[])
 				case SDLK_q:
 				case SDLK_ESCAPE:
 					run = 0;
+					break;
+				case SDLK_F1:
+				case SDLK_F2:
+					// toggle debug visualizations
+					if (evt.type == SDL_KEYDOWN) {
+						int flag = (
+							evt.key.keysym.sym == SDLK_F1 ?
+							RENDER_DEBUG_OVERDRAW :
+							RENDER_DEBUG_STATS
+						);
+						renderer_set_debug(
+							renderer_get_debug() ^ flag
+						);
+						ui_dirty = 1;
+					}
 				}
 				run &= handle_key(&evt, world);
 			} else if (evt.type == SDL_QUIT) {
@@ -354,15 +787,22 @@ main(int argc, char *argv[])
 
 		// update the world
 		run &= world_update(world, dt);
+		update_particles(world, dt);
+		update_labels(world, dt);
 
 		// update credits text
 		if (world->player.credits != current_credits) {
 			current_credits = world->player.credits;
 			text_set_fmt(credits_text, "Credits: %d$", current_credits);
+			ui_dirty = 1;
 		}
 
 		// update hitpoints widget
-		hp_bar->width = 200.0 * world->player.hitpoints / PLAYER_INITIAL_HITPOINTS;
+		unsigned hp_width = 200.0 * world->player.hitpoints / PLAYER_INITIAL_HITPOINTS;
+		if (hp_bar->width != hp_width) {
+			hp_bar->width = hp_width;
+			ui_dirty = 1;
+		}
 
 		// notify script environment
 		while (tick >= TICK) {
@@ -370,37 +810,116 @@ main(int argc, char *argv[])
 			ok &= script_env_tick(env);
 		}
 
+		// destroy the assets let go of, such as those of past stages,
+		// which waits for the lists in flight which may draw them
+		if (resource_has_garbage()) {
+			ok &= renderer_call(collect_resources, NULL);
+		}
+
 		// render!
-		now = SDL_GetTicks();
-		renderer_clear();
+		struct RenderList *rndr_list = renderer_begin_frame();
+		if (!rndr_list) {
+			ok = 0;
+			break;
+		}
 		render_world(rndr_list, world);
-		render_ui(rndr_list);
-		render_list_exec(rndr_list);
-		renderer_present();
-		Uint32 render_time = SDL_GetTicks() - now;
+		if (ui_dirty) {
+			// the UI layer is retained by the renderer, thus it's
+			// recorded only when some of its elements change
+			render_list_begin_ui(rndr_list);
+			render_ui(rndr_list);
+			render_list_end_ui(rndr_list);
+			ui_dirty = 0;
+		}
+		ok &= renderer_end_frame(rndr_list);
+
+		// the counters are of interest frame by frame
+		if (renderer_get_debug() & RENDER_DEBUG_STATS) {
+			struct RenderStats stats;
+			renderer_get_stats(&stats);
+			text_set_fmt(
+				counters_text,
+				"%zu nodes, %lu draws, %lu pipelines, "
+				"%lu binds, %lu capture drops",
+				stats.node_count,
+				stats.draw_calls,
+				stats.pipeline_switches,
+				stats.texture_binds,
+				stats.capture_dropped
+			);
+			ui_dirty = 1;
+		}
+
+		// stop after given number of frames, if requested
+		total_frames++;
+		if (max_frames > 0 && total_frames >= max_frames) {
+			run = 0;
+		}
 
 		// each second, update the stats
 		if (time_acc >= 1.0) {
 			time_acc -= 1.0;
 
-			// update fps
-			text_set_fmt(fps_text, "FPS: %d", frame_count);
+			// update fps and frame times
+			struct RenderStats stats;
+			renderer_get_stats(&stats);
+			text_set_fmt(
+				fps_text,
+				"FPS: %d (CPU %.2fms, GPU %.2fms) "
+				"%lu elided, %zu culled, %zu particles",
+				frame_count,
+				stats.render_time,
+				stats.gpu_total_time,
+				stats.elided_calls,
+				stats.culled_nodes,
+				stats.particle_count
+			);
 			frame_count = 0;
+			ui_dirty = 1;
 
-			// update render time
+			// update render time breakdown and statistics
 			text_set_fmt(
 				render_time_text,
-				"Render time: %dms",
-				render_time
+				"Build %.2fms, sort %.2fms, submit %.2fms, present %.2fms",
+				stats.cpu_time.build,
+				stats.cpu_time.sort,
+				stats.cpu_time.submit,
+				stats.cpu_time.present
+			);
+			text_set_fmt(
+				pass_time_text,
+				"GPU bg/sprite/particle/text/widget/UI "
+				"%.2f/%.2f/%.2f/%.2f/%.2f/%.2fms, "
+				"%lu dropped",
+				stats.gpu_time[RENDER_PASS_BACKGROUND],
+				stats.gpu_time[RENDER_PASS_SPRITE],
+				stats.gpu_time[RENDER_PASS_PARTICLE],
+				stats.gpu_time[RENDER_PASS_TEXT],
+				stats.gpu_time[RENDER_PASS_WIDGET],
+				stats.gpu_time[RENDER_PASS_UI],
+				stats.gpu_dropped
 			);
 		}
 	}
 
+	// report the throughput, for comparing rendering backends
+	Uint32 elapsed = SDL_GetTicks() - start_time;
+	printf(
+		"%u frames in %ums (%.1f FPS)\n",
+		total_frames,
+		elapsed,
+		elapsed > 0 ? total_frames * 1000.0f / elapsed : 0.0f
+	);
+
 cleanup:
 	script_env_destroy(env);
 	world_destroy(world);
-	cleanup_resources();
+	renderer_set_frame_call(NULL, NULL);
+	renderer_call(cleanup_resources, NULL);
 	renderer_shutdown();
+	resource_shutdown();
+	font_cache_shutdown();
+	archive_unmount();
 
  	ok &= !error_is_set();
 	if (!ok) {
@@ -0,0 +1,278 @@
+#define _POSIX_C_SOURCE 200809L  // for opendir()
+
+#include "archive.h"
+#include "error.h"
+#include "image.h"
+#include "ioutils.h"
+#include "strutils.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef HAVE_LZ4
+# include <lz4.h>
+#endif
+
+/**
+ * File to pack.
+ */
+struct Item {
+	char *name;
+	int type;
+	int flags;
+	unsigned width, height;
+	char *data;       // as stored
+	size_t size;
+	size_t raw_size;  // uncompressed
+};
+
+static struct Item *items = NULL;
+static size_t item_count = 0;
+static size_t item_cap = 0;
+
+static int
+add_item(char *name)
+{
+	if (!name) {
+		error(ERR_NO_MEM);
+		return 0;
+	}
+	if (item_count == item_cap) {
+		size_t cap = item_cap ? item_cap * 2 : 64;
+		struct Item *tmp = realloc(items, sizeof(struct Item) * cap);
+		if (!tmp) {
+			error(ERR_NO_MEM);
+			free(name);
+			return 0;
+		}
+		items = tmp;
+		item_cap = cap;
+	}
+	struct Item *item = &items[item_count++];
+	memset(item, 0, sizeof(struct Item));
+	item->name = name;
+	return 1;
+}
+
+/**
+ * Add the files of a directory and of its subdirectories, skipping hidden
+ * ones.
+ */
+static int
+collect_files(const char *path)
+{
+	DIR *dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "unable to open directory `%s`\n", path);
+		error(ERR_FILE_READ);
+		return 0;
+	}
+
+	int ok = 1;
+	struct dirent *entry;
+	while (ok && (entry = readdir(dir))) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+		char *name = string_fmt("%s/%s", path, entry->d_name);
+		struct stat st;
+		if (!name || stat(name, &st) != 0) {
+			error(ERR_FILE_READ);
+			ok = 0;
+		} else if (S_ISDIR(st.st_mode)) {
+			ok = collect_files(name);
+		} else if (S_ISREG(st.st_mode)) {
+			ok = add_item(name);
+			name = NULL;
+		}
+		free(name);
+	}
+
+	closedir(dir);
+	return ok;
+}
+
+static int
+item_cmp(const void *a, const void *b)
+{
+	return strcmp(
+		((const struct Item*)a)->name,
+		((const struct Item*)b)->name
+	);
+}
+
+/**
+ * Load the data of an item, decoding images.
+ */
+static int
+load_item(struct Item *item, int compress)
+{
+	const char *ext = strrchr(item->name, '.');
+	if (ext && strcmp(ext, ".png") == 0) {
+		item->type = ARCHIVE_ENTRY_IMAGE;
+		item->data = image_read_png(
+			item->name,
+			&item->width,
+			&item->height
+		);
+		item->size = item->width * item->height * 4;
+	} else {
+		item->type = ARCHIVE_ENTRY_FILE;
+		item->size = file_read(item->name, &item->data);
+	}
+	if (!item->data) {
+		fprintf(stderr, "failed to read `%s`\n", item->name);
+		return 0;
+	}
+	item->raw_size = item->size;
+
+#ifdef HAVE_LZ4
+	// keep the compressed data only if smaller
+	if (compress && item->size > 0) {
+		int bound = LZ4_compressBound(item->size);
+		char *packed = malloc(bound);
+		if (!packed) {
+			error(ERR_NO_MEM);
+			return 0;
+		}
+		int size = LZ4_compress_default(
+			item->data,
+			packed,
+			item->size,
+			bound
+		);
+		if (size > 0 && (size_t)size < item->size) {
+			free(item->data);
+			item->data = packed;
+			item->size = size;
+			item->flags |= ARCHIVE_ENTRY_LZ4;
+		} else {
+			free(packed);
+		}
+	}
+#else
+	(void)compress;
+#endif
+
+	return 1;
+}
+
+static size_t
+align(size_t offset)
+{
+	return (offset + ARCHIVE_ALIGN - 1) & ~(size_t)(ARCHIVE_ALIGN - 1);
+}
+
+/**
+ * Write the archive: the header, the index, the names and then the data of
+ * all the items.
+ */
+static int
+write_archive(const char *filename)
+{
+	size_t index_end = (
+		sizeof(struct ArchiveHeader) +
+		sizeof(struct ArchiveEntry) * item_count
+	);
+	size_t size = index_end;
+	for (size_t i = 0; i < item_count; i++) {
+		size += strlen(items[i].name) + 1;
+	}
+	size_t data_start = size = align(size);
+	for (size_t i = 0; i < item_count; i++) {
+		size = align(size + items[i].size);
+	}
+
+	char *buf = calloc(1, size);
+	if (!buf) {
+		error(ERR_NO_MEM);
+		return 0;
+	}
+	struct ArchiveHeader *hdr = (void*)buf;
+	hdr->magic = ARCHIVE_MAGIC;
+	hdr->version = ARCHIVE_VERSION;
+	hdr->entry_count = item_count;
+
+	struct ArchiveEntry *entries = (void*)(hdr + 1);
+	size_t name_offset = index_end;
+	size_t data_offset = data_start;
+	for (size_t i = 0; i < item_count; i++) {
+		const struct Item *item = &items[i];
+		struct ArchiveEntry *e = &entries[i];
+		e->name = name_offset;
+		e->type = item->type;
+		e->flags = item->flags;
+		e->width = item->width;
+		e->height = item->height;
+		e->offset = data_offset;
+		e->size = item->size;
+		e->raw_size = item->raw_size;
+
+		size_t name_len = strlen(item->name) + 1;
+		memcpy(buf + name_offset, item->name, name_len);
+		name_offset += name_len;
+		memcpy(buf + data_offset, item->data, item->size);
+		data_offset = align(data_offset + item->size);
+	}
+
+	int ok = file_write(filename, buf, size);
+	free(buf);
+	if (ok) {
+		printf(
+			"packed %zu files in `%s`, %zu bytes\n",
+			item_count,
+			filename,
+			size
+		);
+	}
+	return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int compress = 0;
+	const char *dir = NULL, *filename = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--lz4") == 0) {
+			compress = 1;
+		} else if (!dir) {
+			dir = argv[i];
+		} else if (!filename) {
+			filename = argv[i];
+		}
+	}
+	if (!dir || !filename) {
+		fprintf(stderr, "usage: %s [--lz4] DIR ARCHIVE\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+#ifndef HAVE_LZ4
+	if (compress) {
+		fprintf(stderr, "no LZ4 support built in, ignoring --lz4\n");
+	}
+#endif
+
+	// entries are sorted by name, so that they can be looked up by binary
+	// search
+	int ok = collect_files(dir);
+	if (ok) {
+		qsort(items, item_count, sizeof(struct Item), item_cmp);
+	}
+	for (size_t i = 0; ok && i < item_count; i++) {
+		ok = load_item(&items[i], compress);
+	}
+	ok = ok && write_archive(filename);
+
+	for (size_t i = 0; i < item_count; i++) {
+		free(items[i].name);
+		free(items[i].data);
+	}
+	free(items);
+
+	if (!ok) {
+		error_dump(stderr);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
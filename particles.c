@@ -0,0 +1,190 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "error.h"
+#include "matlib.h"
+#include "memory.h"
+#include "particles.h"
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE__
+# include <xmmintrin.h>
+#endif
+
+// alignment and width of SIMD lanes
+#define PARTICLE_ALIGN 16
+#define PARTICLE_LANES 4
+
+// number of per-particle arrays
+#define PARTICLE_ARRAYS 10
+
+struct ParticleEmitter*
+particle_emitter_new(
+	const struct Texture *texture,
+	size_t capacity,
+	float size
+) {
+	assert(texture != NULL);
+	assert(capacity > 0);
+
+	struct ParticleEmitter *em = make(struct ParticleEmitter);
+	if (!em) {
+		return NULL;
+	}
+	em->texture = texture;
+	em->size = size;
+	em->seed = 0x9e3779b9;
+
+	// round the capacity up to a whole number of lanes, so that the
+	// arrays can be processed without a scalar tail
+	capacity = (capacity + PARTICLE_LANES - 1) & ~(PARTICLE_LANES - 1);
+	em->capacity = capacity;
+
+	// allocate all the arrays in a single aligned block
+	void *block = NULL;
+	size_t size_bytes = sizeof(float) * capacity * PARTICLE_ARRAYS;
+	if (posix_memalign(&block, PARTICLE_ALIGN, size_bytes) != 0) {
+		error(ERR_NO_MEM);
+		destroy(em);
+		return NULL;
+	}
+	float **arrays[PARTICLE_ARRAYS] = {
+		&em->x, &em->y,
+		&em->vx, &em->vy,
+		&em->life, &em->fade,
+		&em->r, &em->g, &em->b, &em->a
+	};
+	memset(block, 0, size_bytes);
+	for (unsigned i = 0; i < PARTICLE_ARRAYS; i++) {
+		*arrays[i] = (float*)block + capacity * i;
+	}
+
+	return em;
+}
+
+void
+particle_emitter_destroy(struct ParticleEmitter *em)
+{
+	if (em) {
+		free(em->x);
+		destroy(em);
+	}
+}
+
+/**
+ * Get a random number in given range, with a xorshift generator.
+ */
+static float
+random_range(uint32_t *seed, const float range[2])
+{
+	uint32_t s = *seed;
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+	*seed = s;
+	return range[0] + (range[1] - range[0]) * (s / 4294967296.0f);
+}
+
+unsigned
+particle_emitter_emit(
+	struct ParticleEmitter *em,
+	const struct ParticleBurst *burst
+) {
+	static const float angle_range[2] = { 0, 2 * M_PI };
+
+	unsigned count = burst->count;
+	if (count > em->capacity - em->count) {
+		count = em->capacity - em->count;
+	}
+
+	for (size_t i = em->count; i < em->count + count; i++) {
+		float angle = random_range(&em->seed, angle_range);
+		float speed = random_range(&em->seed, burst->speed);
+		float life = random_range(&em->seed, burst->life);
+		em->x[i] = burst->x;
+		em->y[i] = burst->y;
+		em->vx[i] = burst->vx + cosf(angle) * speed;
+		em->vy[i] = burst->vy + sinf(angle) * speed;
+		em->life[i] = life;
+		em->fade[i] = life > 0 ? 1.0f / life : 0;
+		em->r[i] = burst->color[0];
+		em->g[i] = burst->color[1];
+		em->b[i] = burst->color[2];
+		em->a[i] = burst->color[3];
+	}
+	em->count += count;
+
+	return count;
+}
+
+/**
+ * Integrate the particles, returning whether any of them expired.
+ */
+static int
+integrate(struct ParticleEmitter *em, float dt)
+{
+	int expired = 0;
+
+#ifdef __SSE__
+	// the arrays are padded to a whole number of lanes, elements past the
+	// last particle are processed too, but their expiration is ignored
+	size_t count = em->count;
+	__m128 vdt = _mm_set1_ps(dt);
+	__m128 zero = _mm_setzero_ps();
+	for (size_t i = 0; i < count; i += PARTICLE_LANES) {
+		__m128 x = _mm_load_ps(em->x + i);
+		__m128 y = _mm_load_ps(em->y + i);
+		__m128 vx = _mm_load_ps(em->vx + i);
+		__m128 vy = _mm_load_ps(em->vy + i);
+		__m128 life = _mm_load_ps(em->life + i);
+		x = _mm_add_ps(x, _mm_mul_ps(vx, vdt));
+		y = _mm_add_ps(y, _mm_mul_ps(vy, vdt));
+		life = _mm_sub_ps(life, vdt);
+		_mm_store_ps(em->x + i, x);
+		_mm_store_ps(em->y + i, y);
+		_mm_store_ps(em->life + i, life);
+		int mask = _mm_movemask_ps(_mm_cmple_ps(life, zero));
+		if (count - i < PARTICLE_LANES) {
+			mask &= (1 << (count - i)) - 1;
+		}
+		expired |= mask;
+	}
+#else
+	for (size_t i = 0; i < em->count; i++) {
+		em->x[i] += em->vx[i] * dt;
+		em->y[i] += em->vy[i] * dt;
+		em->life[i] -= dt;
+		expired |= em->life[i] <= 0;
+	}
+#endif
+
+	return expired;
+}
+
+void
+particle_emitter_update(struct ParticleEmitter *em, float dt)
+{
+	if (em->count == 0 || !integrate(em, dt)) {
+		return;
+	}
+
+	// remove expired particles by moving the last ones in their place
+	float *arrays[PARTICLE_ARRAYS] = {
+		em->x, em->y,
+		em->vx, em->vy,
+		em->life, em->fade,
+		em->r, em->g, em->b, em->a
+	};
+	size_t i = 0;
+	while (i < em->count) {
+		if (em->life[i] > 0) {
+			i++;
+			continue;
+		}
+		size_t last = --em->count;
+		for (unsigned a = 0; a < PARTICLE_ARRAYS; a++) {
+			arrays[a][i] = arrays[a][last];
+		}
+	}
+}
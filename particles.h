@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Texture;
+
+/**
+ * Parameters of a burst of particles.
+ *
+ * Particles fly away from the origin in random directions, on top of the
+ * velocity shared by all of them.
+ */
+struct ParticleBurst {
+	float x, y;        // origin
+	float vx, vy;      // shared velocity (units/second)
+	float speed[2];    // range of radial speed (units/second)
+	float life[2];     // range of lifetime (seconds)
+	float color[4];    // RGBA, alpha fades out over the lifetime
+	unsigned count;
+};
+
+/**
+ * Particle emitter.
+ *
+ * Particles are stored in a structure of arrays of fixed capacity, which
+ * are simulated four elements at a time with SSE, when available. All of
+ * them are drawn as squares of the same size, with the same texture.
+ */
+struct ParticleEmitter {
+	const struct Texture *texture;
+	float size;
+	size_t capacity;
+	size_t count;
+	float *x, *y;
+	float *vx, *vy;
+	float *life;  // remaining lifetime (seconds)
+	float *fade;  // reciprocal of the total lifetime
+	float *r, *g, *b, *a;
+	uint32_t seed;
+};
+
+/**
+ * Create a particle emitter holding up to `capacity` live particles.
+ */
+struct ParticleEmitter*
+particle_emitter_new(
+	const struct Texture *texture,
+	size_t capacity,
+	float size
+);
+
+/**
+ * Destroy a particle emitter.
+ */
+void
+particle_emitter_destroy(struct ParticleEmitter *em);
+
+/**
+ * Emit a burst of particles.
+ *
+ * Particles exceeding the capacity of the emitter are dropped. Returns the
+ * number of particles emitted.
+ */
+unsigned
+particle_emitter_emit(
+	struct ParticleEmitter *em,
+	const struct ParticleBurst *burst
+);
+
+/**
+ * Advance the particles by given delta time, removing the expired ones.
+ */
+void
+particle_emitter_update(struct ParticleEmitter *em, float dt);
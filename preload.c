@@ -0,0 +1,339 @@
+#include "error.h"
+#include "loader.h"
+#include "memory.h"
+#include "preload.h"
+#include "resource.h"
+#include "strutils.h"
+#include <SDL.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// assets created after each frame, at most
+#define PRELOAD_JOBS_PER_FRAME 2
+
+enum {
+	CMD_ADD = 1,
+	CMD_RELEASE,
+};
+
+struct Command {
+	int op;
+	int stage;
+	int type;
+	char *filename;
+};
+
+/**
+ * Asset held for a stage.
+ */
+struct Held {
+	int stage;
+	void *asset;
+};
+
+/**
+ * Growable array of commands.
+ */
+struct CommandQueue {
+	struct Command *commands;
+	size_t count;
+	size_t cap;
+};
+
+struct Preloader {
+	SDL_mutex *lock;
+	struct CommandQueue queued;   // by any thread, under the lock
+	struct CommandQueue pending;  // taken by the render thread
+	size_t pending_head;          // first pending command not executed
+	struct Loader *ldr;
+	struct Held *batch;           // assets being loaded
+	size_t batch_count;
+	struct Held *held;            // assets of stages not released yet
+	size_t held_count;
+	size_t held_cap;
+};
+
+struct Preloader*
+preloader_new(void)
+{
+	struct Preloader *pl = make(struct Preloader);
+	if (!pl) {
+		return NULL;
+	}
+	if (!(pl->lock = SDL_CreateMutex())) {
+		error(ERR_SDL);
+		preloader_destroy(pl);
+		return NULL;
+	}
+	if (!(pl->ldr = loader_new())) {
+		preloader_destroy(pl);
+		return NULL;
+	}
+	return pl;
+}
+
+static void
+clear_commands(struct CommandQueue *q, size_t start)
+{
+	for (size_t i = start; i < q->count; i++) {
+		free(q->commands[i].filename);
+	}
+	q->count = 0;
+}
+
+void
+preloader_destroy(struct Preloader *pl)
+{
+	if (pl) {
+		// wait for the workers, then let go of what's loaded
+		loader_destroy(pl->ldr);
+		for (size_t i = 0; i < pl->batch_count; i++) {
+			resource_release(pl->batch[i].asset);
+		}
+		free(pl->batch);
+		for (size_t i = 0; i < pl->held_count; i++) {
+			resource_release(pl->held[i].asset);
+		}
+		free(pl->held);
+
+		clear_commands(&pl->queued, 0);
+		free(pl->queued.commands);
+		clear_commands(&pl->pending, pl->pending_head);
+		free(pl->pending.commands);
+		if (pl->lock) {
+			SDL_DestroyMutex(pl->lock);
+		}
+		destroy(pl);
+	}
+}
+
+static int
+push_command(struct CommandQueue *q, const struct Command *cmd)
+{
+	if (q->count == q->cap) {
+		size_t cap = q->cap ? q->cap * 2 : 16;
+		struct Command *commands = realloc(
+			q->commands,
+			sizeof(struct Command) * cap
+		);
+		if (!commands) {
+			error(ERR_NO_MEM);
+			return 0;
+		}
+		q->commands = commands;
+		q->cap = cap;
+	}
+	q->commands[q->count++] = *cmd;
+	return 1;
+}
+
+static int
+queue_command(struct Preloader *pl, struct Command *cmd)
+{
+	SDL_LockMutex(pl->lock);
+	int ok = push_command(&pl->queued, cmd);
+	SDL_UnlockMutex(pl->lock);
+	if (!ok) {
+		free(cmd->filename);
+	}
+	return ok;
+}
+
+int
+preloader_add(
+	struct Preloader *pl,
+	int stage,
+	int type,
+	const char *filename
+) {
+	assert(pl != NULL);
+	assert(type == RESOURCE_TEXTURE || type == RESOURCE_SPRITE);
+	assert(filename != NULL);
+
+	struct Command cmd = { CMD_ADD, stage, type, string_copy(filename) };
+	if (!cmd.filename) {
+		error(ERR_NO_MEM);
+		return 0;
+	}
+	return queue_command(pl, &cmd);
+}
+
+int
+preloader_release(struct Preloader *pl, int stage)
+{
+	assert(pl != NULL);
+
+	struct Command cmd = { CMD_RELEASE, stage, 0, NULL };
+	return queue_command(pl, &cmd);
+}
+
+/**
+ * Hold the loaded assets of the batch, skipping those which failed.
+ */
+static int
+hold_batch(struct Preloader *pl)
+{
+	int ok = 1;
+	size_t loaded = 0;
+	for (size_t i = 0; i < pl->batch_count; i++) {
+		if (!pl->batch[i].asset) {
+			continue;
+		}
+		if (pl->held_count == pl->held_cap) {
+			size_t cap = pl->held_cap ? pl->held_cap * 2 : 64;
+			struct Held *held = realloc(
+				pl->held,
+				sizeof(struct Held) * cap
+			);
+			if (!held) {
+				error(ERR_NO_MEM);
+				resource_release(pl->batch[i].asset);
+				ok = 0;
+				continue;
+			}
+			pl->held = held;
+			pl->held_cap = cap;
+		}
+		pl->held[pl->held_count++] = pl->batch[i];
+		loaded++;
+	}
+	printf("preloaded %zu of %zu assets\n", loaded, pl->batch_count);
+
+	free(pl->batch);
+	pl->batch = NULL;
+	pl->batch_count = 0;
+	return ok;
+}
+
+static void
+release_stage(struct Preloader *pl, int stage)
+{
+	size_t released = 0;
+	for (size_t i = 0; i < pl->held_count; ) {
+		if (pl->held[i].stage == stage) {
+			resource_release(pl->held[i].asset);
+			pl->held[i] = pl->held[--pl->held_count];
+			released++;
+		} else {
+			i++;
+		}
+	}
+	if (released > 0) {
+		printf("released %zu assets of stage %d\n", released, stage);
+	}
+}
+
+/**
+ * Start loading the assets added by consecutive pending commands.
+ */
+static int
+start_batch(struct Preloader *pl)
+{
+	const struct Command *cmds = &pl->pending.commands[pl->pending_head];
+	size_t count = 0;
+	while (pl->pending_head + count < pl->pending.count &&
+	       cmds[count].op == CMD_ADD) {
+		count++;
+	}
+
+	// the batch is allocated whole, since the loader stores the assets
+	// right into it
+	if (!(pl->batch = calloc(count, sizeof(struct Held)))) {
+		error(ERR_NO_MEM);
+		return 0;
+	}
+	pl->batch_count = count;
+
+	int ok = 1;
+	for (size_t i = 0; i < count; i++) {
+		const struct Command *cmd = &cmds[i];
+		struct Held *held = &pl->batch[i];
+		held->stage = cmd->stage;
+		if (cmd->type == RESOURCE_TEXTURE) {
+			ok &= loader_add_texture(
+				pl->ldr,
+				cmd->filename,
+				(struct Texture**)&held->asset
+			);
+		} else {
+			ok &= loader_add_sprite(
+				pl->ldr,
+				cmd->filename,
+				(struct Sprite**)&held->asset
+			);
+		}
+		free(cmd->filename);
+	}
+	pl->pending_head += count;
+	return loader_start(pl->ldr) && ok;
+}
+
+int
+preloader_update(struct Preloader *pl)
+{
+	assert(pl != NULL);
+
+	// create a few of the assets being loaded, until all of them are
+	if (pl->batch) {
+		if (loader_poll(pl->ldr, PRELOAD_JOBS_PER_FRAME, NULL, NULL)) {
+			return 1;
+		}
+		loader_finish(pl->ldr, NULL, NULL);
+		if (!hold_batch(pl)) {
+			return 0;
+		}
+	}
+
+	// take the queued commands, after those left from before
+	struct CommandQueue *q = &pl->pending;
+	if (pl->pending_head > 0) {
+		q->count -= pl->pending_head;
+		memmove(
+			q->commands,
+			q->commands + pl->pending_head,
+			sizeof(struct Command) * q->count
+		);
+		pl->pending_head = 0;
+	}
+	int ok = 1;
+	SDL_LockMutex(pl->lock);
+	for (size_t i = 0; ok && i < pl->queued.count; i++) {
+		ok = push_command(&pl->pending, &pl->queued.commands[i]);
+		if (ok) {
+			pl->queued.commands[i].filename = NULL;
+		}
+	}
+	clear_commands(&pl->queued, 0);
+	SDL_UnlockMutex(pl->lock);
+
+	// execute the releases, up to the next batch of assets
+	while (ok && pl->pending_head < q->count) {
+		const struct Command *cmd = &q->commands[pl->pending_head];
+		if (cmd->op == CMD_ADD) {
+			ok = start_batch(pl);
+			break;
+		}
+		release_stage(pl, cmd->stage);
+		pl->pending_head++;
+	}
+	return ok;
+}
+
+int
+preloader_flush(struct Preloader *pl)
+{
+	assert(pl != NULL);
+
+	// finish each batch at once, then carry on with the next commands
+	int ok = 1;
+	do {
+		if (pl->batch) {
+			loader_finish(pl->ldr, NULL, NULL);
+			ok &= hold_batch(pl);
+		}
+		ok &= preloader_update(pl);
+	} while (ok && pl->batch);
+	return ok;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/**
+ * Stage asset preloader.
+ *
+ * Level scripts declare the textures and sprites each stage needs ahead of
+ * it; they're decoded in the background by the loader workers while the
+ * current stage plays, and created a few at a time after each frame on the
+ * render thread, so that no frame stalls on them. The preloader holds a
+ * reference to the assets of each stage until the stage is released, then
+ * they're left idle in the resource cache, evicted once over the budget.
+ */
+struct Preloader;
+
+struct Preloader*
+preloader_new(void);
+
+/**
+ * Destroy the preloader, releasing the assets of all the stages.
+ *
+ * NOTE: Must be called on the render thread.
+ */
+void
+preloader_destroy(struct Preloader *pl);
+
+/**
+ * Queue an asset of a stage, of type `RESOURCE_TEXTURE` or
+ * `RESOURCE_SPRITE`.
+ *
+ * Can be called from any thread.
+ */
+int
+preloader_add(
+	struct Preloader *pl,
+	int stage,
+	int type,
+	const char *filename
+);
+
+/**
+ * Queue the release of the assets of a stage, once those queued before are
+ * loaded.
+ *
+ * Can be called from any thread.
+ */
+int
+preloader_release(struct Preloader *pl, int stage);
+
+/**
+ * Carry on with the queued work, creating a few assets at most.
+ *
+ * Meant to be called after each frame, see `renderer_set_frame_call()`.
+ * Assets which fail to load are reported and skipped.
+ *
+ * NOTE: Must be called on the render thread.
+ */
+int
+preloader_update(struct Preloader *pl);
+
+/**
+ * Carry out all the queued work, waiting for the assets to be loaded.
+ *
+ * Meant for the assets needed right away, such as those of the first
+ * stages.
+ *
+ * NOTE: Must be called on the render thread.
+ */
+int
+preloader_flush(struct Preloader *pl);
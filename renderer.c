@@ -1,89 +1,530 @@
+#include "animation.h"
+#include "capture.h"
 #include "error.h"
 #include "font.h"
+#include "gputimer.h"
+#include "image.h"
+#include "label.h"
 #include "matlib.h"
 #include "memory.h"
+#include "particles.h"
 #include "renderer.h"
+#include "resource.h"
 #include "shader.h"
 #include "sprite.h"
+#include "stream.h"
+#include "strutils.h"
+#include "swrender.h"
 #include "text.h"
 #include "texture.h"
 #include "widget.h"
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define RENDER_LIST_MAX_LEN 1000
+#define RENDER_LIST_MAX_GLYPHS 8192
+#define RENDER_LIST_MAX_PARTICLES (128 * 1024)
+
+// fraction of label lifetime over which labels shrink away
+#define LABEL_SHRINK_FRACTION 0.25f
+#define STREAM_BUFFER_FRAME_SIZE (4 * 1024 * 1024)
 #define SPRITE_TEXTURE_UNIT 0
-#define TEXT_GLYPH_TEXTURE_UNIT 1
-#define TEXT_ATLAS_TEXTURE_UNIT 2
-#define WIDGET_TEXTURE_UNIT 3
+#define TEXT_ATLAS_TEXTURE_UNIT 1
+#define WIDGET_TEXTURE_UNIT 2
+#define SPRITE_ARRAY_TEXTURE_UNIT 3
+#define PARTICLE_TEXTURE_UNIT 4
+#define TEXTURE_UNIT_COUNT 5
+
+// number of overdraw levels told apart by the heatmap
+#define OVERDRAW_LEVELS 8
+
+// number of render lists which can be recorded or executed concurrently;
+// with 2, the simulation of frame N+1 overlaps the submission of frame N,
+// with 3, the main thread may run up to two frames ahead
+#define RENDER_FRAMES_IN_FLIGHT 2
 
 enum {
 	RENDER_NODE_SPRITE,
+	RENDER_NODE_PARTICLES,
 	RENDER_NODE_TEXT,
 	RENDER_NODE_WIDGET,
 };
 
+enum {
+	RENDER_LAYER_WORLD,
+	RENDER_LAYER_UI,
+};
+
+enum {
+	PIPELINE_SPRITE,
+	PIPELINE_SPRITE_ARRAY,
+	PIPELINE_PARTICLE,
+	PIPELINE_TEXT,
+	PIPELINE_WIDGET,
+};
+
+/**
+ * Per-instance attributes of sprite pipeline.
+ */
+struct SpriteInstance {
+	GLfloat position[2];
+	GLfloat size[2];
+	GLfloat angle;
+
+	// used only by sprites stored in array textures
+	GLuint layer;       // first frame layer
+	GLuint frames[2];   // flipbook frame count and playback mode
+	GLfloat timing[2];  // flipbook start time and frame rate
+};
+
+/**
+ * Per-instance attributes of particle pipeline.
+ */
+struct ParticleInstance {
+	GLfloat position[2];
+	GLfloat size;
+	GLubyte color[4];
+};
+
+/**
+ * Per-instance attributes of text pipeline, one for each glyph.
+ */
+struct GlyphInstance {
+	GLfloat coord[2];
+	GLushort rect[4];  // glyph atlas rectangle, filled at execution
+	GLfloat style[3];  // scale, outline and glow widths in field units
+	GLuint chr;        // Unicode code point, not passed to the shader
+};
+
+/**
+ * Per-instance attributes of widget pipeline.
+ */
+struct WidgetInstance {
+	GLfloat position[2];
+	GLfloat size[2];
+	GLuint border[2];
+};
+
+/**
+ * Layout of an instance attribute within the stream buffer.
+ *
+ * Non-integer attributes of integer types are normalized.
+ */
+struct InstanceAttrib {
+	GLuint index;
+	GLint size;
+	GLenum type;
+	int integer;
+	size_t offset;
+};
+
+static const struct InstanceAttrib sprite_attribs[] = {
+	{ 0, 2, GL_FLOAT, 0, offsetof(struct SpriteInstance, position) },
+	{ 1, 2, GL_FLOAT, 0, offsetof(struct SpriteInstance, size) },
+	{ 2, 1, GL_FLOAT, 0, offsetof(struct SpriteInstance, angle) },
+	{ 0, 0 }
+};
+
+static const struct InstanceAttrib sprite_array_attribs[] = {
+	{ 0, 2, GL_FLOAT, 0, offsetof(struct SpriteInstance, position) },
+	{ 1, 2, GL_FLOAT, 0, offsetof(struct SpriteInstance, size) },
+	{ 2, 1, GL_FLOAT, 0, offsetof(struct SpriteInstance, angle) },
+	{ 3, 1, GL_UNSIGNED_INT, 1, offsetof(struct SpriteInstance, layer) },
+	{ 4, 2, GL_UNSIGNED_INT, 1, offsetof(struct SpriteInstance, frames) },
+	{ 5, 2, GL_FLOAT, 0, offsetof(struct SpriteInstance, timing) },
+	{ 0, 0 }
+};
+
+static const struct InstanceAttrib particle_attribs[] = {
+	{ 0, 2, GL_FLOAT, 0, offsetof(struct ParticleInstance, position) },
+	{ 1, 1, GL_FLOAT, 0, offsetof(struct ParticleInstance, size) },
+	{ 2, 4, GL_UNSIGNED_BYTE, 0, offsetof(struct ParticleInstance, color) },
+	{ 0, 0 }
+};
+
+static const struct InstanceAttrib glyph_attribs[] = {
+	{ 0, 2, GL_FLOAT, 0, offsetof(struct GlyphInstance, coord) },
+	{ 1, 4, GL_UNSIGNED_SHORT, 1, offsetof(struct GlyphInstance, rect) },
+	{ 2, 3, GL_FLOAT, 0, offsetof(struct GlyphInstance, style) },
+	{ 0, 0 }
+};
+
+static const struct InstanceAttrib widget_attribs[] = {
+	{ 0, 2, GL_FLOAT, 0, offsetof(struct WidgetInstance, position) },
+	{ 1, 2, GL_FLOAT, 0, offsetof(struct WidgetInstance, size) },
+	{ 2, 2, GL_UNSIGNED_INT, 1, offsetof(struct WidgetInstance, border) },
+	{ 0, 0 }
+};
+
 static struct Renderer {
 	int initialized;
+	int backend;
 	SDL_Window *win;
 	SDL_GLContext *ctx;
 	int width, height;
 	Mat projection;
+	struct StreamBuffer *stream;
+	struct GpuTimer *timer;
+	struct Capture *capture;
+	struct RenderStats stats;        // published to other threads
+	struct RenderStats frame_stats;  // collected by the render thread
+	struct {
+		uint32_t *pixels;  // last presented software frame
+		unsigned index;
+		char *dump_prefix;
+	} frame;
+	SDL_atomic_t debug;  // `RENDER_DEBUG_*` flags
+	unsigned long frame_number;  // executed lists, stamps glyph atlas usage
+	struct {
+		FILE *file;          // per-frame statistics CSV export
+		unsigned long row;
+	} stats_export;
+	struct {
+		GLuint active_unit;
+		struct {
+			GLenum target;
+			GLuint hnd;
+		} textures[TEXTURE_UNIT_COUNT];
+		GLuint vao;
+		const Mat *projection;
+		float time;
+	} state;
+	struct {
+		struct RenderList *list;  // retained UI nodes
+		int dirty;                // list changed since last redraw
+		struct Texture texture;
+		GLuint fbo;
+		Mat projection;           // flipped, for top to bottom rows
+	} ui_layer;
+	struct {
+		SDL_Thread *thread;
+		SDL_mutex *lock;
+		SDL_cond *cond;
+		int quit;
+		int exited;                   // no longer serving requests
+		unsigned long failed_frames;  // frames or frame calls failed
+		struct RenderList *lists[RENDER_FRAMES_IN_FLIGHT];
+		struct RenderList *free[RENDER_FRAMES_IN_FLIGHT];
+		size_t free_count;
+		struct RenderList *queue[RENDER_FRAMES_IN_FLIGHT];
+		size_t queue_head, queue_len;
+		struct {
+			RenderCallFunc func;
+			void *userdata;
+			int result;
+			int pending;
+		} call;
+		struct {
+			RenderCallFunc func;
+			void *userdata;
+		} frame_call;
+	} worker;
+	struct {
+		struct Shader *shader;
+		GLuint vao;  // empty, vertices are generated by the shader
+		struct ShaderUniform u_scroll;
+	} background_pipeline;
+	struct {
+		struct Shader *shader;
+		struct ShaderUniform u_color;
+	} overdraw_pipeline;
 	struct {
 		struct Shader *shader;
+		GLuint vao;
 		struct ShaderUniform u_texture;
-		struct ShaderUniform u_size;
-		struct ShaderUniform u_transform;
+		struct ShaderUniform u_projection;
 	} sprite_pipeline;
 	struct {
 		struct Shader *shader;
-		struct ShaderUniform u_transform;
-		struct ShaderUniform u_glyph_texture;
+		GLuint vao;
+		struct ShaderUniform u_texture;
+		struct ShaderUniform u_projection;
+		struct ShaderUniform u_time;
+	} sprite_array_pipeline;
+	struct {
+		struct Shader *shader;
+		GLuint vao;
+		struct ShaderUniform u_texture;
+		struct ShaderUniform u_projection;
+	} particle_pipeline;
+	struct {
+		struct Shader *shader;
+		GLuint vao;
+		struct ShaderUniform u_projection;
 		struct ShaderUniform u_atlas_texture;
-		struct ShaderUniform u_atlas_offset;
 	} text_pipeline;
 	struct {
 		struct Shader *shader;
+		GLuint vao;
 		struct ShaderUniform u_texture;
-		struct ShaderUniform u_size;
-		struct ShaderUniform u_border;
-		struct ShaderUniform u_transform;
+		struct ShaderUniform u_projection;
 	} widget_pipeline;
-} rndr = { 0, NULL, NULL };
+} rndr = { 0, RENDER_BACKEND_OPENGL, NULL, NULL };
 
 struct RenderNode {
 	int type;
-	Mat transform;
+	int layer;
+	size_t index;
 	union {
-		struct Sprite *sprite;
-		struct Text *text;
-		struct Widget *widget;
+		struct {
+			const struct Texture *texture;
+			struct SpriteInstance instance;
+		} sprite;
+		struct {
+			const struct Texture *texture;
+			size_t first;
+			size_t len;
+		} particles;
+		struct {
+			const struct Font *font;
+			size_t first;
+			size_t len;
+		} text;
+		struct {
+			const struct Texture *texture;
+			struct WidgetInstance instance;
+		} widget;
 	};
 };
 
 struct RenderList {
 	struct RenderNode nodes[RENDER_LIST_MAX_LEN];
 	size_t len;
+	struct GlyphInstance glyphs[RENDER_LIST_MAX_GLYPHS];
+	size_t glyph_count;
+	struct ParticleInstance particles[RENDER_LIST_MAX_PARTICLES];
+	size_t particle_count;
+	size_t culled;
+	float time;    // for flipbook animations
+	float scroll;  // background scroll offset
+	int layer;     // layer of the nodes being added
+	int ui_dirty;  // whether UI layer was recorded
+	Uint64 build_start;
+	float build_time;
 };
 
+/**
+ * Milliseconds elapsed since given performance counter value.
+ */
+static float
+elapsed_ms(Uint64 since)
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+	return (now - since) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+/**
+ * Forget cached OpenGL state.
+ *
+ * Must be called before rendering, since textures and vertex arrays may be
+ * bound outside of the renderer, e.g. while loading resources.
+ */
+static void
+reset_state(void)
+{
+	memset(&rndr.state, 0, sizeof(rndr.state));
+	rndr.state.projection = &rndr.projection;
+	glActiveTexture(GL_TEXTURE0);
+}
+
+static void
+bind_texture(GLuint unit, GLenum target, GLuint hnd)
+{
+	assert(unit < TEXTURE_UNIT_COUNT);
+	if (rndr.state.textures[unit].target == target &&
+	    rndr.state.textures[unit].hnd == hnd) {
+		rndr.frame_stats.elided_calls++;
+		return;
+	}
+	if (rndr.state.active_unit != unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		rndr.state.active_unit = unit;
+	}
+	glBindTexture(target, hnd);
+	rndr.frame_stats.texture_binds++;
+	rndr.state.textures[unit].target = target;
+	rndr.state.textures[unit].hnd = hnd;
+}
+
+static void
+bind_vertex_array(GLuint vao)
+{
+	if (rndr.state.vao == vao) {
+		rndr.frame_stats.elided_calls++;
+		return;
+	}
+	glBindVertexArray(vao);
+	rndr.state.vao = vao;
+}
+
+static GLuint
+init_instance_vao(const struct InstanceAttrib *attribs)
+{
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	for (unsigned i = 0; attribs[i].size != 0; i++) {
+		glEnableVertexAttribArray(attribs[i].index);
+		glVertexAttribDivisor(attribs[i].index, 1);
+	}
+	glBindVertexArray(0);
+
+	if (glGetError() != GL_NO_ERROR) {
+		glDeleteVertexArrays(1, &vao);
+		return 0;
+	}
+	return vao;
+}
+
+/**
+ * Point the instance attributes of given VAO to a chunk of stream buffer.
+ */
+static void
+bind_instance_attribs(
+	GLuint vao,
+	const struct InstanceAttrib *attribs,
+	GLsizei stride,
+	GLintptr offset
+) {
+	bind_vertex_array(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, stream_buffer_get_handle(rndr.stream));
+	for (unsigned i = 0; attribs[i].size != 0; i++) {
+		const struct InstanceAttrib *a = &attribs[i];
+		GLvoid *ptr = (GLvoid*)(offset + a->offset);
+		if (a->integer) {
+			glVertexAttribIPointer(a->index, a->size, a->type, stride, ptr);
+		} else {
+			glVertexAttribPointer(
+				a->index,
+				a->size,
+				a->type,
+				a->type != GL_FLOAT,
+				stride,
+				ptr
+			);
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+ * Get a shader program from the resource manager and look up its uniforms
+ * and uniform blocks, see `shader_compile()`.
+ */
+static struct Shader*
+load_shader(
+	const char *vert_src_filename,
+	const char *frag_src_filename,
+	const char *uniform_names[],
+	struct ShaderUniform *r_uniforms[],
+	const char *uniform_block_names[],
+	struct ShaderUniformBlock *r_uniform_blocks[]
+) {
+	struct Shader *shader = resource_get_shader(
+		vert_src_filename,
+		frag_src_filename
+	);
+	if (!shader) {
+		return NULL;
+	}
+	int ok = 1;
+	if (uniform_names) {
+		ok &= shader_get_uniforms(shader, uniform_names, r_uniforms);
+	}
+	if (uniform_block_names) {
+		ok &= shader_get_uniform_blocks(
+			shader,
+			uniform_block_names,
+			r_uniform_blocks
+		);
+	}
+	if (!ok) {
+		resource_release(shader);
+		return NULL;
+	}
+	return shader;
+}
+
+static int
+init_background_pipeline(void)
+{
+	// load and compile the shader
+	const char *uniform_names[] = {
+		"scroll",
+		NULL
+	};
+	struct ShaderUniform *uniforms[] = {
+		&rndr.background_pipeline.u_scroll,
+		NULL
+	};
+	rndr.background_pipeline.shader = load_shader(
+		"data/shaders/background.vert",
+		"data/shaders/background.frag",
+		uniform_names,
+		uniforms,
+		NULL,
+		NULL
+	);
+	glGenVertexArrays(1, &rndr.background_pipeline.vao);
+	if (!rndr.background_pipeline.shader ||
+	    !rndr.background_pipeline.vao) {
+		fprintf(
+			stderr,
+			"failed to initialize background pipeline\n"
+		);
+		return 0;
+	}
+	return 1;
+}
+
+static int
+init_overdraw_pipeline(void)
+{
+	// load and compile the shader; it draws a fullscreen triangle, just
+	// like the background one
+	const char *uniform_names[] = {
+		"color",
+		NULL
+	};
+	struct ShaderUniform *uniforms[] = {
+		&rndr.overdraw_pipeline.u_color,
+		NULL
+	};
+	rndr.overdraw_pipeline.shader = load_shader(
+		"data/shaders/background.vert",
+		"data/shaders/overdraw.frag",
+		uniform_names,
+		uniforms,
+		NULL,
+		NULL
+	);
+	if (!rndr.overdraw_pipeline.shader) {
+		fprintf(
+			stderr,
+			"failed to initialize overdraw pipeline\n"
+		);
+		return 0;
+	}
+	return 1;
+}
+
 static int
 init_sprite_pipeline(void)
 {
 	// load and compile the shader
 	const char *uniform_names[] = {
 		"tex",
-		"size",
-		"transform",
+		"projection",
 		NULL
 	};
 	struct ShaderUniform *uniforms[] = {
 		&rndr.sprite_pipeline.u_texture,
-		&rndr.sprite_pipeline.u_size,
-		&rndr.sprite_pipeline.u_transform,
+		&rndr.sprite_pipeline.u_projection,
 		NULL
 	};
-	rndr.sprite_pipeline.shader = shader_compile(
+	rndr.sprite_pipeline.shader = load_shader(
 		"data/shaders/sprite.vert",
 		"data/shaders/sprite.frag",
 		uniform_names,
@@ -91,7 +532,8 @@ init_sprite_pipeline(void)
 		NULL,
 		NULL
 	);
-	if (!rndr.sprite_pipeline.shader) {
+	rndr.sprite_pipeline.vao = init_instance_vao(sprite_attribs);
+	if (!rndr.sprite_pipeline.shader || !rndr.sprite_pipeline.vao) {
 		fprintf(
 			stderr,
 			"failed to initialize rendering pipeline\n"
@@ -101,25 +543,92 @@ init_sprite_pipeline(void)
 	return 1;
 }
 
+static int
+init_sprite_array_pipeline(void)
+{
+	// load and compile the shader
+	const char *uniform_names[] = {
+		"tex",
+		"projection",
+		"time",
+		NULL
+	};
+	struct ShaderUniform *uniforms[] = {
+		&rndr.sprite_array_pipeline.u_texture,
+		&rndr.sprite_array_pipeline.u_projection,
+		&rndr.sprite_array_pipeline.u_time,
+		NULL
+	};
+	rndr.sprite_array_pipeline.shader = load_shader(
+		"data/shaders/sprite_array.vert",
+		"data/shaders/sprite_array.frag",
+		uniform_names,
+		uniforms,
+		NULL,
+		NULL
+	);
+	rndr.sprite_array_pipeline.vao = init_instance_vao(
+		sprite_array_attribs
+	);
+	if (!rndr.sprite_array_pipeline.shader ||
+	    !rndr.sprite_array_pipeline.vao) {
+		fprintf(
+			stderr,
+			"failed to initialize sprite array pipeline\n"
+		);
+		return 0;
+	}
+	return 1;
+}
+
+static int
+init_particle_pipeline(void)
+{
+	// load and compile the shader
+	const char *uniform_names[] = {
+		"tex",
+		"projection",
+		NULL
+	};
+	struct ShaderUniform *uniforms[] = {
+		&rndr.particle_pipeline.u_texture,
+		&rndr.particle_pipeline.u_projection,
+		NULL
+	};
+	rndr.particle_pipeline.shader = load_shader(
+		"data/shaders/particle.vert",
+		"data/shaders/particle.frag",
+		uniform_names,
+		uniforms,
+		NULL,
+		NULL
+	);
+	rndr.particle_pipeline.vao = init_instance_vao(particle_attribs);
+	if (!rndr.particle_pipeline.shader || !rndr.particle_pipeline.vao) {
+		fprintf(
+			stderr,
+			"failed to initialize particle pipeline\n"
+		);
+		return 0;
+	}
+	return 1;
+}
+
 static int
 init_text_pipeline(void)
 {
 	// load and compile the shader
 	const char *uniform_names[] = {
-		"glyph_tex",
 		"atlas_tex",
-		"atlas_offset",
-		"transform",
+		"projection",
 		NULL
 	};
 	struct ShaderUniform *uniforms[] = {
-		&rndr.text_pipeline.u_glyph_texture,
 		&rndr.text_pipeline.u_atlas_texture,
-		&rndr.text_pipeline.u_atlas_offset,
-		&rndr.text_pipeline.u_transform,
+		&rndr.text_pipeline.u_projection,
 		NULL
 	};
-	rndr.text_pipeline.shader = shader_compile(
+	rndr.text_pipeline.shader = load_shader(
 		"data/shaders/text.vert",
 		"data/shaders/text.frag",
 		uniform_names,
@@ -127,7 +636,8 @@ init_text_pipeline(void)
 		NULL,
 		NULL
 	);
-	if (!rndr.text_pipeline.shader) {
+	rndr.text_pipeline.vao = init_instance_vao(glyph_attribs);
+	if (!rndr.text_pipeline.shader || !rndr.text_pipeline.vao) {
 		fprintf(
 			stderr,
 			"failed to initialize rendering pipeline\n"
@@ -143,19 +653,15 @@ init_widget_pipeline(void)
 	// load and compile the shader
 	const char *uniform_names[] = {
 		"tex",
-		"size",
-		"border",
-		"transform",
+		"projection",
 		NULL
 	};
 	struct ShaderUniform *uniforms[] = {
 		&rndr.widget_pipeline.u_texture,
-		&rndr.widget_pipeline.u_size,
-		&rndr.widget_pipeline.u_border,
-		&rndr.widget_pipeline.u_transform,
+		&rndr.widget_pipeline.u_projection,
 		NULL
 	};
-	rndr.widget_pipeline.shader = shader_compile(
+	rndr.widget_pipeline.shader = load_shader(
 		"data/shaders/widget.vert",
 		"data/shaders/widget.frag",
 		uniform_names,
@@ -163,7 +669,8 @@ init_widget_pipeline(void)
 		NULL,
 		NULL
 	);
-	if (!rndr.widget_pipeline.shader) {
+	rndr.widget_pipeline.vao = init_instance_vao(widget_attribs);
+	if (!rndr.widget_pipeline.shader || !rndr.widget_pipeline.vao) {
 		fprintf(
 			stderr,
 			"failed to initialize widget pipeline\n"
@@ -173,69 +680,333 @@ init_widget_pipeline(void)
 	return 1;
 }
 
-int
-renderer_init(unsigned width, unsigned height)
+/**
+ * Append a row of given statistics to the export file, if any.
+ */
+static void
+export_stats(const struct RenderStats *stats)
 {
-	assert(!rndr.initialized);
-	memset(&rndr, 0, sizeof(struct Renderer));
+	if (!rndr.stats_export.file) {
+		return;
+	}
+	fprintf(
+		rndr.stats_export.file,
+		"%lu,%zu,%zu,%lu,%lu,%lu,%lu,%zu,"
+		"%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+		rndr.stats_export.row++,
+		stats->node_count,
+		stats->culled_nodes,
+		stats->draw_calls,
+		stats->pipeline_switches,
+		stats->texture_binds,
+		stats->elided_calls,
+		stats->particle_count,
+		stats->cpu_time.build,
+		stats->cpu_time.sort,
+		stats->cpu_time.submit,
+		stats->cpu_time.present,
+		stats->render_time,
+		stats->gpu_total_time
+	);
+}
 
-	// initialize SDL video subsystem
-	if (!SDL_WasInit(SDL_INIT_VIDEO) && SDL_Init(SDL_INIT_VIDEO) != 0) {
-		fprintf(stderr, "failed to initialize SDL: %s", SDL_GetError());
-		error(ERR_SDL);
+/**
+ * Count a failed frame, which is not fatal, reporting the first one.
+ *
+ * NOTE: Must be called with the worker lock held.
+ */
+static void
+count_failure(int ok, const char *what)
+{
+	if (!ok && rndr.worker.failed_frames++ == 0) {
+		fprintf(
+			stderr,
+			"%s failed on render thread, further failures are "
+			"only counted\n",
+			what
+		);
+	}
+}
+
+static int
+render_thread_main(void *data)
+{
+	if (rndr.ctx && SDL_GL_MakeCurrent(rndr.win, rndr.ctx) != 0) {
+		fprintf(
+			stderr,
+			"failed to bind OpenGL context to render thread: %s\n",
+			SDL_GetError()
+		);
+		SDL_LockMutex(rndr.worker.lock);
+		rndr.worker.exited = 1;
+		SDL_CondBroadcast(rndr.worker.cond);
+		SDL_UnlockMutex(rndr.worker.lock);
 		return 0;
 	}
 
-	// create window
-	rndr.win = SDL_CreateWindow(
-		"Shooter",
-		SDL_WINDOWPOS_CENTERED,
-		SDL_WINDOWPOS_CENTERED,
-		width,
-		height,
-		SDL_WINDOW_OPENGL
-	);
-	if (!rndr.win) {
-		fprintf(stderr, "failed to create OpenGL window\n");
-		error(ERR_SDL);
-		goto error;
+	SDL_LockMutex(rndr.worker.lock);
+	while (!rndr.worker.quit) {
+		if (rndr.worker.queue_len > 0) {
+			// pop the oldest submitted list and execute it
+			struct RenderList *list = rndr.worker.queue[
+				rndr.worker.queue_head
+			];
+			rndr.worker.queue_head = (
+				(rndr.worker.queue_head + 1) %
+				RENDER_FRAMES_IN_FLIGHT
+			);
+			rndr.worker.queue_len--;
+			SDL_UnlockMutex(rndr.worker.lock);
+
+			Uint64 start = SDL_GetPerformanceCounter();
+			renderer_clear();
+			int ok = render_list_exec(list);
+			Uint64 present_start = SDL_GetPerformanceCounter();
+			ok &= renderer_present();
+			rndr.frame_stats.cpu_time.present = elapsed_ms(present_start);
+			float render_time = elapsed_ms(start);
+			rndr.frame_stats.render_time = render_time;
+			export_stats(&rndr.frame_stats);
+
+			// give the list back to the main thread and publish the
+			// statistics
+			SDL_LockMutex(rndr.worker.lock);
+			rndr.stats = rndr.frame_stats;
+			rndr.stats.render_time = render_time;
+			rndr.worker.free[rndr.worker.free_count++] = list;
+			count_failure(ok, "frame");
+			rndr.stats.failed_frames = rndr.worker.failed_frames;
+			SDL_CondBroadcast(rndr.worker.cond);
+
+			// run the per-frame function, if any, once the list is
+			// given back, so that the main thread isn't held up
+			RenderCallFunc frame_func = rndr.worker.frame_call.func;
+			void *frame_userdata = rndr.worker.frame_call.userdata;
+			if (frame_func) {
+				SDL_UnlockMutex(rndr.worker.lock);
+				ok = frame_func(frame_userdata);
+				SDL_LockMutex(rndr.worker.lock);
+				count_failure(ok, "frame call");
+			}
+		} else if (rndr.worker.call.pending) {
+			// calls are served only when all submitted lists are
+			// executed, so that they can safely destroy resources
+			// referenced by them
+			SDL_UnlockMutex(rndr.worker.lock);
+			int result = rndr.worker.call.func(
+				rndr.worker.call.userdata
+			);
+			SDL_LockMutex(rndr.worker.lock);
+			rndr.worker.call.result = result;
+			rndr.worker.call.pending = 0;
+			SDL_CondBroadcast(rndr.worker.cond);
+		} else {
+			SDL_CondWait(rndr.worker.cond, rndr.worker.lock);
+		}
 	}
-	rndr.width = width;
-	rndr.height = height;
+	rndr.worker.exited = 1;
+	SDL_CondBroadcast(rndr.worker.cond);
+	SDL_UnlockMutex(rndr.worker.lock);
 
-	// initialize OpenGL context
-	SDL_GL_SetAttribute(
-		SDL_GL_CONTEXT_PROFILE_MASK,
-		SDL_GL_CONTEXT_PROFILE_CORE
-	);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
-	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-	SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+	if (rndr.ctx) {
+		SDL_GL_MakeCurrent(rndr.win, NULL);
+	}
+	return 1;
+}
 
-	rndr.ctx = SDL_GL_CreateContext(rndr.win);
-	if (!rndr.ctx) {
-		fprintf(stderr, "failed to initialize OpenGL context\n");
+static int
+start_render_thread(void)
+{
+	rndr.worker.lock = SDL_CreateMutex();
+	rndr.worker.cond = SDL_CreateCond();
+	if (!rndr.worker.lock || !rndr.worker.cond) {
+		fprintf(stderr, "failed to create render thread sync primitives\n");
 		error(ERR_SDL);
-		goto error;
+		return 0;
 	}
-	SDL_GL_SetSwapInterval(0);
 
-	// initialize GLEW
-	glewExperimental = GL_TRUE;
-	if (glewInit() != 0) {
-		fprintf(stderr, "failed to initialize GLEW");
-		error(ERR_OPENGL);
-		goto error;
+	for (unsigned i = 0; i < RENDER_FRAMES_IN_FLIGHT; i++) {
+		if (!(rndr.worker.lists[i] = render_list_new())) {
+			return 0;
+		}
+		rndr.worker.free[rndr.worker.free_count++] = rndr.worker.lists[i];
 	}
-	glGetError(); // silence any errors produced during GLEW initialization
 
-	printf("OpenGL version: %s\n", glGetString(GL_VERSION));
-	printf("GLSL version: %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
-	printf("GLEW version: %s\n", glewGetString(GLEW_VERSION));
+	// hand the OpenGL context over to the render thread
+	if (rndr.ctx) {
+		SDL_GL_MakeCurrent(rndr.win, NULL);
+	}
+	rndr.worker.thread = SDL_CreateThread(
+		render_thread_main,
+		"render",
+		NULL
+	);
+	if (!rndr.worker.thread) {
+		fprintf(stderr, "failed to create render thread\n");
+		error(ERR_SDL);
+		if (rndr.ctx) {
+			SDL_GL_MakeCurrent(rndr.win, rndr.ctx);
+		}
+		return 0;
+	}
 
-	// initialize OpenGL state machine
-	glCullFace(GL_BACK);
+	return 1;
+}
+
+static void
+stop_render_thread(void)
+{
+	if (rndr.worker.thread) {
+		SDL_LockMutex(rndr.worker.lock);
+		rndr.worker.quit = 1;
+		SDL_CondBroadcast(rndr.worker.cond);
+		SDL_UnlockMutex(rndr.worker.lock);
+		SDL_WaitThread(rndr.worker.thread, NULL);
+		rndr.worker.thread = NULL;
+		if (rndr.worker.failed_frames > 0) {
+			fprintf(
+				stderr,
+				"%lu frames failed to render\n",
+				rndr.worker.failed_frames
+			);
+		}
+
+		// take the OpenGL context back for the clean-up
+		if (rndr.ctx) {
+			SDL_GL_MakeCurrent(rndr.win, rndr.ctx);
+		}
+	}
+
+	for (unsigned i = 0; i < RENDER_FRAMES_IN_FLIGHT; i++) {
+		render_list_destroy(rndr.worker.lists[i]);
+	}
+	if (rndr.worker.cond) {
+		SDL_DestroyCond(rndr.worker.cond);
+	}
+	if (rndr.worker.lock) {
+		SDL_DestroyMutex(rndr.worker.lock);
+	}
+	memset(&rndr.worker, 0, sizeof(rndr.worker));
+}
+
+static int
+init_ui_layer(unsigned width, unsigned height)
+{
+	// the layer is rendered upside down, so that the texture rows are
+	// stored top to bottom like in any other texture
+	mat_ortho(
+		&rndr.ui_layer.projection,
+		-(float)width / 2,
+		(float)width / 2,
+		-(float)height / 2,
+		(float)height / 2,
+		0,
+		100
+	);
+
+	// create the color buffer texture
+	struct Texture *tex = &rndr.ui_layer.texture;
+	tex->target = GL_TEXTURE_RECTANGLE;
+	tex->width = width;
+	tex->height = height;
+	glGenTextures(1, &tex->hnd);
+	glBindTexture(GL_TEXTURE_RECTANGLE, tex->hnd);
+	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(
+		GL_TEXTURE_RECTANGLE,
+		0,
+		GL_RGBA8,
+		width,
+		height,
+		0,
+		GL_RGBA,
+		GL_UNSIGNED_BYTE,
+		NULL
+	);
+	glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+
+	// create the framebuffer and clear it
+	glGenFramebuffers(1, &rndr.ui_layer.fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, rndr.ui_layer.fbo);
+	glFramebufferTexture2D(
+		GL_FRAMEBUFFER,
+		GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_RECTANGLE,
+		tex->hnd,
+		0
+	);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE || glGetError() != GL_NO_ERROR) {
+		fprintf(stderr, "failed to initialize UI layer framebuffer\n");
+		error(ERR_OPENGL);
+		return 0;
+	}
+	return 1;
+}
+
+static int
+init_opengl(unsigned width, unsigned height)
+{
+	// initialize SDL video subsystem
+	if (!SDL_WasInit(SDL_INIT_VIDEO) && SDL_Init(SDL_INIT_VIDEO) != 0) {
+		fprintf(stderr, "failed to initialize SDL: %s", SDL_GetError());
+		error(ERR_SDL);
+		return 0;
+	}
+
+	// create window
+	rndr.win = SDL_CreateWindow(
+		"Shooter",
+		SDL_WINDOWPOS_CENTERED,
+		SDL_WINDOWPOS_CENTERED,
+		width,
+		height,
+		SDL_WINDOW_OPENGL
+	);
+	if (!rndr.win) {
+		fprintf(stderr, "failed to create OpenGL window\n");
+		error(ERR_SDL);
+		return 0;
+	}
+
+	// initialize OpenGL context
+	SDL_GL_SetAttribute(
+		SDL_GL_CONTEXT_PROFILE_MASK,
+		SDL_GL_CONTEXT_PROFILE_CORE
+	);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+	SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+	SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+
+	rndr.ctx = SDL_GL_CreateContext(rndr.win);
+	if (!rndr.ctx) {
+		fprintf(stderr, "failed to initialize OpenGL context\n");
+		error(ERR_SDL);
+		return 0;
+	}
+	SDL_GL_SetSwapInterval(0);
+
+	// initialize GLEW
+	glewExperimental = GL_TRUE;
+	if (glewInit() != 0) {
+		fprintf(stderr, "failed to initialize GLEW");
+		error(ERR_OPENGL);
+		return 0;
+	}
+	glGetError(); // silence any errors produced during GLEW initialization
+
+	printf("OpenGL version: %s\n", glGetString(GL_VERSION));
+	printf("GLSL version: %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+	printf("GLEW version: %s\n", glewGetString(GLEW_VERSION));
+
+	// initialize OpenGL state machine
+	glCullFace(GL_BACK);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
@@ -250,13 +1021,95 @@ renderer_init(unsigned width, unsigned height)
 		100
 	);
 
-	rndr.initialized = (
+	// create the stream buffer for per-instance data
+	rndr.stream = stream_buffer_new(STREAM_BUFFER_FRAME_SIZE);
+	if (!rndr.stream) {
+		fprintf(stderr, "failed to create stream buffer\n");
+		return 0;
+	}
+
+	// create the timer queries for render passes
+	rndr.timer = gpu_timer_new(RENDER_PASS_COUNT);
+	if (!rndr.timer) {
+		fprintf(stderr, "failed to create GPU timer\n");
+		return 0;
+	}
+
+	// enable the program binary cache in user's data directory
+	char *pref_path = SDL_GetPrefPath("V0idExp", "yass");
+	if (pref_path) {
+		char *cache_dir = string_fmt("%sshaders", pref_path);
+		SDL_free(pref_path);
+		if (!cache_dir || !shader_cache_init(cache_dir)) {
+			printf("shader program cache disabled\n");
+		}
+		free(cache_dir);
+	}
+
+	int ok = (
+		init_background_pipeline() &&
+		init_overdraw_pipeline() &&
 		init_sprite_pipeline() &&
+		init_sprite_array_pipeline() &&
+		init_particle_pipeline() &&
 		init_text_pipeline() &&
-		init_widget_pipeline()
+		init_widget_pipeline() &&
+		init_ui_layer(width, height)
 	);
+	if (ok && shader_cache_get_saved_time() > 0) {
+		printf(
+			"shader program cache saved %.2fms\n",
+			shader_cache_get_saved_time()
+		);
+	}
+	return ok;
+}
+
+static int
+init_software(unsigned width, unsigned height)
+{
+	// there's no window, but events are still needed for input handling
+	if (!SDL_WasInit(SDL_INIT_EVENTS) && SDL_Init(SDL_INIT_EVENTS) != 0) {
+		fprintf(stderr, "failed to initialize SDL: %s", SDL_GetError());
+		error(ERR_SDL);
+		return 0;
+	}
+
+	// resources are sampled by the rasterizer, keep them in memory only
+	texture_set_storage(TEXTURE_STORAGE_CPU);
+
+	rndr.frame.pixels = calloc(width * height, sizeof(uint32_t));
+	if (!rndr.frame.pixels) {
+		error(ERR_NO_MEM);
+		return 0;
+	}
+
+	return swr_init(width, height);
+}
+
+int
+renderer_init(unsigned width, unsigned height, int backend)
+{
+	assert(!rndr.initialized);
+	memset(&rndr, 0, sizeof(struct Renderer));
+
+	rndr.backend = backend;
+	rndr.width = width;
+	rndr.height = height;
+
+	// the list retaining UI layer nodes is shared by both backends
+	if (!(rndr.ui_layer.list = render_list_new())) {
+		error(ERR_NO_MEM);
+		goto error;
+	}
+
+	if (backend == RENDER_BACKEND_SOFTWARE) {
+		rndr.initialized = init_software(width, height);
+	} else {
+		rndr.initialized = init_opengl(width, height);
+	}
 
-	if (!rndr.initialized) {
+	if (!rndr.initialized || !start_render_thread()) {
 		goto error;
 	}
 
@@ -270,33 +1123,153 @@ error:
 void
 renderer_shutdown(void)
 {
-	shader_free(rndr.sprite_pipeline.shader);
+	stop_render_thread();
+
+	// the capture may own OpenGL objects, which are released with the
+	// context current on this thread
+	capture_destroy(rndr.capture);
+	rndr.capture = NULL;
+
+	if (rndr.backend == RENDER_BACKEND_SOFTWARE) {
+		swr_shutdown();
+		texture_set_storage(TEXTURE_STORAGE_GPU);
+	}
+	free(rndr.frame.pixels);
+	free(rndr.frame.dump_prefix);
+	if (rndr.stats_export.file) {
+		fclose(rndr.stats_export.file);
+	}
+	render_list_destroy(rndr.ui_layer.list);
+
+	// released shaders are left idle, and destroyed by the purge
+	resource_release(rndr.background_pipeline.shader);
+	resource_release(rndr.overdraw_pipeline.shader);
+	resource_release(rndr.sprite_pipeline.shader);
+	resource_release(rndr.sprite_array_pipeline.shader);
+	resource_release(rndr.particle_pipeline.shader);
+	resource_release(rndr.text_pipeline.shader);
+	resource_release(rndr.widget_pipeline.shader);
+	resource_purge();
+	shader_cache_shutdown();
 
 	if (rndr.ctx) {
+		GLuint vaos[] = {
+			rndr.background_pipeline.vao,
+			rndr.sprite_pipeline.vao,
+			rndr.sprite_array_pipeline.vao,
+			rndr.particle_pipeline.vao,
+			rndr.text_pipeline.vao,
+			rndr.widget_pipeline.vao
+		};
+		for (unsigned i = 0; i < sizeof(vaos) / sizeof(GLuint); i++) {
+			if (vaos[i]) {
+				glDeleteVertexArrays(1, &vaos[i]);
+			}
+		}
+		stream_buffer_destroy(rndr.stream);
+		gpu_timer_destroy(rndr.timer);
+		if (rndr.ui_layer.fbo) {
+			glDeleteFramebuffers(1, &rndr.ui_layer.fbo);
+		}
+		if (rndr.ui_layer.texture.hnd) {
+			glDeleteTextures(1, &rndr.ui_layer.texture.hnd);
+		}
+
 		SDL_GL_DeleteContext(rndr.ctx);
 	}
 	if (rndr.win) {
 		SDL_DestroyWindow(rndr.win);
 	}
+	memset(&rndr.frame, 0, sizeof(rndr.frame));
+	rndr.initialized = 0;
 }
 
 void
 renderer_clear(void)
 {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	if (rndr.backend == RENDER_BACKEND_SOFTWARE) {
+		swr_clear();
+	} else {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
 }
 
-void
+static int
+present_software(void)
+{
+	const uint32_t *pixels = swr_get_pixels();
+	size_t stride = rndr.width * sizeof(uint32_t);
+
+	// publish the frame for `renderer_read_frame()`
+	SDL_LockMutex(rndr.worker.lock);
+	memcpy(rndr.frame.pixels, pixels, stride * rndr.height);
+	int dump = rndr.frame.dump_prefix != NULL;
+	char *filename = NULL;
+	if (dump) {
+		filename = string_fmt(
+			"%s%06u.png",
+			rndr.frame.dump_prefix,
+			rndr.frame.index
+		);
+	}
+	rndr.frame.index++;
+	SDL_UnlockMutex(rndr.worker.lock);
+
+	if (rndr.capture) {
+		int ok = capture_submit(rndr.capture, pixels);
+		rndr.frame_stats.capture_dropped = capture_get_dropped(
+			rndr.capture
+		);
+		if (!ok) {
+			free(filename);
+			return 0;
+		}
+	}
+
+	if (!dump) {
+		return 1;
+	} else if (!filename) {
+		error(ERR_NO_MEM);
+		return 0;
+	}
+	int ok = image_write_png(
+		filename,
+		rndr.width,
+		rndr.height,
+		pixels,
+		stride,
+		0
+	);
+	if (!ok) {
+		fprintf(stderr, "failed to write frame `%s`\n", filename);
+	}
+	free(filename);
+	return ok;
+}
+
+int
 renderer_present(void)
 {
 	assert(rndr.initialized);
+	if (rndr.backend == RENDER_BACKEND_SOFTWARE) {
+		return present_software();
+	}
+
+	// read the frame back before it's swapped out
+	int ok = 1;
+	if (rndr.capture) {
+		ok = capture_frame(rndr.capture);
+		rndr.frame_stats.capture_dropped = capture_get_dropped(
+			rndr.capture
+		);
+	}
 	SDL_GL_SwapWindow(rndr.win);
+	return ok;
 }
 
 struct RenderList*
 render_list_new(void)
 {
-	assert(rndr.initialized);
 	struct RenderList *list = make(struct RenderList);
 	return list;
 }
@@ -307,71 +1280,208 @@ render_list_destroy(struct RenderList *list)
 	destroy(list);
 }
 
-void
-render_list_add_sprite(
+/**
+ * Add a sprite node for given texture, unless it's culled.
+ */
+static struct SpriteInstance*
+add_sprite_node(
 	struct RenderList *list,
-	const struct Sprite *spr,
+	const struct Texture *texture,
+	float width,
+	float height,
 	float x,
 	float y,
 	float angle
 ) {
+	// compute the half extents of sprite's bounding box, as rotated around
+	// its center, and skip it if it falls outside the visible area
+	float abs_cos = fabsf(cosf(angle));
+	float abs_sin = fabsf(sinf(angle));
+	float half_w = (width * abs_cos + height * abs_sin) / 2;
+	float half_h = (width * abs_sin + height * abs_cos) / 2;
+	if (fabsf(x) - half_w > rndr.width / 2.0f ||
+	    fabsf(y) - half_h > rndr.height / 2.0f) {
+		list->culled++;
+		return NULL;
+	}
+
 	assert(list->len < RENDER_LIST_MAX_LEN);
 
 	// initialize sprite render node
-	struct RenderNode *node = &list->nodes[list->len++];
+	struct RenderNode *node = &list->nodes[list->len];
 	node->type = RENDER_NODE_SPRITE;
-	node->sprite = (struct Sprite*)spr;
+	node->layer = list->layer;
+	node->index = list->len++;
+	node->sprite.texture = texture;
+
+	// fill instance data; the sprite is rotated around its center by the
+	// vertex shader
+	struct SpriteInstance *inst = &node->sprite.instance;
+	inst->position[0] = x;
+	inst->position[1] = -y;
+	inst->size[0] = width;
+	inst->size[1] = height;
+	inst->angle = angle;
+	inst->layer = texture->layer;
+	inst->frames[0] = 1;
+	inst->frames[1] = ANIMATION_LOOP;
+	inst->timing[0] = 0;
+	inst->timing[1] = 0;
+	return inst;
+}
 
-	// compute transform
-	Mat t, r;
-	mat_ident(&t);
-	mat_translate(&t, x, -y, 0);
+void
+render_list_add_sprite(
+	struct RenderList *list,
+	const struct Sprite *spr,
+	float x,
+	float y,
+	float angle
+) {
+	add_sprite_node(
+		list,
+		spr->texture,
+		spr->width,
+		spr->height,
+		x,
+		y,
+		angle
+	);
+}
 
-	mat_ident(&r);
-	mat_translate(&r, -spr->width / 2, spr->height / 2, 0);
-	mat_rotate(&r, 0, 0, 1, angle);
+void
+render_list_add_animation(
+	struct RenderList *list,
+	const struct Animation *anim,
+	float x,
+	float y,
+	float angle,
+	float start_time
+) {
+	// frames stored in consecutive array layers are stepped through by the
+	// vertex shader, otherwise the current one is picked right away
+	const struct Texture *first = anim->frames[0];
+	if (first->target != GL_TEXTURE_2D_ARRAY) {
+		first = anim->frames[
+			animation_get_frame(anim, start_time, list->time)
+		];
+	}
+	struct SpriteInstance *inst = add_sprite_node(
+		list,
+		first,
+		anim->width,
+		anim->height,
+		x,
+		y,
+		angle
+	);
+	if (inst && first->target == GL_TEXTURE_2D_ARRAY) {
+		inst->frames[0] = anim->frame_count;
+		inst->frames[1] = anim->mode;
+		inst->timing[0] = start_time;
+		inst->timing[1] = anim->fps;
+	}
+}
 
-	mat_mul(&t, &r, &node->transform);
+void
+render_list_set_time(struct RenderList *list, float time)
+{
+	list->time = time;
 }
 
-static int
-render_sprite_node(const struct RenderNode *node)
+void
+render_list_set_scroll(struct RenderList *list, float scroll)
 {
-	int ok = 1;
+	list->scroll = scroll;
+}
 
-	// configure size
-	Vec size = {{ node->sprite->width, node->sprite->height, 0, 0 }};
-	ok &= shader_uniform_set(
-		&rndr.sprite_pipeline.u_size,
-		1,
-		&size
-	);
+void
+render_list_add_particles(
+	struct RenderList *list,
+	const struct ParticleEmitter *em
+) {
+	assert(em->texture->target != GL_TEXTURE_2D_ARRAY);
+	if (em->count == 0) {
+		return;
+	}
+	assert(list->len < RENDER_LIST_MAX_LEN);
 
-	// configure transform
-	Mat mvp;
-	mat_mul(&rndr.projection, &node->transform, &mvp);
-	ok &= shader_uniform_set(
-		&rndr.sprite_pipeline.u_transform,
-		1,
-		&mvp
-	);
+	// particles exceeding the capacity of the list are dropped
+	size_t count = em->count;
+	if (count > RENDER_LIST_MAX_PARTICLES - list->particle_count) {
+		count = RENDER_LIST_MAX_PARTICLES - list->particle_count;
+	}
 
-	// configure texture sampler
-	GLuint texture_unit = SPRITE_TEXTURE_UNIT;
-	ok &= shader_uniform_set(
-		&rndr.sprite_pipeline.u_texture,
-		1,
-		&texture_unit
-	);
+	// initialize particles render node
+	struct RenderNode *node = &list->nodes[list->len];
+	node->type = RENDER_NODE_PARTICLES;
+	node->layer = list->layer;
+	node->index = list->len++;
+	node->particles.texture = em->texture;
+	node->particles.first = list->particle_count;
+	node->particles.len = count;
 
-	// render
-	glActiveTexture(GL_TEXTURE0 + texture_unit);
-	glBindTexture(GL_TEXTURE_RECTANGLE, node->sprite->texture->hnd);
-	glBindVertexArray(node->sprite->vao);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	ok &= glGetError() == GL_NO_ERROR;
+	// interleave the particle arrays into instances, fading them out over
+	// their lifetime
+	struct ParticleInstance *instances = &list->particles[
+		list->particle_count
+	];
+	for (size_t i = 0; i < count; i++) {
+		float alpha = em->a[i] * em->life[i] * em->fade[i];
+		instances[i].position[0] = em->x[i];
+		instances[i].position[1] = -em->y[i];
+		instances[i].size = em->size;
+		instances[i].color[0] = em->r[i] * 255;
+		instances[i].color[1] = em->g[i] * 255;
+		instances[i].color[2] = em->b[i] * 255;
+		instances[i].color[3] = (alpha > 1 ? 1 : alpha) * 255;
+	}
+	list->particle_count += count;
+}
 
-	return ok;
+/**
+ * Initialize a text node for `len` glyphs of given font.
+ */
+static struct GlyphInstance*
+add_text_node(struct RenderList *list, const struct Font *font, size_t len)
+{
+	assert(list->len < RENDER_LIST_MAX_LEN);
+	assert(list->glyph_count + len <= RENDER_LIST_MAX_GLYPHS);
+
+	struct RenderNode *node = &list->nodes[list->len];
+	node->type = RENDER_NODE_TEXT;
+	node->layer = list->layer;
+	node->index = list->len++;
+	node->text.font = font;
+	node->text.first = list->glyph_count;
+	node->text.len = len;
+
+	struct GlyphInstance *glyphs = &list->glyphs[list->glyph_count];
+	list->glyph_count += len;
+	return glyphs;
+}
+
+/**
+ * Compute the style of glyphs, converting the effect widths from pixels to
+ * distance field units, which span twice the spread; they must fit within
+ * the spread.
+ */
+static void
+get_text_style(
+	const struct Font *font,
+	float outline,
+	float glow,
+	GLfloat r_style[3]
+) {
+	float scale = font_get_scale((struct Font*)font);
+	float field_unit = 2 * FONT_SDF_SPREAD * scale;
+	outline /= field_unit;
+	glow /= field_unit;
+	outline = outline > 0.5f ? 0.5f : outline;
+	glow = outline + glow > 0.5f ? 0.5f - outline : glow;
+	r_style[0] = scale;
+	r_style[1] = outline;
+	r_style[2] = glow;
 }
 
 void
@@ -381,117 +1491,408 @@ render_list_add_text(
 	float x,
 	float y
 ) {
-	// initialize text render node
-	struct RenderNode *node = &list->nodes[list->len++];
-	node->type = RENDER_NODE_TEXT;
-	node->text = (struct Text*)txt;
-	mat_ident(&node->transform);
-	mat_translate(&node->transform, x, -y, 0);
+	struct GlyphInstance *glyphs = add_text_node(list, txt->font, txt->len);
+	GLfloat style[3];
+	get_text_style(txt->font, txt->outline, txt->glow, style);
+
+	// copy text glyphs to list glyph buffer, translating them to their
+	// final position, offset by the padding of their distance fields
+	float padding = FONT_SDF_SPREAD * style[0];
+	for (size_t c = 0; c < txt->len; c++) {
+		glyphs[c].coord[0] = txt->coords[c][0] + x - padding;
+		glyphs[c].coord[1] = txt->coords[c][1] - y - padding;
+		memcpy(glyphs[c].style, style, sizeof(style));
+		glyphs[c].chr = txt->chars[c];
+	}
 }
 
-static int
-render_text_node(const struct RenderNode *node)
+void
+render_list_add_labels(struct RenderList *list, const struct LabelPool *pool)
 {
-	int ok = 1;
+	// count the glyphs of all labels, those exceeding the capacity of the
+	// list are dropped
+	size_t room = RENDER_LIST_MAX_GLYPHS - list->glyph_count;
+	size_t glyph_count = 0, count = 0;
+	while (count < pool->count &&
+	       glyph_count + pool->labels[count].len <= room) {
+		glyph_count += pool->labels[count++].len;
+	}
+	if (glyph_count == 0) {
+		return;
+	}
 
-	// configure transform
-	Mat mvp;
-	mat_mul(&rndr.projection, &node->transform, &mvp);
-	ok &= shader_uniform_set(
-		&rndr.text_pipeline.u_transform,
-		1,
-		&mvp
+	// all labels make up a single text node
+	struct GlyphInstance *glyphs = add_text_node(
+		list,
+		pool->font,
+		glyph_count
 	);
+	GLfloat style[3];
+	get_text_style(pool->font, pool->outline, pool->glow, style);
+	for (size_t i = 0; i < count; i++) {
+		// shrink the label around its center as it expires
+		const struct Label *label = &pool->labels[i];
+		float k = label->life / (pool->life * LABEL_SHRINK_FRACTION);
+		k = k > 1 ? 1 : k;
+		float scale = style[0] * k;
+		float padding = FONT_SDF_SPREAD * scale;
+		for (unsigned c = 0; c < label->len; c++) {
+			glyphs->coord[0] = (
+				label->coords[c][0] * k + label->x - padding
+			);
+			glyphs->coord[1] = (
+				label->coords[c][1] * k - label->y - padding
+			);
+			glyphs->style[0] = scale;
+			glyphs->style[1] = style[1];
+			glyphs->style[2] = style[2];
+			glyphs->chr = label->chars[c];
+			glyphs++;
+		}
+	}
+}
 
-	// configure atlas offset
-	unsigned int offset = font_get_atlas_offset(node->text->font);
-	ok &= shader_uniform_set(
-		&rndr.text_pipeline.u_atlas_offset,
+void
+render_list_add_widget(
+	struct RenderList *list,
+	const struct Widget *wdg,
+	float x,
+	float y
+) {
+	assert(list->len < RENDER_LIST_MAX_LEN);
+
+	// initialize widget render node
+	struct RenderNode *node = &list->nodes[list->len];
+	node->type = RENDER_NODE_WIDGET;
+	node->layer = list->layer;
+	node->index = list->len++;
+	node->widget.texture = wdg->texture;
+
+	// widgets are positioned relative to top-left corner of the screen
+	struct WidgetInstance *inst = &node->widget.instance;
+	inst->position[0] = x - rndr.width / 2;
+	inst->position[1] = -y + rndr.height / 2;
+	inst->size[0] = wdg->width;
+	inst->size[1] = wdg->height;
+	inst->border[0] = wdg->border.left;
+	inst->border[1] = wdg->texture->width - wdg->border.right;
+}
+
+void
+render_list_begin_ui(struct RenderList *list)
+{
+	assert(list->layer == RENDER_LAYER_WORLD);
+	list->layer = RENDER_LAYER_UI;
+	list->ui_dirty = 1;
+}
+
+void
+render_list_end_ui(struct RenderList *list)
+{
+	assert(list->layer == RENDER_LAYER_UI);
+	list->layer = RENDER_LAYER_WORLD;
+}
+
+/**
+ * Draw instanced quads, made of 4 vertices each.
+ */
+static void
+draw_quads(GLsizei instance_count)
+{
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instance_count);
+	rndr.frame_stats.draw_calls++;
+}
+
+static int
+bind_sprite_pipeline(void)
+{
+	int ok = shader_bind(rndr.sprite_pipeline.shader);
+
+	// configure projection
+	ok &= shader_uniform_set(
+		&rndr.sprite_pipeline.u_projection,
 		1,
-		&offset
+		rndr.state.projection
 	);
 
-	// configure texture samplers
-	GLuint glyph_texture_unit = TEXT_GLYPH_TEXTURE_UNIT;
-	GLuint atlas_texture_unit = TEXT_ATLAS_TEXTURE_UNIT;
+	// configure texture sampler
+	GLuint texture_unit = SPRITE_TEXTURE_UNIT;
 	ok &= shader_uniform_set(
-		&rndr.text_pipeline.u_glyph_texture,
+		&rndr.sprite_pipeline.u_texture,
 		1,
-		&glyph_texture_unit
+		&texture_unit
 	);
+
+	return ok;
+}
+
+static int
+bind_sprite_array_pipeline(void)
+{
+	int ok = shader_bind(rndr.sprite_array_pipeline.shader);
+
+	// configure projection
 	ok &= shader_uniform_set(
-		&rndr.text_pipeline.u_atlas_texture,
+		&rndr.sprite_array_pipeline.u_projection,
 		1,
-		&atlas_texture_unit
+		rndr.state.projection
 	);
 
-	// render
-	glActiveTexture(GL_TEXTURE0 + atlas_texture_unit);
-	glBindTexture(
-		GL_TEXTURE_RECTANGLE,
-		font_get_atlas_texture(node->text->font)
+	// configure texture sampler
+	GLuint texture_unit = SPRITE_ARRAY_TEXTURE_UNIT;
+	ok &= shader_uniform_set(
+		&rndr.sprite_array_pipeline.u_texture,
+		1,
+		&texture_unit
 	);
-	glActiveTexture(GL_TEXTURE0 + glyph_texture_unit);
-	glBindTexture(
-		GL_TEXTURE_1D,
-		font_get_glyph_texture(node->text->font)
+
+	// configure animation time
+	ok &= shader_uniform_set(
+		&rndr.sprite_array_pipeline.u_time,
+		1,
+		&rndr.state.time
 	);
-	glBindVertexArray(node->text->vao);
-	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, node->text->len);
 
-	ok &= glGetError() == GL_NO_ERROR;
+	return ok;
+}
+
+static int
+render_sprite_batch(const struct RenderNode *nodes, size_t count)
+{
+	// write instance data to stream buffer
+	GLintptr offset;
+	struct SpriteInstance *instances = stream_buffer_alloc(
+		rndr.stream,
+		sizeof(struct SpriteInstance) * count,
+		&offset
+	);
+	if (!instances) {
+		fprintf(stderr, "stream buffer exhausted by sprite batch\n");
+		return 0;
+	}
+	for (size_t i = 0; i < count; i++) {
+		instances[i] = nodes[i].sprite.instance;
+	}
+	if (!stream_buffer_commit(rndr.stream)) {
+		return 0;
+	}
+
+	// render; the batch shares a single texture, either a rectangle one or
+	// an array one, with each sprite picking its own layer
+	const struct Texture *texture = nodes[0].sprite.texture;
+	if (texture->target == GL_TEXTURE_2D_ARRAY) {
+		bind_texture(
+			SPRITE_ARRAY_TEXTURE_UNIT,
+			GL_TEXTURE_2D_ARRAY,
+			texture->hnd
+		);
+		bind_instance_attribs(
+			rndr.sprite_array_pipeline.vao,
+			sprite_array_attribs,
+			sizeof(struct SpriteInstance),
+			offset
+		);
+	} else {
+		bind_texture(
+			SPRITE_TEXTURE_UNIT,
+			GL_TEXTURE_RECTANGLE,
+			texture->hnd
+		);
+		bind_instance_attribs(
+			rndr.sprite_pipeline.vao,
+			sprite_attribs,
+			sizeof(struct SpriteInstance),
+			offset
+		);
+	}
+	draw_quads(count);
+
+	return glGetError() == GL_NO_ERROR;
+}
+
+static int
+bind_particle_pipeline(void)
+{
+	int ok = shader_bind(rndr.particle_pipeline.shader);
+
+	// configure projection
+	ok &= shader_uniform_set(
+		&rndr.particle_pipeline.u_projection,
+		1,
+		rndr.state.projection
+	);
+
+	// configure texture sampler
+	GLuint texture_unit = PARTICLE_TEXTURE_UNIT;
+	ok &= shader_uniform_set(
+		&rndr.particle_pipeline.u_texture,
+		1,
+		&texture_unit
+	);
 
 	return ok;
 }
 
-void
-render_list_add_widget(
-	struct RenderList *list,
-	const struct Widget *wdg,
-	float x,
-	float y
+static int
+render_particle_batch(
+	const struct RenderList *list,
+	const struct RenderNode *nodes,
+	size_t count
 ) {
-	// initialize text render node
-	struct RenderNode *node = &list->nodes[list->len++];
-	node->type = RENDER_NODE_WIDGET;
-	node->widget = (struct Widget*)wdg;
-	mat_ident(&node->transform);
-	mat_translate(&node->transform, x - rndr.width / 2, -y + rndr.height / 2, 0);
+	// count the particles of all emitters in the batch
+	size_t particle_count = 0;
+	for (size_t i = 0; i < count; i++) {
+		particle_count += nodes[i].particles.len;
+	}
+
+	// write particle instances to stream buffer
+	GLintptr offset;
+	struct ParticleInstance *instances = stream_buffer_alloc(
+		rndr.stream,
+		sizeof(struct ParticleInstance) * particle_count,
+		&offset
+	);
+	if (!instances) {
+		fprintf(stderr, "stream buffer exhausted by particle batch\n");
+		return 0;
+	}
+	for (size_t i = 0; i < count; i++) {
+		memcpy(
+			instances,
+			&list->particles[nodes[i].particles.first],
+			sizeof(struct ParticleInstance) * nodes[i].particles.len
+		);
+		instances += nodes[i].particles.len;
+	}
+	if (!stream_buffer_commit(rndr.stream)) {
+		return 0;
+	}
+
+	// render
+	bind_texture(
+		PARTICLE_TEXTURE_UNIT,
+		GL_TEXTURE_RECTANGLE,
+		nodes[0].particles.texture->hnd
+	);
+	bind_instance_attribs(
+		rndr.particle_pipeline.vao,
+		particle_attribs,
+		sizeof(struct ParticleInstance),
+		offset
+	);
+	draw_quads(particle_count);
+
+	return glGetError() == GL_NO_ERROR;
 }
 
 static int
-render_widget_node(const struct RenderNode *node)
+bind_text_pipeline(void)
 {
-	int ok = 1;
+	int ok = shader_bind(rndr.text_pipeline.shader);
 
-	// configure size
-	Vec size = {{ node->widget->width, node->widget->height, 0, 0 }};
+	// configure projection
 	ok &= shader_uniform_set(
-		&rndr.widget_pipeline.u_size,
+		&rndr.text_pipeline.u_projection,
 		1,
-		&size
+		rndr.state.projection
 	);
 
-	// configure border
-	Vec border = {{
-		node->widget->border.left,
-		node->widget->texture->width - node->widget->border.right,
-		0,
-		0
-	}};
+	// configure texture sampler
+	GLuint atlas_texture_unit = TEXT_ATLAS_TEXTURE_UNIT;
 	ok &= shader_uniform_set(
-		&rndr.widget_pipeline.u_border,
+		&rndr.text_pipeline.u_atlas_texture,
 		1,
-		&border
+		&atlas_texture_unit
+	);
+
+	return ok;
+}
+
+static int
+render_text_batch(
+	const struct RenderList *list,
+	const struct RenderNode *nodes,
+	size_t count
+) {
+	int ok = 1;
+
+	// count the glyphs of all texts in the batch
+	size_t glyph_count = 0;
+	for (size_t i = 0; i < count; i++) {
+		glyph_count += nodes[i].text.len;
+	}
+	if (glyph_count == 0) {
+		return 1;
+	}
+
+	// write glyph instances to stream buffer, resolving their atlas
+	// rectangles; glyphs which don't fit in the atlas are left empty
+	GLintptr offset;
+	struct GlyphInstance *glyphs = stream_buffer_alloc(
+		rndr.stream,
+		sizeof(struct GlyphInstance) * glyph_count,
+		&offset
 	);
+	if (!glyphs) {
+		fprintf(stderr, "stream buffer exhausted by text batch\n");
+		return 0;
+	}
+	for (size_t i = 0; i < count; i++) {
+		const struct GlyphInstance *src = &list->glyphs[
+			nodes[i].text.first
+		];
+		for (size_t c = 0; c < nodes[i].text.len; c++) {
+			struct GlyphRect rect;
+			font_cache_glyph(
+				(struct Font*)nodes[i].text.font,
+				src[c].chr,
+				rndr.frame_number,
+				&rect
+			);
+			glyphs->coord[0] = src[c].coord[0];
+			glyphs->coord[1] = src[c].coord[1];
+			memcpy(glyphs->style, src[c].style, sizeof(GLfloat) * 3);
+			glyphs->rect[0] = rect.x;
+			glyphs->rect[1] = rect.y;
+			glyphs->rect[2] = rect.w;
+			glyphs->rect[3] = rect.h;
+			glyphs++;
+		}
+	}
+	if (!stream_buffer_commit(rndr.stream)) {
+		return 0;
+	}
 
-	// configure transform
-	Mat mvp;
-	mat_mul(&rndr.projection, &node->transform, &mvp);
+	// render, uploading glyphs rasterized by this batch first
+	bind_texture(
+		TEXT_ATLAS_TEXTURE_UNIT,
+		GL_TEXTURE_RECTANGLE,
+		font_get_atlas_texture()
+	);
+	ok &= font_sync_atlas();
+	bind_instance_attribs(
+		rndr.text_pipeline.vao,
+		glyph_attribs,
+		sizeof(struct GlyphInstance),
+		offset
+	);
+	draw_quads(glyph_count);
+
+	ok &= glGetError() == GL_NO_ERROR;
+
+	return ok;
+}
+
+static int
+bind_widget_pipeline(void)
+{
+	int ok = shader_bind(rndr.widget_pipeline.shader);
+
+	// configure projection
 	ok &= shader_uniform_set(
-		&rndr.widget_pipeline.u_transform,
+		&rndr.widget_pipeline.u_projection,
 		1,
-		&mvp
+		rndr.state.projection
 	);
 
 	// configure texture sampler
@@ -502,65 +1903,724 @@ render_widget_node(const struct RenderNode *node)
 		&texture_unit
 	);
 
+	return ok;
+}
+
+static int
+render_widget_batch(const struct RenderNode *nodes, size_t count)
+{
+	// write instance data to stream buffer
+	GLintptr offset;
+	struct WidgetInstance *instances = stream_buffer_alloc(
+		rndr.stream,
+		sizeof(struct WidgetInstance) * count,
+		&offset
+	);
+	if (!instances) {
+		fprintf(stderr, "stream buffer exhausted by widget batch\n");
+		return 0;
+	}
+	for (size_t i = 0; i < count; i++) {
+		instances[i] = nodes[i].widget.instance;
+	}
+	if (!stream_buffer_commit(rndr.stream)) {
+		return 0;
+	}
+
 	// render
-	glActiveTexture(GL_TEXTURE0 + texture_unit);
-	glBindTexture(GL_TEXTURE_RECTANGLE, node->widget->texture->hnd);
-	glBindVertexArray(node->widget->vao);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	ok &= glGetError() == GL_NO_ERROR;
+	bind_texture(
+		WIDGET_TEXTURE_UNIT,
+		GL_TEXTURE_RECTANGLE,
+		nodes[0].widget.texture->hnd
+	);
+	bind_instance_attribs(
+		rndr.widget_pipeline.vao,
+		widget_attribs,
+		sizeof(struct WidgetInstance),
+		offset
+	);
+	draw_quads(count);
 
-	return ok;
+	return glGetError() == GL_NO_ERROR;
 }
 
 static int
 node_cmp(const void *a, const void *b)
 {
-	if (((struct RenderNode*)a)->type == ((struct RenderNode*)b)->type) {
+	// sort by layer and node type, preserving the order in which the nodes
+	// were added within the same type
+	const struct RenderNode *node_a = a, *node_b = b;
+	if (node_a->layer != node_b->layer) {
+		return node_a->layer < node_b->layer ? -1 : 1;
+	} else if (node_a->type != node_b->type) {
+		return node_a->type < node_b->type ? -1 : 1;
+	} else if (node_a->index != node_b->index) {
+		return node_a->index < node_b->index ? -1 : 1;
+	}
+	return 0;
+}
+
+/**
+ * Check whether two nodes can be drawn with a single instanced call.
+ */
+static int
+node_same_batch(const struct RenderNode *a, const struct RenderNode *b)
+{
+	if (a->type != b->type) {
 		return 0;
-	} else if (a < b) {
-		return -1;
 	}
-	return 1;
+	switch (a->type) {
+	case RENDER_NODE_SPRITE:
+		// sprites stored in the same array texture are batched together
+		// regardless of their layer
+		return (
+			a->sprite.texture->target == b->sprite.texture->target &&
+			a->sprite.texture->hnd == b->sprite.texture->hnd
+		);
+	case RENDER_NODE_PARTICLES:
+		return a->particles.texture == b->particles.texture;
+	case RENDER_NODE_TEXT:
+		// all fonts share the same glyph atlas
+		return 1;
+	case RENDER_NODE_WIDGET:
+		return a->widget.texture == b->widget.texture;
+	}
+	return 0;
 }
 
-int
-render_list_exec(struct RenderList *list)
+/**
+ * Get the pipeline which draws given node.
+ */
+static int
+node_pipeline(const struct RenderNode *node)
 {
+	switch (node->type) {
+	case RENDER_NODE_SPRITE:
+		if (node->sprite.texture->target == GL_TEXTURE_2D_ARRAY) {
+			return PIPELINE_SPRITE_ARRAY;
+		}
+		return PIPELINE_SPRITE;
+	case RENDER_NODE_PARTICLES:
+		return PIPELINE_PARTICLE;
+	case RENDER_NODE_TEXT:
+		return PIPELINE_TEXT;
+	}
+	return PIPELINE_WIDGET;
+}
+
+static int
+bind_pipeline(int pipeline)
+{
+	rndr.frame_stats.pipeline_switches++;
+	switch (pipeline) {
+	case PIPELINE_SPRITE:
+		return bind_sprite_pipeline();
+	case PIPELINE_SPRITE_ARRAY:
+		return bind_sprite_array_pipeline();
+	case PIPELINE_PARTICLE:
+		return bind_particle_pipeline();
+	case PIPELINE_TEXT:
+		return bind_text_pipeline();
+	}
+	return bind_widget_pipeline();
+}
+
+/**
+ * Render the first `count` nodes of a sorted list.
+ *
+ * When `timed` is set, each node type is timed as a separate render pass.
+ */
+static int
+render_nodes(const struct RenderList *list, size_t count, int timed)
+{
+	static const int passes[] = {
+		[RENDER_NODE_SPRITE] = RENDER_PASS_SPRITE,
+		[RENDER_NODE_PARTICLES] = RENDER_PASS_PARTICLE,
+		[RENDER_NODE_TEXT] = RENDER_PASS_TEXT,
+		[RENDER_NODE_WIDGET] = RENDER_PASS_WIDGET,
+	};
+
 	int ok = 1;
+	int active_type = -1;
+	int active_pipeline = -1;
+	size_t i = 0;
+	while (ok && i < count) {
+		// find the longest run of nodes which can be batched together
+		const struct RenderNode *node = &list->nodes[i];
+		size_t batch_len = 1;
+		while (i + batch_len < count &&
+		       node_same_batch(node, node + batch_len)) {
+			batch_len++;
+		}
 
-	// sort the list by node type
-	qsort(list->nodes, list->len, sizeof(struct RenderNode), node_cmp);
+		if (timed && active_type != node->type) {
+			gpu_timer_begin(rndr.timer, passes[node->type]);
+		}
+		int pipeline = node_pipeline(node);
+		if (active_pipeline != pipeline) {
+			ok &= bind_pipeline(pipeline);
+		}
 
-	int active = -1;
-	for (size_t i = 0; i < list->len; i++) {
-		struct RenderNode *node = &list->nodes[i];
 		switch (node->type) {
 		case RENDER_NODE_SPRITE:
-			if (active != node->type) {
-				ok &= shader_bind(rndr.sprite_pipeline.shader);
+			ok &= render_sprite_batch(node, batch_len);
+			break;
+		case RENDER_NODE_PARTICLES:
+			ok &= render_particle_batch(list, node, batch_len);
+			break;
+		case RENDER_NODE_TEXT:
+			ok &= render_text_batch(list, node, batch_len);
+			break;
+		case RENDER_NODE_WIDGET:
+			ok &= render_widget_batch(node, batch_len);
+			break;
+		}
+		active_type = node->type;
+		active_pipeline = pipeline;
+		i += batch_len;
+	}
+	return ok;
+}
+
+/**
+ * Draw the procedural starfield background with a fullscreen triangle.
+ */
+static int
+render_background(float scroll)
+{
+	int ok = shader_bind(rndr.background_pipeline.shader);
+	ok &= shader_uniform_set(
+		&rndr.background_pipeline.u_scroll,
+		1,
+		&scroll
+	);
+	bind_vertex_array(rndr.background_pipeline.vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	rndr.frame_stats.draw_calls++;
+	return ok && glGetError() == GL_NO_ERROR;
+}
+
+/**
+ * Replace the frame with a heatmap of the fragments counted in the stencil
+ * buffer, drawing a fullscreen triangle for each overdraw level.
+ */
+static int
+render_overdraw_heatmap(void)
+{
+	static const GLfloat ramp[OVERDRAW_LEVELS][4] = {
+		{ 0.0, 0.0, 0.4, 1 },
+		{ 0.0, 0.3, 0.8, 1 },
+		{ 0.0, 0.7, 0.5, 1 },
+		{ 0.3, 0.9, 0.0, 1 },
+		{ 0.9, 0.9, 0.0, 1 },
+		{ 1.0, 0.5, 0.0, 1 },
+		{ 1.0, 0.0, 0.0, 1 },
+		{ 1.0, 1.0, 1.0, 1 },
+	};
+
+	glClear(GL_COLOR_BUFFER_BIT);
+	glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+	int ok = shader_bind(rndr.overdraw_pipeline.shader);
+	bind_vertex_array(rndr.background_pipeline.vao);
+	for (unsigned level = 0; ok && level < OVERDRAW_LEVELS; level++) {
+		// fill the pixels touched more than `level` times, the last
+		// level takes all the rest
+		glStencilFunc(GL_LESS, level, 0xff);
+		ok &= shader_uniform_set(
+			&rndr.overdraw_pipeline.u_color,
+			1,
+			ramp[level]
+		);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	return ok && glGetError() == GL_NO_ERROR;
+}
+
+/**
+ * Redraw the retained UI nodes into the UI layer framebuffer.
+ */
+static int
+redraw_ui_layer(void)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, rndr.ui_layer.fbo);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	// accumulate colors premultiplied by alpha, so that the layer can be
+	// composited as a whole
+	glBlendFuncSeparate(
+		GL_SRC_ALPHA,
+		GL_ONE_MINUS_SRC_ALPHA,
+		GL_ONE,
+		GL_ONE_MINUS_SRC_ALPHA
+	);
+	rndr.state.projection = &rndr.ui_layer.projection;
+
+	int ok = render_nodes(rndr.ui_layer.list, rndr.ui_layer.list->len, 0);
+
+	rndr.state.projection = &rndr.projection;
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	rndr.ui_layer.dirty = 0;
+	return ok;
+}
+
+/**
+ * Draw the UI layer on top of the frame with a single screen-sized quad.
+ */
+static int
+composite_ui_layer(void)
+{
+	struct RenderNode node = {
+		.type = RENDER_NODE_SPRITE,
+		.layer = RENDER_LAYER_UI,
+	};
+	node.sprite.texture = &rndr.ui_layer.texture;
+	node.sprite.instance.size[0] = rndr.width;
+	node.sprite.instance.size[1] = rndr.height;
+
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	int ok = (
+		bind_pipeline(PIPELINE_SPRITE) &&
+		render_sprite_batch(&node, 1)
+	);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	return ok;
+}
+
+static int
+exec_opengl(const struct RenderList *list, size_t count)
+{
+	int ok = stream_buffer_begin(rndr.stream);
+
+	reset_state();
+	rndr.state.time = list->time;
+	shader_reset_elided_calls();
+	gpu_timer_begin_frame(rndr.timer);
+
+	// count the fragments of each pixel in the stencil buffer, when the
+	// overdraw heatmap is requested
+	int overdraw = SDL_AtomicGet(&rndr.debug) & RENDER_DEBUG_OVERDRAW;
+	if (overdraw) {
+		glClear(GL_STENCIL_BUFFER_BIT);
+		glEnable(GL_STENCIL_TEST);
+		glStencilFunc(GL_ALWAYS, 0, 0xff);
+		glStencilOp(GL_KEEP, GL_INCR, GL_INCR);
+	}
+
+	if (ok) {
+		gpu_timer_begin(rndr.timer, RENDER_PASS_BACKGROUND);
+		ok &= render_background(list->scroll);
+	}
+	ok = ok && render_nodes(list, count, 1);
+	if (overdraw) {
+		ok = ok && render_overdraw_heatmap();
+		glDisable(GL_STENCIL_TEST);
+	}
+
+	if (ok) {
+		gpu_timer_begin(rndr.timer, RENDER_PASS_UI);
+		if (rndr.ui_layer.dirty) {
+			ok &= redraw_ui_layer();
+		}
+		ok = ok && composite_ui_layer();
+	}
+
+	gpu_timer_end(rndr.timer);
+	bind_vertex_array(0);
+
+	ok &= stream_buffer_end(rndr.stream);
+
+	rndr.frame_stats.elided_calls += shader_get_elided_calls();
+
+	// publish the results of the oldest frame in flight
+	rndr.frame_stats.gpu_total_time = 0;
+	for (unsigned p = 0; p < RENDER_PASS_COUNT; p++) {
+		float time = gpu_timer_get_time(rndr.timer, p);
+		rndr.frame_stats.gpu_time[p] = time;
+		rndr.frame_stats.gpu_total_time += time;
+	}
+	rndr.frame_stats.gpu_dropped = gpu_timer_get_dropped(rndr.timer);
+
+	return ok;
+}
+
+static void
+draw_software(const struct RenderList *list, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const struct RenderNode *node = &list->nodes[i];
+		const struct SpriteInstance *spr = &node->sprite.instance;
+		const struct WidgetInstance *wdg = &node->widget.instance;
+
+		switch (node->type) {
+		case RENDER_NODE_SPRITE:
+			swr_draw_sprite(
+				node->sprite.texture,
+				spr->position[0],
+				spr->position[1],
+				spr->size[0],
+				spr->size[1],
+				spr->angle
+			);
+			break;
+		case RENDER_NODE_PARTICLES:
+			// the rasterizer has no tinting, particles are drawn
+			// with their texture colors
+			for (size_t p = 0; p < node->particles.len; p++) {
+				const struct ParticleInstance *prt = &list->particles[
+					node->particles.first + p
+				];
+				swr_draw_sprite(
+					node->particles.texture,
+					prt->position[0],
+					prt->position[1],
+					prt->size,
+					prt->size,
+					0
+				);
 			}
-			ok &= render_sprite_node(node);
 			break;
 		case RENDER_NODE_TEXT:
-			if (active != node->type) {
-				ok &= shader_bind(rndr.text_pipeline.shader);
+			for (size_t c = 0; c < node->text.len; c++) {
+				const struct GlyphInstance *glyph = &list->glyphs[
+					node->text.first + c
+				];
+				struct GlyphRect rect;
+				font_cache_glyph(
+					(struct Font*)node->text.font,
+					glyph->chr,
+					rndr.frame_number,
+					&rect
+				);
+				swr_draw_glyph(
+					glyph->coord[0],
+					glyph->coord[1],
+					glyph->style[0],
+					&rect
+				);
 			}
-			ok &= render_text_node(node);
 			break;
 		case RENDER_NODE_WIDGET:
-			if (active != node->type) {
-				ok &= shader_bind(rndr.widget_pipeline.shader);
-			}
-			ok &= render_widget_node(node);
+			swr_draw_widget(
+				node->widget.texture,
+				wdg->position[0],
+				wdg->position[1],
+				wdg->size[0],
+				wdg->size[1],
+				wdg->border[0],
+				wdg->border[1]
+			);
 			break;
 		}
-		active = node->type;
+	}
+}
 
-		if (!ok) {
-			break;
+static int
+exec_software(const struct RenderList *list, size_t count)
+{
+	// there are no offscreen targets, the retained UI nodes are simply
+	// rasterized on top of every frame
+	draw_software(list, count);
+	draw_software(rndr.ui_layer.list, rndr.ui_layer.list->len);
+	return swr_flush();
+}
+
+/**
+ * Replace the retained UI nodes with the ones recorded in given list,
+ * starting at `first`.
+ */
+static void
+retain_ui_nodes(const struct RenderList *list, size_t first)
+{
+	struct RenderList *ui = rndr.ui_layer.list;
+	ui->len = 0;
+	ui->glyph_count = 0;
+	ui->particle_count = 0;
+	for (size_t i = first; i < list->len; i++) {
+		struct RenderNode *node = &ui->nodes[ui->len++];
+		*node = list->nodes[i];
+		if (node->type == RENDER_NODE_TEXT) {
+			memcpy(
+				&ui->glyphs[ui->glyph_count],
+				&list->glyphs[node->text.first],
+				sizeof(struct GlyphInstance) * node->text.len
+			);
+			node->text.first = ui->glyph_count;
+			ui->glyph_count += node->text.len;
+		} else if (node->type == RENDER_NODE_PARTICLES) {
+			memcpy(
+				&ui->particles[ui->particle_count],
+				&list->particles[node->particles.first],
+				sizeof(struct ParticleInstance) * node->particles.len
+			);
+			node->particles.first = ui->particle_count;
+			ui->particle_count += node->particles.len;
 		}
 	}
+	rndr.ui_layer.dirty = 1;
+}
+
+int
+render_list_exec(struct RenderList *list)
+{
+	rndr.frame_number++;
+	rndr.frame_stats.elided_calls = 0;
+	rndr.frame_stats.draw_calls = 0;
+	rndr.frame_stats.pipeline_switches = 0;
+	rndr.frame_stats.texture_binds = 0;
+	rndr.frame_stats.node_count = list->len;
+	rndr.frame_stats.culled_nodes = list->culled;
+	rndr.frame_stats.particle_count = list->particle_count;
+	rndr.frame_stats.cpu_time.build = list->build_time;
+
+	// sort the list by layer and node type
+	Uint64 start = SDL_GetPerformanceCounter();
+	qsort(list->nodes, list->len, sizeof(struct RenderNode), node_cmp);
+	rndr.frame_stats.cpu_time.sort = elapsed_ms(start);
+
+	// UI nodes, sorted last, are retained and drawn separately
+	size_t count = list->len;
+	while (count > 0 && list->nodes[count - 1].layer == RENDER_LAYER_UI) {
+		count--;
+	}
+	if (list->ui_dirty) {
+		retain_ui_nodes(list, count);
+	}
+
+	int ok;
+	start = SDL_GetPerformanceCounter();
+	if (rndr.backend == RENDER_BACKEND_SOFTWARE) {
+		ok = exec_software(list, count);
+	} else {
+		ok = exec_opengl(list, count);
+	}
+	rndr.frame_stats.cpu_time.submit = elapsed_ms(start);
+
 	list->len = 0;
+	list->glyph_count = 0;
+	list->particle_count = 0;
+	list->culled = 0;
+	list->layer = RENDER_LAYER_WORLD;
+	list->ui_dirty = 0;
+
+	return ok;
+}
+
+struct RenderList*
+renderer_begin_frame(void)
+{
+	assert(rndr.initialized);
+
+	// wait for the render thread to release a list
+	struct RenderList *list = NULL;
+	SDL_LockMutex(rndr.worker.lock);
+	while (rndr.worker.free_count == 0 && !rndr.worker.exited) {
+		SDL_CondWait(rndr.worker.cond, rndr.worker.lock);
+	}
+	if (rndr.worker.free_count > 0) {
+		list = rndr.worker.free[--rndr.worker.free_count];
+	}
+	SDL_UnlockMutex(rndr.worker.lock);
+
+	if (list) {
+		list->build_start = SDL_GetPerformanceCounter();
+	}
+	return list;
+}
+
+int
+renderer_end_frame(struct RenderList *list)
+{
+	assert(rndr.initialized);
+	assert(list != NULL);
+
+	list->build_time = elapsed_ms(list->build_start);
+
+	SDL_LockMutex(rndr.worker.lock);
+	assert(rndr.worker.queue_len < RENDER_FRAMES_IN_FLIGHT);
+	size_t tail = (
+		(rndr.worker.queue_head + rndr.worker.queue_len) %
+		RENDER_FRAMES_IN_FLIGHT
+	);
+	rndr.worker.queue[tail] = list;
+	rndr.worker.queue_len++;
+	SDL_CondBroadcast(rndr.worker.cond);
+	int ok = !rndr.worker.exited;
+	SDL_UnlockMutex(rndr.worker.lock);
 
 	return ok;
-}
\ No newline at end of file
+}
+
+int
+renderer_call(RenderCallFunc func, void *userdata)
+{
+	assert(rndr.initialized);
+	assert(func != NULL);
+
+	SDL_LockMutex(rndr.worker.lock);
+	assert(!rndr.worker.call.pending);
+	rndr.worker.call.func = func;
+	rndr.worker.call.userdata = userdata;
+	rndr.worker.call.pending = 1;
+	SDL_CondBroadcast(rndr.worker.cond);
+	while (rndr.worker.call.pending && !rndr.worker.exited) {
+		SDL_CondWait(rndr.worker.cond, rndr.worker.lock);
+	}
+
+	// the call is withdrawn if the thread is gone without serving it
+	int result = !rndr.worker.call.pending && rndr.worker.call.result;
+	rndr.worker.call.pending = 0;
+	SDL_UnlockMutex(rndr.worker.lock);
+
+	return result;
+}
+
+void
+renderer_set_frame_call(RenderCallFunc func, void *userdata)
+{
+	assert(rndr.initialized);
+
+	SDL_LockMutex(rndr.worker.lock);
+	rndr.worker.frame_call.func = func;
+	rndr.worker.frame_call.userdata = userdata;
+	SDL_UnlockMutex(rndr.worker.lock);
+}
+
+void
+renderer_get_stats(struct RenderStats *r_stats)
+{
+	assert(r_stats != NULL);
+	SDL_LockMutex(rndr.worker.lock);
+	*r_stats = rndr.stats;
+	SDL_UnlockMutex(rndr.worker.lock);
+}
+
+void
+renderer_set_frame_dump(const char *prefix)
+{
+	assert(rndr.initialized);
+
+	char *copy = prefix ? string_copy(prefix) : NULL;
+	SDL_LockMutex(rndr.worker.lock);
+	free(rndr.frame.dump_prefix);
+	rndr.frame.dump_prefix = copy;
+	SDL_UnlockMutex(rndr.worker.lock);
+}
+
+int
+renderer_read_frame(void *r_pixels)
+{
+	assert(rndr.initialized);
+	assert(r_pixels != NULL);
+
+	if (rndr.backend != RENDER_BACKEND_SOFTWARE) {
+		return 0;
+	}
+
+	SDL_LockMutex(rndr.worker.lock);
+	memcpy(
+		r_pixels,
+		rndr.frame.pixels,
+		sizeof(uint32_t) * rndr.width * rndr.height
+	);
+	SDL_UnlockMutex(rndr.worker.lock);
+	return 1;
+}
+
+struct CaptureArgs {
+	int format;
+	const char *path;
+};
+
+static int
+start_capture(void *userdata)
+{
+	const struct CaptureArgs *args = userdata;
+
+	capture_destroy(rndr.capture);
+	rndr.capture = capture_new(
+		rndr.width,
+		rndr.height,
+		args->format,
+		args->path
+	);
+	return rndr.capture != NULL;
+}
+
+static int
+stop_capture(void *userdata)
+{
+	capture_destroy(rndr.capture);
+	rndr.capture = NULL;
+	return 1;
+}
+
+void
+renderer_set_debug(int flags)
+{
+	assert(rndr.initialized);
+	SDL_AtomicSet(&rndr.debug, flags);
+}
+
+int
+renderer_get_debug(void)
+{
+	assert(rndr.initialized);
+	return SDL_AtomicGet(&rndr.debug);
+}
+
+static int
+open_stats_file(void *userdata)
+{
+	const char *path = userdata;
+
+	if (rndr.stats_export.file) {
+		fclose(rndr.stats_export.file);
+		rndr.stats_export.file = NULL;
+	}
+	if (!path) {
+		return 1;
+	}
+
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		error(ERR_FILE_WRITE);
+		return 0;
+	}
+	fprintf(
+		file,
+		"frame,nodes,culled,draw_calls,pipeline_switches,"
+		"texture_binds,elided_calls,particles,build_ms,sort_ms,"
+		"submit_ms,present_ms,render_ms,gpu_ms\n"
+	);
+	rndr.stats_export.file = file;
+	rndr.stats_export.row = 0;
+	return 1;
+}
+
+int
+renderer_set_stats_file(const char *path)
+{
+	assert(rndr.initialized);
+	return renderer_call(open_stats_file, (void*)path);
+}
+
+int
+renderer_start_capture(int format, const char *path)
+{
+	assert(rndr.initialized);
+	assert(path != NULL);
+
+	struct CaptureArgs args = { format, path };
+	return renderer_call(start_capture, &args);
+}
+
+void
+renderer_stop_capture(void)
+{
+	assert(rndr.initialized);
+	renderer_call(stop_capture, NULL);
+}
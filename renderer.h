@@ -2,11 +2,79 @@
 
 #include <GL/glew.h>
 #include <SDL.h>
+#include <stddef.h>
 
+struct Animation;
+struct LabelPool;
+struct ParticleEmitter;
 struct Sprite;
 struct Text;
 struct Widget;
 
+/**
+ * Rendering backends.
+ */
+enum {
+	RENDER_BACKEND_OPENGL,
+	RENDER_BACKEND_SOFTWARE,  // headless, rasterized on the CPU
+};
+
+/**
+ * Render passes, one for each pipeline.
+ */
+enum {
+	RENDER_PASS_BACKGROUND,
+	RENDER_PASS_SPRITE,
+	RENDER_PASS_PARTICLE,
+	RENDER_PASS_TEXT,
+	RENDER_PASS_WIDGET,
+	RENDER_PASS_UI,  // UI layer redraw and compositing
+	RENDER_PASS_COUNT
+};
+
+/**
+ * Debug visualization flags, see `renderer_set_debug()`.
+ */
+enum {
+	// replace the frame with a heatmap of the times each pixel is drawn
+	RENDER_DEBUG_OVERDRAW = 1,
+	// display render statistics on screen
+	RENDER_DEBUG_STATS = 1 << 1,
+};
+
+/**
+ * Renderer statistics, collected during last render list execution.
+ *
+ * Times are in milliseconds. GPU times are measured with timer queries and
+ * lag a few frames behind, they're always zero with software backend.
+ */
+struct RenderStats {
+	size_t node_count;           // nodes in the render list
+	unsigned long draw_calls;    // OpenGL draw calls issued
+	unsigned long pipeline_switches;
+	unsigned long texture_binds; // texture bindings actually changed
+	unsigned long elided_calls;  // redundant OpenGL calls skipped
+	size_t culled_nodes;         // sprites outside of the view
+	size_t particle_count;       // particles drawn
+	float render_time;           // list execution and presentation
+	struct {
+		float build;         // list recording, on the main thread
+		float sort;          // node sorting
+		float submit;        // batching and draw calls submission
+		float present;       // buffers swap or frame dump
+	} cpu_time;
+	float gpu_time[RENDER_PASS_COUNT];
+	float gpu_total_time;
+	unsigned long gpu_dropped;   // timings not available in time
+	unsigned long failed_frames; // since start, not fatal
+	unsigned long capture_dropped; // frames the capture couldn't keep
+};
+
+/**
+ * Function executed on the render thread by `renderer_call()`.
+ */
+typedef int (*RenderCallFunc)(void *userdata);
+
 /**
  * Render list.
  */
@@ -26,6 +94,9 @@ render_list_destroy(struct RenderList *list);
 
 /**
  * Add a sprite to render list.
+ *
+ * Sprites whose rotated bounds lie entirely outside of the visible area are
+ * culled and not added.
  */
 void
 render_list_add_sprite(
@@ -36,6 +107,54 @@ render_list_add_sprite(
 	float angle
 );
 
+/**
+ * Add an animated sprite to render list.
+ *
+ * The frame shown is determined by the time elapsed since `start_time`, as
+ * of the time set by `render_list_set_time()`. It's computed on the GPU,
+ * thus instances cost no more than static sprites to record.
+ */
+void
+render_list_add_animation(
+	struct RenderList *list,
+	const struct Animation *anim,
+	float x,
+	float y,
+	float angle,
+	float start_time
+);
+
+/**
+ * Set the time of the frame recorded to render list, in seconds.
+ *
+ * Must be set before adding animations, on the same clock as their start
+ * times.
+ */
+void
+render_list_set_time(struct RenderList *list, float time);
+
+/**
+ * Add the live particles of an emitter to render list.
+ *
+ * Particles are copied, thus the emitter may be updated right away. Those
+ * sharing a texture are drawn together, with a single call.
+ */
+void
+render_list_add_particles(
+	struct RenderList *list,
+	const struct ParticleEmitter *em
+);
+
+/**
+ * Set the scroll offset of the starfield background, in pixels.
+ *
+ * The background is generated on the GPU, its layers scroll downwards at
+ * different speeds as the offset grows. It's not drawn by the software
+ * backend.
+ */
+void
+render_list_set_scroll(struct RenderList *list, float scroll);
+
 /**
  * Add a text to render list.
  */
@@ -47,6 +166,15 @@ render_list_add_text(
 	float y
 );
 
+/**
+ * Add the live labels of a pool to render list.
+ *
+ * Labels are copied as a single text, thus the pool may be updated right
+ * away. They shrink away over the last part of their lifetime.
+ */
+void
+render_list_add_labels(struct RenderList *list, const struct LabelPool *pool);
+
 /**
  * Add a widget to render list.
  */
@@ -58,17 +186,81 @@ render_list_add_widget(
 	float y
 );
 
+/**
+ * Begin recording the UI layer.
+ *
+ * The UI layer is retained by the renderer: it's drawn into an offscreen
+ * buffer and composited on top of each frame, until replaced by the nodes
+ * added to another list between `render_list_begin_ui()` and
+ * `render_list_end_ui()`. Lists which don't record it leave it unchanged.
+ */
+void
+render_list_begin_ui(struct RenderList *list);
+
+/**
+ * End recording the UI layer.
+ */
+void
+render_list_end_ui(struct RenderList *list);
+
 /**
  * Execute a render list.
+ *
+ * NOTE: Must be called on the render thread.
  */
 int
 render_list_exec(struct RenderList *list);
 
 /**
  * Initialize rendering system.
+ *
+ * The OpenGL context is owned by a dedicated render thread, which executes
+ * the lists submitted with `renderer_end_frame()`. Any other OpenGL work
+ * must be carried out on it via `renderer_call()`.
+ *
+ * The software backend creates no window and no OpenGL context; textures
+ * and fonts created afterwards are kept in memory and rasterized on the
+ * CPU instead.
  */
 int
-renderer_init(unsigned width, unsigned height);
+renderer_init(unsigned width, unsigned height, int backend);
+
+/**
+ * Acquire a render list for recording a new frame.
+ *
+ * Blocks until the render thread has released one of the lists in flight.
+ * Returns NULL if the render thread has exited.
+ */
+struct RenderList*
+renderer_begin_frame(void);
+
+/**
+ * Submit a recorded render list to the render thread.
+ *
+ * The list is executed and presented asynchronously, and must not be
+ * touched after this call. Returns 0 if the render thread has exited; lists
+ * failing to render are only counted, see `RenderStats`.
+ */
+int
+renderer_end_frame(struct RenderList *list);
+
+/**
+ * Run a function on the render thread and wait for its result.
+ *
+ * The function is called once all previously submitted lists have been
+ * executed.
+ */
+int
+renderer_call(RenderCallFunc func, void *userdata);
+
+/**
+ * Set a function run on the render thread after each frame, or NULL.
+ *
+ * Meant for small amounts of work spread across frames, such as streaming
+ * assets in; its failure is reported like that of a frame.
+ */
+void
+renderer_set_frame_call(RenderCallFunc func, void *userdata);
 
 /**
  * Clean-up and shut down renderer.
@@ -78,12 +270,81 @@ renderer_shutdown(void);
 
 /**
  * Clear screen.
+ *
+ * NOTE: Must be called on the render thread.
  */
 void
 renderer_clear(void);
 
 /**
  * Present buffered contents to the screen.
+ *
+ * With software backend, the frame is made available to
+ * `renderer_read_frame()` and written to disk if frame dumping is enabled.
+ *
+ * NOTE: Must be called on the render thread.
+ */
+int
+renderer_present(void);
+
+/**
+ * Get renderer statistics.
+ */
+void
+renderer_get_stats(struct RenderStats *r_stats);
+
+/**
+ * Write each presented frame to a PNG file named `<prefix>NNNNNN.png`.
+ *
+ * Passing NULL disables frame dumping. Supported by software backend only.
+ */
+void
+renderer_set_frame_dump(const char *prefix);
+
+/**
+ * Copy last presented frame to given buffer.
+ *
+ * The buffer must hold `width * height` RGBA8 pixels, which are stored top
+ * to bottom. Supported by software backend only.
+ */
+int
+renderer_read_frame(void *r_pixels);
+
+/**
+ * Set `RENDER_DEBUG_*` flags, effective from next executed render list.
+ *
+ * Overdraw heatmap is supported by OpenGL backend only.
+ */
+void
+renderer_set_debug(int flags);
+
+/**
+ * Get current `RENDER_DEBUG_*` flags.
+ */
+int
+renderer_get_debug(void);
+
+/**
+ * Append statistics of each executed render list to a CSV file.
+ *
+ * The file is truncated and a header row is written first. Passing NULL
+ * closes current file, if any.
+ */
+int
+renderer_set_stats_file(const char *path);
+
+/**
+ * Start capturing presented frames, see `capture_new()`.
+ *
+ * Replaces any capture in progress. Frames are read back asynchronously
+ * and encoded on a background thread, thus the capture may drop frames but
+ * never stalls rendering.
+ */
+int
+renderer_start_capture(int format, const char *path);
+
+/**
+ * Stop capturing frames, waiting for those in flight to be written.
  */
 void
-renderer_present(void);
\ No newline at end of file
+renderer_stop_capture(void);
@@ -0,0 +1,807 @@
+#include "error.h"
+#include "font.h"
+#include "memory.h"
+#include "resource.h"
+#include "shader.h"
+#include "sprite.h"
+#include "strutils.h"
+#include "texarray.h"
+#include "texture.h"
+#include "utils.h"
+#include <SDL.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESOURCE_INITIAL_BUCKETS 64
+#define RESOURCE_DEFAULT_BUDGET (256 << 20)  // bytes
+
+struct Resource {
+	int type;
+	char *key;
+	uint64_t hash;
+	void *asset;
+	unsigned refs;
+	unsigned hits;                // requests served from the cache
+	size_t size;                  // texture memory taken, if any
+	GLuint array;                 // texture array storing it, if any
+	struct Resource *next;        // in the bucket of its key
+	struct Resource *next_asset;  // in the bucket of its asset
+	struct Resource *lru_prev;    // in the list of idle resources
+	struct Resource *lru_next;
+};
+
+/**
+ * Resources are indexed twice, by type and key for lookups and by asset
+ * for releasing them, in two tables of chained buckets of the same size.
+ *
+ * Unreferenced resources are kept as idle, in a list from the least
+ * recently used, until they're collected: textures and sprites only once
+ * the texture memory doesn't fit in the budget. That's the memory of the
+ * cached textures of their own and of all the texture arrays, whose layers
+ * are freed only along with the whole array, thus their idle occupants are
+ * evicted together, and only if no other layer is used.
+ *
+ * The tables and the list are guarded by the lock, which is never held
+ * while assets are loaded or destroyed.
+ */
+static SDL_SpinLock lock = 0;
+
+static struct {
+	struct Resource **buckets;
+	struct Resource **asset_buckets;
+	size_t bucket_count;
+	size_t count;
+	struct Resource *lru_head;
+	struct Resource *lru_tail;
+	size_t resident;     // texture memory, as of the last update
+	size_t own_size;     // of the resources not in texture arrays
+	size_t budget;
+	int idle_changed;    // since the last collection
+	unsigned long lookups;
+	unsigned long hits;
+	unsigned long evictions;
+} cache = {
+	.budget = RESOURCE_DEFAULT_BUDGET,
+};
+
+static const char *type_names[] = {
+	[RESOURCE_TEXTURE] = "texture",
+	[RESOURCE_SPRITE] = "sprite",
+	[RESOURCE_FONT] = "font",
+	[RESOURCE_SHADER] = "shader",
+};
+
+/**
+ * Normalize a path, so that different spellings of the same file are
+ * cached once: backslashes become slashes, and empty, `.` and `..`
+ * components are resolved.
+ */
+static char*
+normalize_path(const char *path)
+{
+	char *norm = malloc(strlen(path) + 1);
+	if (!norm) {
+		error(ERR_NO_MEM);
+		return NULL;
+	}
+
+	size_t len = 0;
+	size_t root = 0;  // start of the components which `..` can remove
+	if (path[0] == '/' || path[0] == '\\') {
+		norm[len++] = '/';
+		root = 1;
+	}
+	const char *s = path;
+	while (*s) {
+		// find the next component
+		while (*s == '/' || *s == '\\') {
+			s++;
+		}
+		const char *end = s;
+		while (*end && *end != '/' && *end != '\\') {
+			end++;
+		}
+		size_t n = end - s;
+
+		if (n == 0 || (n == 1 && s[0] == '.')) {
+			// skip empty and current directory components
+		} else if (n == 2 && s[0] == '.' && s[1] == '.' && len > root) {
+			// remove the last component, along with its separator
+			while (len > root && norm[len - 1] != '/') {
+				len--;
+			}
+			if (len > root) {
+				len--;
+			}
+		} else {
+			if (len > 0 && norm[len - 1] != '/') {
+				norm[len++] = '/';
+			}
+			memcpy(norm + len, s, n);
+			len += n;
+
+			// leading `..` components are kept
+			if (n == 2 && s[0] == '.' && s[1] == '.') {
+				root = len;
+			}
+		}
+		s = end;
+	}
+	norm[len] = 0;
+	return norm;
+}
+
+static uint64_t
+hash_key(int type, const char *key)
+{
+	uint64_t hash = hash_fnv1a(HASH_FNV1A_INIT, &type, sizeof(type));
+	return hash_fnv1a(hash, key, strlen(key));
+}
+
+static uint64_t
+hash_asset(const void *asset)
+{
+	return hash_fnv1a(HASH_FNV1A_INIT, &asset, sizeof(asset));
+}
+
+/**
+ * Double the buckets of both tables, or allocate them, rehashing the
+ * resources.
+ */
+static int
+grow_buckets(void)
+{
+	size_t count = cache.bucket_count * 2;
+	count = count ? count : RESOURCE_INITIAL_BUCKETS;
+	struct Resource **buckets = calloc(count, sizeof(struct Resource*));
+	struct Resource **asset_buckets = calloc(
+		count,
+		sizeof(struct Resource*)
+	);
+	if (!buckets || !asset_buckets) {
+		error(ERR_NO_MEM);
+		free(buckets);
+		free(asset_buckets);
+		return 0;
+	}
+
+	for (size_t i = 0; i < cache.bucket_count; i++) {
+		struct Resource *res = cache.buckets[i];
+		while (res) {
+			struct Resource *next = res->next;
+			size_t b = res->hash & (count - 1);
+			res->next = buckets[b];
+			buckets[b] = res;
+
+			b = hash_asset(res->asset) & (count - 1);
+			res->next_asset = asset_buckets[b];
+			asset_buckets[b] = res;
+			res = next;
+		}
+	}
+
+	free(cache.buckets);
+	free(cache.asset_buckets);
+	cache.buckets = buckets;
+	cache.asset_buckets = asset_buckets;
+	cache.bucket_count = count;
+	return 1;
+}
+
+static struct Resource*
+lookup(int type, const char *key, uint64_t hash)
+{
+	if (!cache.buckets) {
+		return NULL;
+	}
+	struct Resource *res = cache.buckets[hash & (cache.bucket_count - 1)];
+	while (res && (
+		res->hash != hash ||
+		res->type != type ||
+		strcmp(res->key, key) != 0
+	)) {
+		res = res->next;
+	}
+	return res;
+}
+
+static struct Resource**
+lookup_asset(const void *asset)
+{
+	if (!cache.asset_buckets) {
+		return NULL;
+	}
+	size_t b = hash_asset(asset) & (cache.bucket_count - 1);
+	struct Resource **link = &cache.asset_buckets[b];
+	while (*link && (*link)->asset != asset) {
+		link = &(*link)->next_asset;
+	}
+	return *link ? link : NULL;
+}
+
+static void
+destroy_asset(int type, void *asset)
+{
+	switch (type) {
+	case RESOURCE_TEXTURE:
+		texture_destroy(asset);
+		break;
+	case RESOURCE_SPRITE:
+		sprite_destroy(asset);
+		break;
+	case RESOURCE_FONT:
+		font_destroy(asset);
+		break;
+	case RESOURCE_SHADER:
+		shader_free(asset);
+		break;
+	}
+}
+
+/**
+ * Get the texture memory taken by an asset and the array storing it, if
+ * any; the size is zero if it has no pixels.
+ */
+static size_t
+get_texture_size(const struct Resource *res, GLuint *r_array)
+{
+	const struct Texture *texture = NULL;
+	if (res->type == RESOURCE_TEXTURE) {
+		texture = res->asset;
+	} else if (res->type == RESOURCE_SPRITE) {
+		texture = ((const struct Sprite*)res->asset)->texture;
+	}
+	*r_array = 0;
+	if (!texture) {
+		return 0;
+	} else if (texture->hnd && texture->target == GL_TEXTURE_2D_ARRAY) {
+		// the layer is taken whole, whatever the size of the image
+		*r_array = texture->hnd;
+		return texture_array_get_layer_size(texture->hnd);
+	}
+	return (size_t)texture->width * texture->height * 4;
+}
+
+/**
+ * Update the texture memory, which changes as textures are created and
+ * destroyed, hence on the thread owning the OpenGL context.
+ */
+static void
+update_resident(void)
+{
+	cache.resident = cache.own_size + texture_array_get_memory();
+}
+
+static void
+lru_unlink(struct Resource *res)
+{
+	if (res->lru_prev) {
+		res->lru_prev->lru_next = res->lru_next;
+	} else {
+		cache.lru_head = res->lru_next;
+	}
+	if (res->lru_next) {
+		res->lru_next->lru_prev = res->lru_prev;
+	} else {
+		cache.lru_tail = res->lru_prev;
+	}
+	res->lru_prev = res->lru_next = NULL;
+}
+
+static void
+lru_append(struct Resource *res)
+{
+	res->lru_prev = cache.lru_tail;
+	res->lru_next = NULL;
+	if (cache.lru_tail) {
+		cache.lru_tail->lru_next = res;
+	} else {
+		cache.lru_head = res;
+	}
+	cache.lru_tail = res;
+}
+
+/**
+ * Acquire a reference to a resource, which is no longer idle.
+ */
+static void
+acquire(struct Resource *res)
+{
+	if (res->refs++ == 0) {
+		lru_unlink(res);
+	}
+}
+
+/**
+ * Remove an unreferenced resource from the cache, leaving it to be freed by
+ * `free_resource()` once the lock is released.
+ */
+static void
+remove_resource(struct Resource *res)
+{
+	assert(res->refs == 0);
+
+	// unlink the resource from both tables and the idle list
+	struct Resource **link = &cache.buckets[
+		res->hash & (cache.bucket_count - 1)
+	];
+	while (*link != res) {
+		link = &(*link)->next;
+	}
+	*link = res->next;
+	link = lookup_asset(res->asset);
+	*link = res->next_asset;
+	lru_unlink(res);
+	cache.count--;
+	if (!res->array) {
+		cache.own_size -= res->size;
+	}
+}
+
+static void
+free_resource(struct Resource *res)
+{
+	destroy_asset(res->type, res->asset);
+	free(res->key);
+	destroy(res);
+}
+
+/**
+ * Remove the idle resources without pixels, or all of them, returning them
+ * chained by `next`.
+ */
+static struct Resource*
+remove_idle(int all)
+{
+	struct Resource *removed = NULL;
+	struct Resource *res = cache.lru_head;
+	while (res) {
+		struct Resource *next = res->lru_next;
+		if (all || res->size == 0) {
+			remove_resource(res);
+			res->next = removed;
+			removed = res;
+		}
+		res = next;
+	}
+	return removed;
+}
+
+/**
+ * Count the idle resources stored in a texture array.
+ */
+static unsigned
+count_idle_in_array(GLuint array)
+{
+	unsigned count = 0;
+	struct Resource *res = cache.lru_head;
+	for (; res; res = res->lru_next) {
+		count += res->array == array;
+	}
+	return count;
+}
+
+/**
+ * Remove the least recently used idle resources whose eviction frees
+ * texture memory, returning them chained by `next`, or NULL if there are
+ * none: either one of its own, or all those stored in an array, if no other
+ * layer of it is used.
+ */
+static struct Resource*
+remove_evictable(void)
+{
+	struct Resource *res = cache.lru_head;
+	while (res && (res->size == 0 || (res->array && (
+		count_idle_in_array(res->array) <
+		texture_array_get_used(res->array)
+	)))) {
+		res = res->lru_next;
+	}
+	if (!res) {
+		return NULL;
+	} else if (!res->array) {
+		cache.evictions++;
+		remove_resource(res);
+		res->next = NULL;
+		return res;
+	}
+
+	GLuint array = res->array;
+	struct Resource *removed = NULL;
+	while (res) {
+		struct Resource *next = res->lru_next;
+		if (res->array == array) {
+			cache.evictions++;
+			remove_resource(res);
+			res->next = removed;
+			removed = res;
+		}
+		res = next;
+	}
+	return removed;
+}
+
+static void
+free_resources(struct Resource *res)
+{
+	while (res) {
+		struct Resource *next = res->next;
+		free_resource(res);
+		res = next;
+	}
+}
+
+/**
+ * Find a cached asset by its normalized key, acquiring a reference.
+ */
+static void*
+find(int type, const char *key)
+{
+	uint64_t hash = hash_key(type, key);
+	void *asset = NULL;
+	SDL_AtomicLock(&lock);
+	cache.lookups++;
+	struct Resource *res = lookup(type, key, hash);
+	if (res) {
+		cache.hits++;
+		res->hits++;
+		acquire(res);
+		asset = res->asset;
+	}
+	SDL_AtomicUnlock(&lock);
+	return asset;
+}
+
+/**
+ * Cache an asset by its normalized key, taking the ownership of both.
+ */
+static int
+add(int type, char *key, void *asset)
+{
+	if (!key || !asset) {
+		free(key);
+		destroy_asset(type, asset);
+		return 0;
+	}
+	uint64_t hash = hash_key(type, key);
+	struct Resource *res = make(struct Resource);
+	SDL_AtomicLock(&lock);
+	assert(lookup(type, key, hash) == NULL);
+	if (!res || (
+		cache.count >= cache.bucket_count &&
+		!grow_buckets()
+	)) {
+		SDL_AtomicUnlock(&lock);
+		free(key);
+		destroy(res);
+		destroy_asset(type, asset);
+		return 0;
+	}
+	res->type = type;
+	res->key = key;
+	res->hash = hash;
+	res->asset = asset;
+	res->refs = 1;
+	res->size = get_texture_size(res, &res->array);
+
+	size_t b = hash & (cache.bucket_count - 1);
+	res->next = cache.buckets[b];
+	cache.buckets[b] = res;
+	b = hash_asset(asset) & (cache.bucket_count - 1);
+	res->next_asset = cache.asset_buckets[b];
+	cache.asset_buckets[b] = res;
+	cache.count++;
+
+	// room for the new pixels is made by the next collection, as the
+	// idle ones may still be drawn by lists in flight
+	if (!res->array) {
+		cache.own_size += res->size;
+	}
+	update_resident();
+	cache.idle_changed = 1;
+	SDL_AtomicUnlock(&lock);
+	return 1;
+}
+
+/**
+ * Get a cached asset by its normalized key, or load it.
+ */
+static void*
+get(int type, char *key, void *(*load)(const void *args), const void *args)
+{
+	if (!key) {
+		return NULL;
+	}
+	void *asset = find(type, key);
+	if (asset) {
+		free(key);
+		return asset;
+	}
+	if (!(asset = load(args))) {
+		free(key);
+		return NULL;
+	}
+	return add(type, key, asset) ? asset : NULL;
+}
+
+static void*
+load_texture(const void *filename)
+{
+	return texture_from_file(filename);
+}
+
+static void*
+load_sprite(const void *filename)
+{
+	return sprite_from_file(filename);
+}
+
+struct FontArgs {
+	const char *filename;
+	unsigned size;
+};
+
+static void*
+load_font(const void *args)
+{
+	const struct FontArgs *font = args;
+	return font_from_file(font->filename, font->size);
+}
+
+static void*
+load_shader(const void *args)
+{
+	const char *const *filenames = args;
+	return shader_compile(
+		filenames[0],
+		filenames[1],
+		NULL,
+		NULL,
+		NULL,
+		NULL
+	);
+}
+
+struct Texture*
+resource_get_texture(const char *filename)
+{
+	assert(filename != NULL);
+	char *key = normalize_path(filename);
+	return get(RESOURCE_TEXTURE, key, load_texture, filename);
+}
+
+struct Sprite*
+resource_get_sprite(const char *filename)
+{
+	assert(filename != NULL);
+	char *key = normalize_path(filename);
+	return get(RESOURCE_SPRITE, key, load_sprite, filename);
+}
+
+struct Font*
+resource_get_font(const char *filename, unsigned size)
+{
+	assert(filename != NULL);
+
+	// fonts of different sizes are distinct assets
+	char *path = normalize_path(filename);
+	char *key = path ? string_fmt("%s@%u", path, size) : NULL;
+	free(path);
+
+	struct FontArgs args = { filename, size };
+	return get(RESOURCE_FONT, key, load_font, &args);
+}
+
+struct Shader*
+resource_get_shader(const char *vert_filename, const char *frag_filename)
+{
+	assert(vert_filename != NULL);
+	assert(frag_filename != NULL);
+
+	char *vert = normalize_path(vert_filename);
+	char *frag = normalize_path(frag_filename);
+	char *key = vert && frag ? string_fmt("%s+%s", vert, frag) : NULL;
+	free(vert);
+	free(frag);
+
+	const char *filenames[] = { vert_filename, frag_filename };
+	return get(RESOURCE_SHADER, key, load_shader, filenames);
+}
+
+void*
+resource_find(int type, const char *filename)
+{
+	assert(filename != NULL);
+	char *key = normalize_path(filename);
+	if (!key) {
+		return NULL;
+	}
+	void *asset = find(type, key);
+	free(key);
+	return asset;
+}
+
+int
+resource_add(int type, const char *filename, void *asset)
+{
+	assert(filename != NULL);
+	assert(asset != NULL);
+	return add(type, normalize_path(filename), asset);
+}
+
+void
+resource_retain(const void *asset)
+{
+	assert(asset != NULL);
+	SDL_AtomicLock(&lock);
+	struct Resource **link = lookup_asset(asset);
+	assert(link != NULL);
+	acquire(*link);
+	SDL_AtomicUnlock(&lock);
+}
+
+void
+resource_release(const void *asset)
+{
+	if (!asset) {
+		return;
+	}
+	SDL_AtomicLock(&lock);
+	struct Resource **link = lookup_asset(asset);
+	assert(link != NULL);
+	struct Resource *res = *link;
+	assert(res->refs > 0);
+	if (--res->refs == 0) {
+		lru_append(res);
+		cache.idle_changed = 1;
+	}
+	SDL_AtomicUnlock(&lock);
+}
+
+int
+resource_has_garbage(void)
+{
+	// idle pixels are worth another look only if something changed since
+	// the last collection, as they may not be evictable
+	SDL_AtomicLock(&lock);
+	int garbage = cache.idle_changed && cache.resident > cache.budget;
+	struct Resource *res = cache.lru_head;
+	for (; res && !garbage; res = res->lru_next) {
+		garbage = res->size == 0;
+	}
+	SDL_AtomicUnlock(&lock);
+	return garbage;
+}
+
+void
+resource_collect(void)
+{
+	SDL_AtomicLock(&lock);
+	struct Resource *removed = remove_idle(0);
+	SDL_AtomicUnlock(&lock);
+	free_resources(removed);
+
+	// evict until the texture memory fits, which is known only once the
+	// evicted assets are destroyed
+	do {
+		SDL_AtomicLock(&lock);
+		update_resident();
+		removed = (
+			cache.resident > cache.budget ?
+			remove_evictable() :
+			NULL
+		);
+		cache.idle_changed = 0;
+		SDL_AtomicUnlock(&lock);
+		free_resources(removed);
+	} while (removed);
+}
+
+void
+resource_purge(void)
+{
+	SDL_AtomicLock(&lock);
+	struct Resource *removed = remove_idle(1);
+	SDL_AtomicUnlock(&lock);
+	free_resources(removed);
+
+	SDL_AtomicLock(&lock);
+	update_resident();
+	SDL_AtomicUnlock(&lock);
+}
+
+void
+resource_set_budget(size_t budget)
+{
+	SDL_AtomicLock(&lock);
+	cache.budget = budget;
+	cache.idle_changed = 1;
+	SDL_AtomicUnlock(&lock);
+}
+
+void
+resource_report(FILE *fp)
+{
+	assert(fp != NULL);
+
+	size_t counts[RESOURCE_SHADER + 1] = { 0 };
+	size_t sizes[RESOURCE_SHADER + 1] = { 0 };
+	SDL_AtomicLock(&lock);
+	fprintf(
+		fp,
+		"%-8s %5s %5s %10s  %s\n",
+		"type",
+		"refs",
+		"hits",
+		"bytes",
+		"key"
+	);
+	for (size_t i = 0; i < cache.bucket_count; i++) {
+		struct Resource *res = cache.buckets[i];
+		for (; res; res = res->next) {
+			counts[res->type]++;
+			sizes[res->type] += res->size;
+			fprintf(
+				fp,
+				"%-8s %5u %5u %10zu  %s\n",
+				type_names[res->type],
+				res->refs,
+				res->hits,
+				res->size,
+				res->key
+			);
+		}
+	}
+
+	for (int t = RESOURCE_TEXTURE; t <= RESOURCE_SHADER; t++) {
+		fprintf(
+			fp,
+			"%zu %ss, %zu bytes of texture memory\n",
+			counts[t],
+			type_names[t],
+			sizes[t]
+		);
+	}
+	fprintf(
+		fp,
+		"%lu lookups, %lu served from cache\n",
+		cache.lookups,
+		cache.hits
+	);
+	fprintf(
+		fp,
+		"%zu of %zu bytes of texture memory resident, %lu evicted\n",
+		cache.resident,
+		cache.budget,
+		cache.evictions
+	);
+	SDL_AtomicUnlock(&lock);
+}
+
+void
+resource_shutdown(void)
+{
+	for (size_t i = 0; i < cache.bucket_count; i++) {
+		struct Resource *res = cache.buckets[i];
+		while (res) {
+			struct Resource *next = res->next;
+			fprintf(
+				stderr,
+				"leaked %s `%s` with %u references\n",
+				type_names[res->type],
+				res->key,
+				res->refs
+			);
+			free(res->key);
+			destroy(res);
+			res = next;
+		}
+	}
+	free(cache.buckets);
+	free(cache.asset_buckets);
+	size_t budget = cache.budget;
+	memset(&cache, 0, sizeof(cache));
+	cache.budget = budget;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+struct Font;
+struct Shader;
+struct Sprite;
+struct Texture;
+
+/**
+ * Resource manager.
+ *
+ * Assets are cached by type and normalized path, so that repeated requests
+ * for the same file share a single asset instead of loading it again. Each
+ * request acquires a reference, which must be dropped by
+ * `resource_release()`; unreferenced assets are left idle until collected.
+ *
+ * Idle textures and sprites are collected from the least recently used only
+ * when the texture memory exceeds the budget, so that those needed again
+ * soon, such as the ones of the next stage, are not loaded again.
+ *
+ * Sprites don't share their textures with the textures of the same file,
+ * since they're stored in array texture layers, which the pipelines drawing
+ * plain textures can't sample.
+ *
+ * Finding, retaining and releasing cached assets can be done from any
+ * thread, so that game entities can hold the assets they're drawn with;
+ * anything which loads or destroys them must be done on the thread owning
+ * the OpenGL context.
+ */
+
+/**
+ * Resource types.
+ */
+enum {
+	RESOURCE_TEXTURE = 1,
+	RESOURCE_SPRITE,
+	RESOURCE_FONT,
+	RESOURCE_SHADER,
+};
+
+struct Texture*
+resource_get_texture(const char *filename);
+
+struct Sprite*
+resource_get_sprite(const char *filename);
+
+struct Font*
+resource_get_font(const char *filename, unsigned size);
+
+/**
+ * Get a shader program compiled from given sources, without uniforms
+ * looked up, see `shader_get_uniforms()`.
+ */
+struct Shader*
+resource_get_shader(const char *vert_filename, const char *frag_filename);
+
+/**
+ * Find a cached asset of given type and file, acquiring a reference.
+ *
+ * Returns NULL if the asset is not cached.
+ */
+void*
+resource_find(int type, const char *filename);
+
+/**
+ * Cache an asset loaded elsewhere, e.g. by the loader, taking its
+ * ownership along with one reference.
+ *
+ * The asset is destroyed if it can't be cached.
+ */
+int
+resource_add(int type, const char *filename, void *asset);
+
+/**
+ * Acquire another reference to a cached asset.
+ */
+void
+resource_retain(const void *asset);
+
+/**
+ * Drop a reference to a cached asset, leaving it idle with the last one.
+ *
+ * NULL is ignored.
+ */
+void
+resource_release(const void *asset);
+
+/**
+ * Set the budget for the texture memory, in bytes; idle textures and
+ * sprites exceeding it are evicted by the next collection.
+ *
+ * The texture memory is that of the cached textures of their own and of
+ * all the texture arrays, where sprites take a whole layer each. An array
+ * is freed only once none of its layers is used, thus its idle sprites are
+ * evicted all together, and not at all while another layer is used.
+ *
+ * Referenced assets are never evicted, thus they can exceed the budget.
+ */
+void
+resource_set_budget(size_t budget);
+
+/**
+ * Tell whether there are idle assets to be collected.
+ */
+int
+resource_has_garbage(void);
+
+/**
+ * Destroy the idle assets which aren't kept in the budget.
+ *
+ * NOTE: Idle assets may still be drawn by the render lists in flight, thus
+ * this must be called once they're executed, see `renderer_call()`.
+ */
+void
+resource_collect(void);
+
+/**
+ * Destroy all the idle assets.
+ *
+ * NOTE: The same as for `resource_collect()` applies.
+ */
+void
+resource_purge(void);
+
+/**
+ * Print the cached assets, with their references and cache hits, and the
+ * totals of each type.
+ */
+void
+resource_report(FILE *fp);
+
+/**
+ * Destroy the cache, reporting the assets which are still referenced.
+ *
+ * Those are leaked rather than destroyed, as the OpenGL context may be gone
+ * by then, thus idle ones must be purged before.
+ */
+void
+resource_shutdown(void);
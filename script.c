@@ -2,8 +2,12 @@
 #include "lauxlib.h"
 #include "lualib.h"
 
+#include "archive.h"
 #include "error.h"
 #include "memory.h"
+#include "preload.h"
+#include "renderer.h"
+#include "resource.h"
 #include "script.h"
 #include <assert.h>
 #include <stdarg.h>
@@ -12,6 +16,7 @@
 struct Arg {
 	int type;
 	const char *name;
+	int optional;  // can be left out, if trailing
 };
 
 /**
@@ -23,6 +28,9 @@ check_args(lua_State *state, const struct Arg args[])
 	int i;
 	for (i = 0; args[i].type != LUA_TNIL; i++) {
 		int type = lua_type(state, i + 1);
+		if (type == LUA_TNONE && args[i].optional) {
+			continue;
+		}
 		if (type != args[i].type) {
 			char *fmt = "`%s` must be a %s, got %s";
 			const char *xname = lua_typename(state, args[i].type);
@@ -64,6 +72,13 @@ get_args(lua_State *state, const struct Arg args[], ...)
 				*dst = lua_tonumber(state, index);
 			}
 			break;
+		case LUA_TSTRING:
+			{
+				// NULL if left out
+				const char **dst = va_arg(ap, const char**);
+				*dst = lua_tostring(state, index);
+			}
+			break;
 		default:
 			luaL_argerror(state, index, "unsupported argument type");
 		}
@@ -76,6 +91,47 @@ get_world_upvalue(lua_State *state)
 	return lua_touserdata(state, lua_upvalueindex(1));
 }
 
+static struct Preloader*
+get_preloader_upvalue(lua_State *state)
+{
+	return lua_touserdata(state, lua_upvalueindex(2));
+}
+
+struct SpriteLoad {
+	const char *filename;
+	struct Sprite *sprite;
+};
+
+static int
+load_sprite(void *userdata)
+{
+	struct SpriteLoad *load = userdata;
+	load->sprite = resource_get_sprite(load->filename);
+	return load->sprite != NULL;
+}
+
+/**
+ * Get a sprite from the resource cache, where the level script should have
+ * preloaded it, acquiring a reference.
+ *
+ * A sprite which isn't there, as the preloader is late or failed to load
+ * it, is loaded right away on the render thread, stalling it.
+ *
+ * Returns NULL if the sprite can't be loaded.
+ */
+static struct Sprite*
+get_sprite(const char *filename)
+{
+	struct Sprite *sprite = resource_find(RESOURCE_SPRITE, filename);
+	if (sprite) {
+		return sprite;
+	}
+	fprintf(stderr, "sprite `%s` not preloaded, loading it\n", filename);
+	struct SpriteLoad load = { filename, NULL };
+	renderer_call(load_sprite, &load);
+	return load.sprite;
+}
+
 /**
  * Add an asteroid.
  *
@@ -85,6 +141,8 @@ get_world_upvalue(lua_State *state)
  *     xvel:       Velocity x component.
  *     yvel:       Velocity y component.
  *     rot_speed:  Rotation speed (rad/s).
+ *     sprite:     File name of a preloaded sprite; the asteroid is
+ *                 skipped if it can't be loaded.
  */
 static int
 luafunc_add_asteroid(lua_State *state)
@@ -95,13 +153,32 @@ luafunc_add_asteroid(lua_State *state)
 		{ LUA_TNUMBER, "xvel" },
 		{ LUA_TNUMBER, "yvel" },
 		{ LUA_TNUMBER, "rot_speed" },
+		{ LUA_TSTRING, "sprite" },
 		{ LUA_TNIL }
 	};
 	lua_Number x, y, xvel, yvel, rot_speed;
-	get_args(state, args, &x, &y, &xvel, &yvel, &rot_speed);
+	const char *sprite_file;
+	get_args(state, args, &x, &y, &xvel, &yvel, &rot_speed, &sprite_file);
+
+	// a missing sprite must not end the game, the asteroid is rather
+	// left out
+	struct Sprite *sprite = get_sprite(sprite_file);
+	if (!sprite) {
+		fprintf(stderr, "asteroid without sprite skipped\n");
+		return 0;
+	}
 
+	// the asteroid holds a reference of its own
 	struct World *world = get_world_upvalue(state);
-	struct Asteroid *ast = asteroid_new(x, y, xvel, yvel, rot_speed);
+	struct Asteroid *ast = asteroid_new(
+		x,
+		y,
+		xvel,
+		yvel,
+		rot_speed,
+		sprite
+	);
+	resource_release(sprite);
 	if (!ast || !world_add_asteroid(world, ast)) {
 		asteroid_destroy(ast);
 		return luaL_error(state, "add_asteroid() call failed");
@@ -114,8 +191,10 @@ luafunc_add_asteroid(lua_State *state)
  * Add an enemy.
  *
  * Arguments:
- *     x:     Position x coordinate.
- *     y:     Position y coordinate.
+ *     x:       Position x coordinate.
+ *     y:       Position y coordinate.
+ *     sprite:  File name of a preloaded sprite, optional, the default
+ *              ship if left out or if it can't be loaded.
  */
 static int
 luafunc_add_enemy(lua_State *state)
@@ -123,12 +202,18 @@ luafunc_add_enemy(lua_State *state)
 	static struct Arg args[] = {
 		{ LUA_TNUMBER, "x" },
 		{ LUA_TNUMBER, "y" },
+		{ LUA_TSTRING, "sprite", 1 },
 		{ LUA_TNIL }
 	};
 	lua_Number x, y;
-	get_args(state, args, &x, &y);
-
-	struct Enemy *enemy = enemy_new(x, y);
+	const char *sprite_file;
+	get_args(state, args, &x, &y, &sprite_file);
+
+	// the enemy holds a reference of its own, and is the default ship if
+	// the sprite is missing
+	struct Sprite *sprite = sprite_file ? get_sprite(sprite_file) : NULL;
+	struct Enemy *enemy = enemy_new(x, y, sprite);
+	resource_release(sprite);
 	struct World *world = get_world_upvalue(state);
 	if (!enemy || !world_add_enemy(world, enemy)) {
 		enemy_destroy(enemy);
@@ -138,9 +223,93 @@ luafunc_add_enemy(lua_State *state)
 	return 0;
 }
 
+/**
+ * Queue the files of a list field of an assets table for preloading.
+ */
+static void
+preload_files(
+	lua_State *state,
+	int stage,
+	int type,
+	const char *field
+) {
+	struct Preloader *pl = get_preloader_upvalue(state);
+	const char *type_error = "`%s` must be a list of file names";
+	lua_getfield(state, 2, field);
+	if (lua_isnil(state, -1)) {
+		lua_pop(state, 1);
+		return;
+	}
+	if (!lua_istable(state, -1)) {
+		luaL_error(state, type_error, field);
+	}
+	size_t count = lua_rawlen(state, -1);
+	for (size_t i = 1; i <= count; i++) {
+		lua_rawgeti(state, -1, i);
+		if (lua_type(state, -1) != LUA_TSTRING) {
+			luaL_error(state, type_error, field);
+		}
+		if (!preloader_add(pl, stage, type, lua_tostring(state, -1))) {
+			luaL_error(state, "preload_assets() call failed");
+		}
+		lua_pop(state, 1);
+	}
+	lua_pop(state, 1);
+}
+
+/**
+ * Preload the assets of a stage in the background, holding them until the
+ * stage is released.
+ *
+ * Arguments:
+ *     stage:   Stage index.
+ *     assets:  Table with `textures` and `sprites` lists of file names.
+ */
+static int
+luafunc_preload_assets(lua_State *state)
+{
+	static struct Arg args[] = {
+		{ LUA_TNUMBER, "stage" },
+		{ LUA_TTABLE, "assets" },
+		{ LUA_TNIL }
+	};
+	check_args(state, args);
+	int stage = lua_tonumber(state, 1);
+
+	preload_files(state, stage, RESOURCE_TEXTURE, "textures");
+	preload_files(state, stage, RESOURCE_SPRITE, "sprites");
+
+	return 0;
+}
+
+/**
+ * Release the assets of a stage, once those preloaded before are loaded.
+ *
+ * Arguments:
+ *     stage:  Stage index.
+ */
+static int
+luafunc_release_assets(lua_State *state)
+{
+	static struct Arg args[] = {
+		{ LUA_TNUMBER, "stage" },
+		{ LUA_TNIL }
+	};
+	lua_Number stage;
+	get_args(state, args, &stage);
+
+	if (!preloader_release(get_preloader_upvalue(state), stage)) {
+		return luaL_error(state, "release_assets() call failed");
+	}
+
+	return 0;
+}
+
 static const luaL_Reg reg[] = {
 	{ "add_asteroid", luafunc_add_asteroid },
 	{ "add_enemy", luafunc_add_enemy },
+	{ "preload_assets", luafunc_preload_assets },
+	{ "release_assets", luafunc_release_assets },
 	{ NULL, NULL }
 };
 
@@ -182,10 +351,14 @@ script_env_new(void)
 }
 
 int
-script_env_init(struct ScriptEnv *env, struct World *world)
-{
+script_env_init(
+	struct ScriptEnv *env,
+	struct World *world,
+	struct Preloader *pl
+) {
 	assert(env);
 	assert(world);
+	assert(pl);
 
 	// create game library
 	luaL_newlibtable(env->state, reg);
@@ -193,7 +366,8 @@ script_env_init(struct ScriptEnv *env, struct World *world)
 
 	// register functions
 	lua_pushlightuserdata(env->state, world);
-	luaL_setfuncs(env->state, reg, 1);
+	lua_pushlightuserdata(env->state, pl);
+	luaL_setfuncs(env->state, reg, 2);
 
 	// register game constants
 	for (unsigned i = 0; game_constants[i].name != NULL; i++) {
@@ -210,7 +384,16 @@ script_env_init(struct ScriptEnv *env, struct World *world)
 int
 script_env_load_file(struct ScriptEnv *env, const char *filename)
 {
-	if (luaL_dofile(env->state, filename)) {
+	// scripts in the mounted archive are read from it
+	size_t size;
+	const char *data = archive_get_file(filename, &size);
+	int err = (
+		data ?
+		luaL_loadbuffer(env->state, data, size, filename) ||
+		lua_pcall(env->state, 0, LUA_MULTRET, 0) :
+		luaL_dofile(env->state, filename)
+	);
+	if (err) {
 		fprintf(
 			stderr,
 			"failed to load Lua script file `%s`:\n%s\n",
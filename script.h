@@ -2,6 +2,8 @@
 
 #include "game.h"
 
+struct Preloader;
+
 struct ScriptEnv {
 	struct lua_State *state;
 	int tick_func;
@@ -10,8 +12,16 @@ struct ScriptEnv {
 struct ScriptEnv*
 script_env_new(void);
 
+/**
+ * Register the `game` library, whose functions add entities to the world
+ * and preload stage assets.
+ */
 int
-script_env_init(struct ScriptEnv *env, struct World *world);
+script_env_init(
+	struct ScriptEnv *env,
+	struct World *world,
+	struct Preloader *pl
+);
 
 int
 script_env_load_file(struct ScriptEnv *env, const char *filename);
@@ -2,12 +2,40 @@
 #include "shader.h"
 #include "strutils.h"
 #include "memory.h"
+#include "utils.h"
+#include <SDL.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#define PROGRAM_BINARY_MAGIC 0x42505359  // "YSPB"
+
+// currently bound program
+static GLuint bound_prog = 0;
+
+// number of redundant OpenGL calls skipped since last reset
+static unsigned long elided_calls = 0;
+
+// program binary cache
+static struct {
+	char *dir;
+	float saved_time;
+} cache = { NULL, 0 };
+
+/**
+ * Header of a program binary cache file, followed by the binary itself.
+ */
+struct ProgramBinaryHeader {
+	uint32_t magic;
+	uint32_t format;
+	uint64_t key;
+	uint32_t compile_time;  // compiling from sources (microseconds)
+	uint32_t size;
+};
+
 static size_t
 compute_uniform_size(struct ShaderUniform *uniform)
 {
@@ -15,6 +43,7 @@ compute_uniform_size(struct ShaderUniform *uniform)
 	case GL_INT:
 	case GL_SAMPLER_2D:
 	case GL_SAMPLER_2D_RECT:
+	case GL_SAMPLER_2D_ARRAY:
 	case GL_SAMPLER_1D:
 	case GL_INT_SAMPLER_1D:
 	case GL_UNSIGNED_INT_SAMPLER_1D:
@@ -354,11 +383,63 @@ init_shader_uniforms(struct Shader *s)
 				return 0;
 			}
 		}
+
+		// allocate the storage for last set uniform values; it's
+		// zero-initialized just like uniforms of a newly linked program
+		size_t cache_size = 0;
+		for (size_t i = 0; i < actual_count; i++) {
+			cache_size += s->uniforms[i].size;
+		}
+		if (!(s->uniform_cache = alloc0(cache_size))) {
+			return 0;
+		}
+		unsigned char *cache = s->uniform_cache;
+		for (size_t i = 0; i < actual_count; i++) {
+			s->uniforms[i].cache = cache;
+			cache += s->uniforms[i].size;
+		}
 	}
 
 	return 1;
 }
 
+/**
+ * Create a shader from a program, which is expected to be linked.
+ */
+static struct Shader*
+init_program(GLuint prog)
+{
+	struct Shader *shader = NULL;
+
+	// retrieve link status
+	int status = GL_FALSE;
+	glGetProgramiv(prog, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE) {
+		// retrieve link log
+		int log_len;
+		glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &log_len);
+		char log[log_len];
+		glGetProgramInfoLog(prog, log_len, NULL, log);
+
+		fprintf(stderr, "failed to link shader program: %s \n", log);
+		goto error;
+	}
+
+	shader = make(struct Shader);
+	shader->prog = prog;
+	if (!init_shader_uniform_blocks(shader) ||
+	    !init_shader_uniforms(shader)) {
+		fprintf(stderr, "failed to initialize shader uniforms table");
+		goto error;
+	}
+
+	return shader;
+
+error:
+	shader_free(shader);
+	return NULL;
+}
+
 struct Shader*
 shader_new(struct ShaderSource **sources, unsigned count)
 {
@@ -375,43 +456,232 @@ shader_new(struct ShaderSource **sources, unsigned count)
 			"failed to create shader program (OpenGL error %d)\n",
 			glGetError()
 		);
-		goto error;
+		return NULL;
 	}
 
-	// attach shaders and link the program
+	// attach shaders and link the program; when the cache is enabled,
+	// let the driver know the binary is going to be retrieved
 	for (unsigned i = 0; i < count; i++) {
 		assert(sources[i]->src != 0);
 		glAttachShader(prog, sources[i]->src);
 	}
+	if (cache.dir) {
+		glProgramParameteri(
+			prog,
+			GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+			GL_TRUE
+		);
+	}
 	glLinkProgram(prog);
 
-	// retrieve link status
+	if (!(shader = init_program(prog))) {
+		glDeleteProgram(prog);
+	}
+	return shader;
+}
+
+static float
+elapsed_ms(Uint64 since)
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+	return (now - since) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+/**
+ * Compute the cache key of a program, which depends on its sources and on
+ * the driver which compiled it.
+ */
+static uint64_t
+compute_cache_key(const char *vert_src, const char *frag_src)
+{
+	const char *strings[] = {
+		vert_src,
+		frag_src,
+		(const char*)glGetString(GL_VENDOR),
+		(const char*)glGetString(GL_RENDERER),
+		(const char*)glGetString(GL_VERSION),
+	};
+	uint64_t key = HASH_FNV1A_INIT;
+	for (unsigned i = 0; i < sizeof(strings) / sizeof(char*); i++) {
+		const char *str = strings[i] ? strings[i] : "";
+		// include the terminator, so that strings don't run together
+		key = hash_fnv1a(key, str, strlen(str) + 1);
+	}
+	return key;
+}
+
+static char*
+cache_filename(uint64_t key)
+{
+	return string_fmt("%s/%016llx.bin", cache.dir, (unsigned long long)key);
+}
+
+/**
+ * Check whether there are at least `size` bytes left to read from a file.
+ */
+static int
+has_bytes_left(FILE *fp, size_t size)
+{
+	long pos = ftell(fp);
+	if (pos < 0 || fseek(fp, 0, SEEK_END) != 0) {
+		return 0;
+	}
+	long end = ftell(fp);
+	if (end < pos || fseek(fp, pos, SEEK_SET) != 0) {
+		return 0;
+	}
+	return (unsigned long)(end - pos) >= size;
+}
+
+/**
+ * Load a program binary from the cache.
+ *
+ * Returns NULL if there's no binary for given key, or if the driver rejects
+ * it, e.g. because it was updated.
+ */
+static struct Shader*
+load_program_binary(uint64_t key)
+{
+	struct Shader *shader = NULL;
+	void *binary = NULL;
+	GLuint prog = 0;
+
+	char *filename = cache_filename(key);
+	FILE *fp = filename ? fopen(filename, "rb") : NULL;
+	if (!fp) {
+		goto cleanup;
+	}
+
+	// read and validate the header, then the binary, whose size must be
+	// checked against the file before allocating it
+	struct ProgramBinaryHeader hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    hdr.magic != PROGRAM_BINARY_MAGIC ||
+	    hdr.key != key ||
+	    hdr.size == 0 ||
+	    !has_bytes_left(fp, hdr.size) ||
+	    !(binary = malloc(hdr.size)) ||
+	    fread(binary, 1, hdr.size, fp) != hdr.size) {
+		fprintf(stderr, "bad program binary cache file `%s`\n", filename);
+		goto cleanup;
+	}
+
+	Uint64 start = SDL_GetPerformanceCounter();
+	if (!(prog = glCreateProgram())) {
+		goto cleanup;
+	}
+	glProgramBinary(prog, hdr.format, binary, hdr.size);
+
 	int status = GL_FALSE;
 	glGetProgramiv(prog, GL_LINK_STATUS, &status);
 	if (status == GL_FALSE) {
-		// retrieve link log
-		int log_len;
-		glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &log_len);
-		char log[log_len];
-		glGetProgramInfoLog(prog, log_len, NULL, log);
+		glGetError();  // clear any error raised by unsupported formats
+		fprintf(
+			stderr,
+			"program binary `%s` rejected by the driver\n",
+			filename
+		);
+		goto cleanup;
+	}
+	if (!(shader = init_program(prog))) {
+		goto cleanup;
+	}
 
-		fprintf(stderr, "failed to link shader program: %s \n", log);
-		goto error;
+	// report the time saved by skipping compilation
+	float load_time = elapsed_ms(start);
+	float saved_time = hdr.compile_time / 1000.0f - load_time;
+	cache.saved_time += saved_time;
+	printf(
+		"loaded program binary `%s` in %.2fms (%.2fms saved)\n",
+		filename,
+		load_time,
+		saved_time
+	);
+
+cleanup:
+	if (!shader && prog) {
+		glDeleteProgram(prog);
+	}
+	if (fp) {
+		fclose(fp);
 	}
+	free(binary);
+	free(filename);
+	return shader;
+}
 
-	shader = make(struct Shader);
-	shader->prog = prog;
-	if (!init_shader_uniform_blocks(shader) ||
-	    !init_shader_uniforms(shader)) {
-		fprintf(stderr, "failed to initialize shader uniforms table");
-		goto error;
+/**
+ * Store a program binary to the cache.
+ *
+ * Failures are reported but not propagated, since the cache is only an
+ * optimization.
+ */
+static void
+store_program_binary(GLuint prog, uint64_t key, float compile_time)
+{
+	GLint len = 0;
+	glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &len);
+	if (len <= 0) {
+		return;
 	}
 
-	return shader;
+	struct ProgramBinaryHeader hdr = {
+		.magic = PROGRAM_BINARY_MAGIC,
+		.key = key,
+		.compile_time = compile_time * 1000,
+		.size = len,
+	};
+	unsigned char *buf = malloc(sizeof(hdr) + len);
+	char *filename = cache_filename(key);
+	if (buf && filename) {
+		GLenum format = 0;
+		glGetProgramBinary(prog, len, NULL, &format, buf + sizeof(hdr));
+		hdr.format = format;
+		memcpy(buf, &hdr, sizeof(hdr));
+
+		if (glGetError() != GL_NO_ERROR ||
+		    !file_write(filename, buf, sizeof(hdr) + len)) {
+			fprintf(stderr, "failed to store program binary\n");
+		}
+	}
+	free(filename);
+	free(buf);
+}
 
-error:
-	shader_free(shader);
-	return NULL;
+static struct Shader*
+compile_program(
+	const char *vert_src,
+	const char *frag_src,
+	const char *vert_src_filename,
+	const char *frag_src_filename,
+	uint64_t key
+) {
+	Uint64 start = SDL_GetPerformanceCounter();
+
+	struct Shader *shader = NULL;
+	struct ShaderSource *sources[2] = {
+		shader_source_from_string(vert_src, GL_VERTEX_SHADER),
+		shader_source_from_string(frag_src, GL_FRAGMENT_SHADER),
+	};
+	const char *failed = (
+		!sources[0] ? vert_src_filename :
+		!sources[1] ? frag_src_filename :
+		NULL
+	);
+	if (failed) {
+		fprintf(stderr, "shader source '%s' compilation failed\n", failed);
+	} else {
+		shader = shader_new(sources, 2);
+	}
+
+	// the sources are not needed anymore once the program is linked
+	shader_source_free(sources[0]);
+	shader_source_free(sources[1]);
+
+	if (shader && cache.dir) {
+		store_program_binary(shader->prog, key, elapsed_ms(start));
+	}
+	return shader;
 }
 
 struct Shader*
@@ -423,12 +693,29 @@ shader_compile(
 	const char *uniform_block_names[],
 	struct ShaderUniformBlock *r_uniform_blocks[]
 ) {
-	// compile sources and attempt to create a shader program
 	struct Shader *shader = NULL;
-	struct ShaderSource *sources[2] = { NULL, NULL };
-	sources[0] = shader_source_from_file(vert_src_filename);
-	sources[1] = shader_source_from_file(frag_src_filename);
-	if (!sources[0] || !sources[1] || !(shader = shader_new(sources, 2))) {
+	char *vert_src = NULL, *frag_src = NULL;
+	if (!file_read(vert_src_filename, &vert_src) ||
+	    !file_read(frag_src_filename, &frag_src)) {
+		goto error;
+	}
+
+	// load the program from the cache, or compile it from the sources
+	uint64_t key = 0;
+	if (cache.dir) {
+		key = compute_cache_key(vert_src, frag_src);
+		shader = load_program_binary(key);
+	}
+	if (!shader) {
+		shader = compile_program(
+			vert_src,
+			frag_src,
+			vert_src_filename,
+			frag_src_filename,
+			key
+		);
+	}
+	if (!shader) {
 		goto error;
 	}
 
@@ -454,18 +741,52 @@ shader_compile(
 		goto error;
 	}
 
-	// TODO: return the compiled shader sources
+	free(vert_src);
+	free(frag_src);
 
 	return shader;
 
 error:
-	for (unsigned i = 0; i < sizeof(sources) / sizeof(struct ShaderSource*); i++) {
-		shader_source_free(sources[i]);
-	}
+	free(vert_src);
+	free(frag_src);
 	shader_free(shader);
 	return NULL;
 }
 
+int
+shader_cache_init(const char *dir)
+{
+	assert(dir != NULL);
+	assert(cache.dir == NULL);
+
+	// program binaries are available since OpenGL 4.1 or via extension,
+	// and the driver may still support no binary format at all
+	GLint format_count = 0;
+	if (GLEW_ARB_get_program_binary) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+	}
+	if (format_count == 0 || !dir_create(dir)) {
+		return 0;
+	}
+
+	cache.dir = string_copy(dir);
+	cache.saved_time = 0;
+	return cache.dir != NULL;
+}
+
+void
+shader_cache_shutdown(void)
+{
+	free(cache.dir);
+	cache.dir = NULL;
+}
+
+float
+shader_cache_get_saved_time(void)
+{
+	return cache.saved_time;
+}
+
 void
 shader_free(struct Shader *s)
 {
@@ -474,6 +795,7 @@ shader_free(struct Shader *s)
 			free((char*)s->uniforms[i].name);
 		}
 		free(s->uniforms);
+		free(s->uniform_cache);
 
 		for (size_t i = 0; i < s->block_count; i++) {
 			struct ShaderUniformBlock *block = &s->blocks[i];
@@ -483,6 +805,9 @@ shader_free(struct Shader *s)
 			free(block->uniforms);
 		}
 		free(s->blocks);
+		if (s->prog == bound_prog) {
+			bound_prog = 0;
+		}
 		free(s);
 	}
 }
@@ -492,7 +817,13 @@ shader_bind(struct Shader *s)
 {
 	assert(s != NULL);
 
+	if (s->prog == bound_prog) {
+		elided_calls++;
+		return 1;
+	}
+
 	glUseProgram(s->prog);
+	bound_prog = s->prog;
 
 #ifdef DEBUG
 	GLenum gl_err;
@@ -602,74 +933,106 @@ shader_uniform_set(const struct ShaderUniform *uniform, size_t count, ...)
 
 	va_list ap;
 	va_start(ap, count);
+	const void *value = va_arg(ap, const void*);
+	va_end(ap);
+
+	// convert vector types passed as `Vec` arrays to the tightly packed
+	// layout expected by OpenGL
+	size_t size = uniform->size / uniform->count * count;
+	unsigned char packed[size];
+	const void *data = value;
+	switch (uniform->type) {
+	case GL_UNSIGNED_INT_VEC4:
+		for (size_t i = 0; i < count; i++) {
+			const Vec *v = (const Vec*)value + i;
+			GLuint *uiv = (GLuint*)packed + i * 4;
+			for (unsigned j = 0; j < 4; j++) {
+				uiv[j] = v->data[j];
+			}
+		}
+		data = packed;
+		break;
+	case GL_FLOAT_VEC3:
+	case GL_FLOAT_VEC2:
+		{
+			size_t n = uniform->type == GL_FLOAT_VEC3 ? 3 : 2;
+			for (size_t i = 0; i < count; i++) {
+				memcpy(
+					packed + i * n * sizeof(GLfloat),
+					(const Vec*)value + i,
+					n * sizeof(GLfloat)
+				);
+			}
+		}
+		data = packed;
+		break;
+	}
+
+	// skip the call if the uniform already holds the same value
+	if (uniform->cache && size <= uniform->size) {
+		if (memcmp(uniform->cache, data, size) == 0) {
+			elided_calls++;
+			return 1;
+		}
+		memcpy(uniform->cache, data, size);
+	}
 
 	switch (uniform->type) {
 	case GL_INT:
 	case GL_BOOL:
 	case GL_SAMPLER_2D:
 	case GL_SAMPLER_2D_RECT:
+	case GL_SAMPLER_2D_ARRAY:
 	case GL_SAMPLER_1D:
 	case GL_INT_SAMPLER_1D:
 	case GL_UNSIGNED_INT_SAMPLER_1D:
-		glUniform1iv(uniform->loc, count, va_arg(ap, GLint*));
+		glUniform1iv(uniform->loc, count, data);
 		break;
 
 	case GL_UNSIGNED_INT:
-		glUniform1uiv(uniform->loc, count, va_arg(ap, GLuint*));
+		glUniform1uiv(uniform->loc, count, data);
 		break;
 
 	case GL_FLOAT:
-		glUniform1fv(uniform->loc, count, va_arg(ap, GLfloat*));
+		glUniform1fv(uniform->loc, count, data);
 		break;
 
 	case GL_FLOAT_MAT4:
-		glUniformMatrix4fv(uniform->loc, count, GL_TRUE, va_arg(ap, GLfloat*));
+		glUniformMatrix4fv(uniform->loc, count, GL_TRUE, data);
 		break;
 
 	case GL_FLOAT_VEC4:
-		glUniform4fv(uniform->loc, count, va_arg(ap, GLfloat*));
+		glUniform4fv(uniform->loc, count, data);
 		break;
 
 	case GL_UNSIGNED_INT_VEC4:
-		{
-			Vec fv = *va_arg(ap, Vec*);
-			GLuint uiv[4] = { fv.data[0], fv.data[1], fv.data[2], fv.data[3] };
-			glUniform4uiv(uniform->loc, 1, uiv);
-		}
+		glUniform4uiv(uniform->loc, count, data);
 		break;
+
 	case GL_FLOAT_VEC3:
-		{
-			GLfloat data[count][3];
-			Vec *v = va_arg(ap, Vec*);
-			for (size_t i = 0; i < count; i++) {
-				memcpy(data[i], v + i, sizeof(GLfloat) * 3);
-			}
-			glUniform3fv(uniform->loc, count, (GLfloat*)data);
-		}
+		glUniform3fv(uniform->loc, count, data);
 		break;
+
 	case GL_FLOAT_VEC2:
-		{
-			GLfloat data[count][2];
-			Vec *v = va_arg(ap, Vec*);
-			for (size_t i = 0; i < count; i++) {
-				memcpy(data[i], v + i, sizeof(GLfloat) * 2);
-			}
-			glUniform2fv(uniform->loc, count, (GLfloat*)data);
-		}
+		glUniform2fv(uniform->loc, count, data);
 		break;
 	}
-	va_end(ap);
 
-#ifdef DEBUG
-	GLenum gl_errno = glGetError();
-	if (gl_errno != GL_NO_ERROR) {
-		fprintf(stderr,
-			"failed to set shader uniform '%s' (OpenGL error %d)\n",
-			uniform->name,
-			gl_errno
-		);
-		return 0;
-	}
-#endif
+	// NOTE: OpenGL errors are not checked here, since it would mean
+	// a pipeline flush for each call; the renderer checks them once per
+	// draw call instead
+
 	return 1;
 }
+
+unsigned long
+shader_get_elided_calls(void)
+{
+	return elided_calls;
+}
+
+void
+shader_reset_elided_calls(void)
+{
+	elided_calls = 0;
+}
@@ -30,6 +30,7 @@ struct ShaderUniform {
 	GLuint count;
 	GLint offset;
 	size_t size;
+	void *cache;
 };
 
 /**
@@ -50,6 +51,7 @@ struct Shader {
 	GLuint prog;
 	GLuint uniform_count;
 	struct ShaderUniform *uniforms;
+	void *uniform_cache;
 	GLuint block_count;
 	struct ShaderUniformBlock *blocks;
 };
@@ -70,6 +72,29 @@ shader_compile(
 void
 shader_free(struct Shader *s);
 
+/**
+ * Enable the program binary cache in given directory.
+ *
+ * Programs created by `shader_compile()` are then stored as binaries keyed
+ * by their sources and the driver, and loaded from the cache on subsequent
+ * runs. Returns 0 if the driver doesn't support program binaries.
+ */
+int
+shader_cache_init(const char *dir);
+
+/**
+ * Disable the program binary cache.
+ */
+void
+shader_cache_shutdown(void);
+
+/**
+ * Get the time in milliseconds saved by loading cached program binaries,
+ * compared to compiling them.
+ */
+float
+shader_cache_get_saved_time(void);
+
 int
 shader_bind(struct Shader *s);
 
@@ -101,3 +126,16 @@ shader_uniform_block_get_uniform(
 
 int
 shader_uniform_set(const struct ShaderUniform *uniform, size_t count, ...);
+
+/**
+ * Get the number of redundant OpenGL calls skipped by `shader_bind()` and
+ * `shader_uniform_set()` since last reset.
+ */
+unsigned long
+shader_get_elided_calls(void);
+
+/**
+ * Reset the counter of skipped OpenGL calls.
+ */
+void
+shader_reset_elided_calls(void);
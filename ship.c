@@ -0,0 +1,123 @@
+#include "error.h"
+#include "ship.h"
+#include "sprite.h"
+#include "texture.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Blend a part over the canvas, with its top-left corner at given position.
+ */
+static void
+blend_part(
+	uint32_t *canvas,
+	unsigned canvas_w,
+	const struct Texture *part,
+	int left,
+	int top,
+	int mirror
+) {
+	const unsigned char *src = part->pixels;
+	for (unsigned y = 0; y < part->height; y++) {
+		unsigned char *dst = (unsigned char*)(
+			canvas + (top + y) * canvas_w + left
+		);
+		for (unsigned x = 0; x < part->width; x++) {
+			unsigned sx = mirror ? part->width - 1 - x : x;
+			const unsigned char *s = src + (y * part->width + sx) * 4;
+			unsigned char *d = dst + x * 4;
+
+			// source over destination, with straight alpha
+			float sa = s[3] / 255.0f;
+			float da = d[3] / 255.0f;
+			float oa = sa + da * (1 - sa);
+			if (oa <= 0) {
+				continue;
+			}
+			for (unsigned c = 0; c < 3; c++) {
+				float v = s[c] * sa + d[c] * da * (1 - sa);
+				d[c] = v / oa + 0.5f;
+			}
+			d[3] = oa * 255 + 0.5f;
+		}
+	}
+}
+
+struct Sprite*
+ship_assemble(const struct ShipPart *parts)
+{
+	assert(parts != NULL);
+
+	struct Sprite *spr = NULL;
+	uint32_t *canvas = NULL;
+
+	// load part images in memory only
+	unsigned count = 0;
+	while (parts[count].file) {
+		count++;
+	}
+	struct Texture *images[count];
+	for (unsigned i = 0; i < count; i++) {
+		images[i] = NULL;
+	}
+	int storage = texture_get_storage();
+	texture_set_storage(TEXTURE_STORAGE_CPU);
+	for (unsigned i = 0; i < count; i++) {
+		if (!(images[i] = texture_from_file(parts[i].file))) {
+			fprintf(
+				stderr,
+				"failed to load ship part `%s`\n",
+				parts[i].file
+			);
+			break;
+		}
+	}
+	texture_set_storage(storage);
+	if (count > 0 && !images[count - 1]) {
+		goto cleanup;
+	}
+
+	// compute the extents of the ship, keeping its origin at the center
+	// of the canvas
+	int half_w = 0, half_h = 0;
+	for (unsigned i = 0; i < count; i++) {
+		int x = abs(parts[i].x) + (images[i]->width + 1) / 2;
+		int y = abs(parts[i].y) + (images[i]->height + 1) / 2;
+		half_w = x > half_w ? x : half_w;
+		half_h = y > half_h ? y : half_h;
+	}
+	unsigned width = half_w * 2;
+	unsigned height = half_h * 2;
+	if (width == 0 || height == 0) {
+		fprintf(stderr, "ship design has no parts\n");
+		error(ERR_FILE_BAD);
+		goto cleanup;
+	}
+
+	// composite the parts
+	canvas = calloc(width * height, sizeof(uint32_t));
+	if (!canvas) {
+		error(ERR_NO_MEM);
+		goto cleanup;
+	}
+	for (unsigned i = 0; i < count; i++) {
+		const struct Texture *img = images[i];
+		int top = half_h + parts[i].y - img->height / 2;
+		int left = half_w + parts[i].x - img->width / 2;
+		blend_part(canvas, width, img, left, top, 0);
+		if (parts[i].mirror) {
+			int mirror_left = half_w - parts[i].x - (img->width + 1) / 2;
+			blend_part(canvas, width, img, mirror_left, top, 1);
+		}
+	}
+
+	// the sprite takes the ownership of the canvas
+	spr = sprite_from_pixels(width, height, canvas);
+
+cleanup:
+	for (unsigned i = 0; i < count; i++) {
+		texture_destroy(images[i]);
+	}
+	return spr;
+}
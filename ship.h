@@ -0,0 +1,24 @@
+#pragma once
+
+/**
+ * Part of a ship design.
+ *
+ * Offsets are in pixels, from the center of the ship to the center of the
+ * part, with Y axis pointing down.
+ */
+struct ShipPart {
+	const char *file;
+	int x, y;
+	int mirror;  // add a copy mirrored across the vertical axis
+};
+
+/**
+ * Assemble a ship from a list of parts, terminated by one with NULL file.
+ *
+ * Parts are composited in order, each one on top of the previous ones, into
+ * a single image centered on the origin of the design. The result is an
+ * impostor sprite, which costs as much as any other sprite to draw and can
+ * be shared by every ship of the same design.
+ */
+struct Sprite*
+ship_assemble(const struct ShipPart *parts);
@@ -1,46 +1,77 @@
-#include "error.h"
 #include "memory.h"
 #include "sprite.h"
 #include "texture.h"
 #include <assert.h>
 
-struct Sprite*
-sprite_from_file(const char *filename)
+/**
+ * Prefer array textures for subsequently created textures.
+ *
+ * Sprites are drawn by a pipeline which batches array texture layers.
+ * Returns the previous storage flags, to be restored afterwards.
+ */
+static int
+prefer_array_storage(void)
 {
-	assert(filename != NULL);
+	int storage = texture_get_storage();
+	if (storage & TEXTURE_STORAGE_GPU) {
+		texture_set_storage(storage | TEXTURE_STORAGE_ARRAY);
+	}
+	return storage;
+}
+
+/**
+ * Create a sprite of the size of given texture, taking its ownership.
+ */
+static struct Sprite*
+sprite_new(struct Texture *texture)
+{
+	if (!texture) {
+		return NULL;
+	}
 
 	// create an empty sprite struct
 	struct Sprite *spr = make(struct Sprite);
 	if (!spr) {
+		texture_destroy(texture);
 		return NULL;
 	}
+	spr->texture = texture;
+	spr->width = texture->width;
+	spr->height = texture->height;
+
+	return spr;
+}
+
+struct Sprite*
+sprite_from_file(const char *filename)
+{
+	assert(filename != NULL);
 
 	// load the texture from image file
-	spr->texture = texture_from_file(filename);
-	if (!spr->texture) {
-		sprite_destroy(spr);
-		return NULL;
-	}
-	spr->width = spr->texture->width;
-	spr->height = spr->texture->height;
-
-	// generate a VAO for the sprite
-	glGenVertexArrays(1, &spr->vao);
-	if (glGetError() != GL_NO_ERROR || !spr->vao) {
-		error(ERR_OPENGL);
-		sprite_destroy(spr);
-		return NULL;
-	}
+	int storage = prefer_array_storage();
+	struct Texture *texture = texture_from_file(filename);
+	texture_set_storage(storage);
 
-	return spr;
+	return sprite_new(texture);
+}
+
+struct Sprite*
+sprite_from_pixels(unsigned width, unsigned height, void *pixels)
+{
+	assert(pixels != NULL);
+
+	int storage = prefer_array_storage();
+	struct Texture *texture = texture_from_pixels(width, height, pixels);
+	texture_set_storage(storage);
+
+	return sprite_new(texture);
 }
 
 void
 sprite_destroy(struct Sprite *spr)
 {
 	if (spr) {
-		glDeleteVertexArrays(1, &spr->vao);
 		texture_destroy(spr->texture);
 		destroy(spr);
 	}
-}
\ No newline at end of file
+}
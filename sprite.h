@@ -3,7 +3,6 @@
 #include <GL/glew.h>
 
 struct Sprite {
-	GLuint vao;
 	struct Texture *texture;
 	int width, height;
 };
@@ -11,5 +10,11 @@ struct Sprite {
 struct Sprite*
 sprite_from_file(const char *filename);
 
+/**
+ * Create a sprite from RGBA8 pixels, see `texture_from_pixels()`.
+ */
+struct Sprite*
+sprite_from_pixels(unsigned width, unsigned height, void *pixels);
+
 void
 sprite_destroy(struct Sprite *spr);
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "error.h"
+#include "memory.h"
+#include "stream.h"
+#include <assert.h>
+#include <stdio.h>
+
+// allocations are aligned to this boundary, enough for any vertex attribute
+#define STREAM_BUFFER_ALIGN 16
+
+// time to wait for a fence before reporting a stall (nanoseconds)
+#define STREAM_BUFFER_FENCE_TIMEOUT 1000000000
+
+struct StreamBuffer {
+	GLuint hnd;
+	int persistent;
+	unsigned char *mapping;
+	size_t frame_size;
+	unsigned frame;
+	size_t offset;
+	GLsync fences[STREAM_BUFFER_FRAMES];
+	int mapped;
+};
+
+static int
+init_persistent(struct StreamBuffer *buf, size_t size)
+{
+	GLbitfield flags = (
+		GL_MAP_WRITE_BIT |
+		GL_MAP_PERSISTENT_BIT |
+		GL_MAP_COHERENT_BIT
+	);
+	glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+	buf->mapping = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+	return buf->mapping != NULL && glGetError() == GL_NO_ERROR;
+}
+
+struct StreamBuffer*
+stream_buffer_new(size_t frame_size)
+{
+	assert(frame_size > 0);
+
+	struct StreamBuffer *buf = make(struct StreamBuffer);
+	if (!buf) {
+		return NULL;
+	}
+	buf->frame_size = (
+		(frame_size + STREAM_BUFFER_ALIGN - 1) &
+		~(size_t)(STREAM_BUFFER_ALIGN - 1)
+	);
+	buf->frame = STREAM_BUFFER_FRAMES - 1;
+
+	size_t size = buf->frame_size * STREAM_BUFFER_FRAMES;
+	glGenBuffers(1, &buf->hnd);
+	glBindBuffer(GL_ARRAY_BUFFER, buf->hnd);
+
+	// prefer an immutable, persistently mapped storage and fall back to a
+	// plain dynamic buffer mapped on demand
+	if (GLEW_ARB_buffer_storage) {
+		buf->persistent = init_persistent(buf, size);
+		if (!buf->persistent) {
+			// immutable storage cannot be respecified, start over
+			glGetError();
+			glDeleteBuffers(1, &buf->hnd);
+			glGenBuffers(1, &buf->hnd);
+			glBindBuffer(GL_ARRAY_BUFFER, buf->hnd);
+			buf->mapping = NULL;
+		}
+	}
+	if (!buf->persistent) {
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (!buf->hnd || glGetError() != GL_NO_ERROR) {
+		error(ERR_OPENGL);
+		stream_buffer_destroy(buf);
+		return NULL;
+	}
+
+	printf(
+		"stream buffer: %zu bytes, %s\n",
+		size,
+		buf->persistent ? "persistent mapping" : "unsynchronized mapping"
+	);
+
+	return buf;
+}
+
+void
+stream_buffer_destroy(struct StreamBuffer *buf)
+{
+	if (buf) {
+		for (unsigned i = 0; i < STREAM_BUFFER_FRAMES; i++) {
+			if (buf->fences[i]) {
+				glDeleteSync(buf->fences[i]);
+			}
+		}
+		if (buf->mapping || buf->mapped) {
+			glBindBuffer(GL_ARRAY_BUFFER, buf->hnd);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &buf->hnd);
+		destroy(buf);
+	}
+}
+
+int
+stream_buffer_begin(struct StreamBuffer *buf)
+{
+	assert(buf != NULL);
+
+	buf->frame = (buf->frame + 1) % STREAM_BUFFER_FRAMES;
+	buf->offset = 0;
+
+	// wait for the GPU to finish reading the region written
+	// `STREAM_BUFFER_FRAMES` frames ago
+	GLsync fence = buf->fences[buf->frame];
+	if (fence) {
+		GLenum status = glClientWaitSync(
+			fence,
+			GL_SYNC_FLUSH_COMMANDS_BIT,
+			STREAM_BUFFER_FENCE_TIMEOUT
+		);
+		glDeleteSync(fence);
+		buf->fences[buf->frame] = NULL;
+		if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED) {
+			fprintf(stderr, "stream buffer fence wait failed\n");
+			error(ERR_OPENGL);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void*
+stream_buffer_alloc(struct StreamBuffer *buf, size_t size, GLintptr *r_offset)
+{
+	assert(buf != NULL);
+	assert(r_offset != NULL);
+	assert(!buf->mapped);
+
+	size_t offset = buf->offset;
+	size = (size + STREAM_BUFFER_ALIGN - 1) & ~(size_t)(STREAM_BUFFER_ALIGN - 1);
+	if (size == 0 || offset + size > buf->frame_size) {
+		return NULL;
+	}
+	*r_offset = buf->frame * buf->frame_size + offset;
+
+	if (buf->persistent) {
+		buf->offset += size;
+		return buf->mapping + *r_offset;
+	}
+
+	// the region is fenced, so there's no need for the driver to
+	// synchronize the mapping
+	glBindBuffer(GL_ARRAY_BUFFER, buf->hnd);
+	void *ptr = glMapBufferRange(
+		GL_ARRAY_BUFFER,
+		*r_offset,
+		size,
+		GL_MAP_WRITE_BIT |
+		GL_MAP_UNSYNCHRONIZED_BIT |
+		GL_MAP_INVALIDATE_RANGE_BIT
+	);
+	if (!ptr) {
+		// the region is left free for the next allocations
+		fprintf(stderr, "stream buffer mapping failed\n");
+		error(ERR_OPENGL);
+		return NULL;
+	}
+	buf->offset += size;
+	buf->mapped = 1;
+	return ptr;
+}
+
+int
+stream_buffer_commit(struct StreamBuffer *buf)
+{
+	assert(buf != NULL);
+
+	if (buf->mapped) {
+		buf->mapped = 0;
+		glBindBuffer(GL_ARRAY_BUFFER, buf->hnd);
+		if (glUnmapBuffer(GL_ARRAY_BUFFER) != GL_TRUE) {
+			error(ERR_OPENGL);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int
+stream_buffer_end(struct StreamBuffer *buf)
+{
+	assert(buf != NULL);
+	assert(!buf->mapped);
+
+	buf->fences[buf->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (!buf->fences[buf->frame]) {
+		error(ERR_OPENGL);
+		return 0;
+	}
+	return 1;
+}
+
+GLuint
+stream_buffer_get_handle(struct StreamBuffer *buf)
+{
+	assert(buf != NULL);
+	return buf->hnd;
+}
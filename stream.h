@@ -0,0 +1,70 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <stddef.h>
+
+/**
+ * Number of frames a stream buffer can have in flight.
+ */
+#define STREAM_BUFFER_FRAMES 3
+
+/**
+ * Streaming vertex buffer.
+ *
+ * A ring of `STREAM_BUFFER_FRAMES` equally sized regions, each one written
+ * by the CPU during a single frame and guarded by a fence until the GPU is
+ * done reading it. When `GL_ARB_buffer_storage` is available the whole
+ * buffer is persistently mapped, otherwise each allocation is mapped with
+ * `glMapBufferRange()` in unsynchronized mode.
+ */
+struct StreamBuffer;
+
+/**
+ * Create a stream buffer with given per-frame region size.
+ */
+struct StreamBuffer*
+stream_buffer_new(size_t frame_size);
+
+/**
+ * Destroy a stream buffer.
+ */
+void
+stream_buffer_destroy(struct StreamBuffer *buf);
+
+/**
+ * Begin a new frame.
+ *
+ * Advances to the next region and waits for the GPU to release it, if it
+ * is still in use.
+ */
+int
+stream_buffer_begin(struct StreamBuffer *buf);
+
+/**
+ * Allocate a chunk of given size in current frame region.
+ *
+ * Returns a write-only pointer to the chunk and its offset within the
+ * buffer in `r_offset`, or NULL if the region is exhausted or can't be
+ * mapped. The chunk must be committed with `stream_buffer_commit()` before
+ * being used for drawing.
+ */
+void*
+stream_buffer_alloc(struct StreamBuffer *buf, size_t size, GLintptr *r_offset);
+
+/**
+ * Commit the data written into last allocated chunk.
+ */
+int
+stream_buffer_commit(struct StreamBuffer *buf);
+
+/**
+ * End current frame, fencing its region.
+ */
+int
+stream_buffer_end(struct StreamBuffer *buf);
+
+/**
+ * Get stream buffer OpenGL handle.
+ */
+GLuint
+stream_buffer_get_handle(struct StreamBuffer *buf);
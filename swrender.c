@@ -0,0 +1,673 @@
+#include "error.h"
+#include "font.h"
+#include "swrender.h"
+#include "texture.h"
+#include <SDL.h>
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#define SWR_TILE_SIZE 64
+#define SWR_MAX_THREADS 16
+#define SWR_BIN_BASE_SIZE 64
+
+enum {
+	PRIM_SPRITE,
+	PRIM_GLYPH,
+	PRIM_WIDGET,
+};
+
+enum {
+	PHASE_BIN,
+	PHASE_RASTER,
+};
+
+/**
+ * Primitive, with coordinates converted to screen space (Y axis down).
+ */
+struct Prim {
+	int type;
+	int x0, y0, x1, y1;  // bounds, clamped to the framebuffer
+	union {
+		struct {
+			const struct Texture *texture;
+			float cx, cy;
+			float w, h;
+			float cos_a, sin_a;
+		} sprite;
+		struct {
+			const unsigned char *atlas;
+			unsigned atlas_w;
+			float x, y;  // bottom-left corner
+			float w, h;
+			float scale;
+			unsigned s;  // first atlas column of the glyph
+			unsigned t;  // first atlas row of the glyph
+		} glyph;
+		struct {
+			const struct Texture *texture;
+			float x, y;  // top-left corner
+			float w, h;
+			unsigned left, right;
+		} widget;
+	};
+};
+
+/**
+ * Indices of primitives overlapping a tile, in submission order.
+ */
+struct Bin {
+	uint32_t *items;
+	size_t len, cap;
+};
+
+struct Worker {
+	SDL_Thread *thread;
+	unsigned id;
+	struct Bin *bins;  // one for each tile
+};
+
+static struct SoftwareRenderer {
+	int initialized;
+	unsigned width, height;
+	uint32_t *pixels;
+	unsigned tiles_x, tiles_y;
+	struct Prim *prims;
+	size_t prim_count, prim_cap;
+	struct Worker workers[SWR_MAX_THREADS];
+	unsigned worker_count;
+	SDL_mutex *lock;
+	SDL_cond *start_cond;
+	SDL_cond *done_cond;
+	unsigned generation;
+	unsigned busy;
+	int phase;
+	int quit;
+	int failed;
+	SDL_atomic_t next_tile;
+} swr;
+
+static struct Prim*
+add_prim(int type, float x0, float y0, float x1, float y1)
+{
+	// clamp bounds to the framebuffer and drop invisible primitives
+	int ix0 = x0 < 0 ? 0 : (int)floorf(x0);
+	int iy0 = y0 < 0 ? 0 : (int)floorf(y0);
+	int ix1 = x1 > swr.width ? (int)swr.width : (int)ceilf(x1);
+	int iy1 = y1 > swr.height ? (int)swr.height : (int)ceilf(y1);
+	if (ix0 >= ix1 || iy0 >= iy1) {
+		return NULL;
+	}
+
+	// extend primitives array
+	if (swr.prim_count == swr.prim_cap) {
+		size_t cap = swr.prim_cap ? swr.prim_cap * 2 : 256;
+		struct Prim *prims = realloc(swr.prims, sizeof(struct Prim) * cap);
+		if (!prims) {
+			swr.failed = 1;
+			return NULL;
+		}
+		swr.prims = prims;
+		swr.prim_cap = cap;
+	}
+
+	struct Prim *prim = &swr.prims[swr.prim_count++];
+	prim->type = type;
+	prim->x0 = ix0;
+	prim->y0 = iy0;
+	prim->x1 = ix1;
+	prim->y1 = iy1;
+	return prim;
+}
+
+void
+swr_draw_sprite(
+	const struct Texture *texture,
+	float x,
+	float y,
+	float width,
+	float height,
+	float angle
+) {
+	assert(texture->pixels != NULL);
+
+	float cx = x + swr.width / 2.0f;
+	float cy = swr.height / 2.0f - y;
+	float cos_a = cosf(angle);
+	float sin_a = sinf(angle);
+	float half_w = (width * fabsf(cos_a) + height * fabsf(sin_a)) / 2;
+	float half_h = (width * fabsf(sin_a) + height * fabsf(cos_a)) / 2;
+
+	struct Prim *prim = add_prim(
+		PRIM_SPRITE,
+		cx - half_w,
+		cy - half_h,
+		cx + half_w,
+		cy + half_h
+	);
+	if (prim) {
+		prim->sprite.texture = texture;
+		prim->sprite.cx = cx;
+		prim->sprite.cy = cy;
+		prim->sprite.w = width;
+		prim->sprite.h = height;
+		prim->sprite.cos_a = cos_a;
+		prim->sprite.sin_a = sin_a;
+	}
+}
+
+void
+swr_draw_glyph(
+	float x,
+	float y,
+	float scale,
+	const struct GlyphRect *rect
+) {
+	unsigned atlas_w;
+	const unsigned char *atlas = font_get_atlas_bitmap(&atlas_w, NULL);
+	assert(atlas != NULL);
+
+	float left = x + swr.width / 2.0f;
+	float bottom = swr.height / 2.0f - y;
+
+	float w = rect->w * scale;
+	float h = rect->h * scale;
+	struct Prim *prim = add_prim(
+		PRIM_GLYPH,
+		left,
+		bottom - h,
+		left + w,
+		bottom
+	);
+	if (prim) {
+		prim->glyph.atlas = atlas;
+		prim->glyph.atlas_w = atlas_w;
+		prim->glyph.x = left;
+		prim->glyph.y = bottom;
+		prim->glyph.w = w;
+		prim->glyph.h = h;
+		prim->glyph.scale = scale;
+		prim->glyph.s = rect->x;
+		prim->glyph.t = rect->y;
+	}
+}
+
+void
+swr_draw_widget(
+	const struct Texture *texture,
+	float x,
+	float y,
+	float width,
+	float height,
+	unsigned border_left,
+	unsigned border_right
+) {
+	assert(texture->pixels != NULL);
+
+	float left = x + swr.width / 2.0f;
+	float top = swr.height / 2.0f - y;
+
+	struct Prim *prim = add_prim(
+		PRIM_WIDGET,
+		left,
+		top,
+		left + width,
+		top + height
+	);
+	if (prim) {
+		prim->widget.texture = texture;
+		prim->widget.x = left;
+		prim->widget.y = top;
+		prim->widget.w = width;
+		prim->widget.h = height;
+		prim->widget.left = border_left;
+		prim->widget.right = border_right;
+	}
+}
+
+static inline uint32_t
+fetch_texel(const struct Texture *texture, int s, int t)
+{
+	// emulate `GL_CLAMP_TO_EDGE` wrapping
+	s = s < 0 ? 0 : (s >= (int)texture->width ? (int)texture->width - 1 : s);
+	t = t < 0 ? 0 : (t >= (int)texture->height ? (int)texture->height - 1 : t);
+	return ((const uint32_t*)texture->pixels)[t * texture->width + s];
+}
+
+static void
+shade_sprite(const struct Prim *prim, int x0, int x1, int y, uint32_t *span)
+{
+	const float py = y + 0.5f;
+	for (int x = x0; x < x1; x++) {
+		// rotate pixel center back to sprite space
+		float dx = x + 0.5f - prim->sprite.cx;
+		float dy = prim->sprite.cy - py;
+		float lx = dx * prim->sprite.cos_a + dy * prim->sprite.sin_a;
+		float ly = dy * prim->sprite.cos_a - dx * prim->sprite.sin_a;
+		float u = lx + prim->sprite.w / 2;
+		float v = prim->sprite.h / 2 - ly;
+		if (u < 0 || v < 0 || u >= prim->sprite.w || v >= prim->sprite.h) {
+			span[x - x0] = 0;
+		} else {
+			span[x - x0] = fetch_texel(prim->sprite.texture, u, v);
+		}
+	}
+}
+
+static void
+shade_glyph(const struct Prim *prim, int x0, int x1, int y, uint32_t *span)
+{
+	// atlas rows are stored bottom to top
+	float scale = prim->glyph.scale;
+	float t = prim->glyph.y - (y + 0.5f);
+	const unsigned char *row = (
+		prim->glyph.atlas +
+		(prim->glyph.t + (unsigned)(t / scale)) * prim->glyph.atlas_w +
+		prim->glyph.s
+	);
+
+	// distance field values span twice the spread, in atlas texels
+	float pixels_per_value = 2 * FONT_SDF_SPREAD * scale / 255.0f;
+	for (int x = x0; x < x1; x++) {
+		float s = x + 0.5f - prim->glyph.x;
+		uint32_t value = 0;
+		if (s >= 0 && t >= 0 && s < prim->glyph.w && t < prim->glyph.h) {
+			// map the distance from the edge to pixel coverage
+			float d = (row[(unsigned)(s / scale)] - 127.5f);
+			float coverage = 0.5f + d * pixels_per_value;
+			coverage = coverage < 0 ? 0 : (coverage > 1 ? 1 : coverage);
+			value = coverage * 255;
+		}
+		// same as text fragment shader, all channels hold the coverage
+		span[x - x0] = value * 0x01010101u;
+	}
+}
+
+static void
+shade_widget(const struct Prim *prim, int x0, int x1, int y, uint32_t *span)
+{
+	// stretch the middle part of the texture horizontally, just like
+	// widget fragment shader does
+	float v = y + 0.5f - prim->widget.y;
+	float left = prim->widget.left;
+	float right = prim->widget.right;
+	unsigned middle = prim->widget.right - prim->widget.left;
+	for (int x = x0; x < x1; x++) {
+		float u = x + 0.5f - prim->widget.x;
+		float norm_u = u;
+		if (u > left && u < prim->widget.w - right && middle > 0) {
+			norm_u = left + (unsigned)u % middle;
+		} else if (u > left + middle && u >= prim->widget.w - right) {
+			norm_u = prim->widget.w - u;
+		}
+		span[x - x0] = fetch_texel(prim->widget.texture, norm_u, v);
+	}
+}
+
+static inline void
+blend_pixel(unsigned char *dst, const unsigned char *src)
+{
+	unsigned a = src[3];
+	for (unsigned c = 0; c < 4; c++) {
+		unsigned x = src[c] * a + dst[c] * (255 - a) + 128;
+		dst[c] = (x + (x >> 8)) >> 8;
+	}
+}
+
+/**
+ * Blend a span of pixels with `GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA`
+ * function, four at a time when SSE2 is available.
+ */
+static void
+blend_span(uint32_t *dst, const uint32_t *src, size_t n)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi16(255);
+	const __m128i bias = _mm_set1_epi16(128);
+	for (; i + 4 <= n; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+
+		// widen channels to 16 bits, two pixels per register
+		__m128i s_lo = _mm_unpacklo_epi8(s, zero);
+		__m128i s_hi = _mm_unpackhi_epi8(s, zero);
+		__m128i d_lo = _mm_unpacklo_epi8(d, zero);
+		__m128i d_hi = _mm_unpackhi_epi8(d, zero);
+
+		// broadcast source alpha to all channels of each pixel
+		__m128i a_lo = _mm_shufflehi_epi16(
+			_mm_shufflelo_epi16(s_lo, _MM_SHUFFLE(3, 3, 3, 3)),
+			_MM_SHUFFLE(3, 3, 3, 3)
+		);
+		__m128i a_hi = _mm_shufflehi_epi16(
+			_mm_shufflelo_epi16(s_hi, _MM_SHUFFLE(3, 3, 3, 3)),
+			_MM_SHUFFLE(3, 3, 3, 3)
+		);
+
+		// s * a + d * (255 - a) + 128, fits in unsigned 16 bits
+		__m128i x_lo = _mm_add_epi16(
+			_mm_add_epi16(
+				_mm_mullo_epi16(s_lo, a_lo),
+				_mm_mullo_epi16(d_lo, _mm_sub_epi16(max, a_lo))
+			),
+			bias
+		);
+		__m128i x_hi = _mm_add_epi16(
+			_mm_add_epi16(
+				_mm_mullo_epi16(s_hi, a_hi),
+				_mm_mullo_epi16(d_hi, _mm_sub_epi16(max, a_hi))
+			),
+			bias
+		);
+
+		// divide by 255: (x + (x >> 8)) >> 8
+		x_lo = _mm_srli_epi16(_mm_add_epi16(x_lo, _mm_srli_epi16(x_lo, 8)), 8);
+		x_hi = _mm_srli_epi16(_mm_add_epi16(x_hi, _mm_srli_epi16(x_hi, 8)), 8);
+
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(x_lo, x_hi));
+	}
+#endif
+	for (; i < n; i++) {
+		blend_pixel((unsigned char*)(dst + i), (const unsigned char*)(src + i));
+	}
+}
+
+static void
+raster_prim(const struct Prim *prim, int tx0, int ty0, int tx1, int ty1)
+{
+	// clip primitive bounds to the tile
+	int x0 = prim->x0 > tx0 ? prim->x0 : tx0;
+	int y0 = prim->y0 > ty0 ? prim->y0 : ty0;
+	int x1 = prim->x1 < tx1 ? prim->x1 : tx1;
+	int y1 = prim->y1 < ty1 ? prim->y1 : ty1;
+
+	uint32_t span[SWR_TILE_SIZE];
+	for (int y = y0; y < y1; y++) {
+		switch (prim->type) {
+		case PRIM_SPRITE:
+			shade_sprite(prim, x0, x1, y, span);
+			break;
+		case PRIM_GLYPH:
+			shade_glyph(prim, x0, x1, y, span);
+			break;
+		case PRIM_WIDGET:
+			shade_widget(prim, x0, x1, y, span);
+			break;
+		}
+		blend_span(swr.pixels + y * swr.width + x0, span, x1 - x0);
+	}
+}
+
+static int
+bin_push(struct Bin *bin, uint32_t index)
+{
+	if (bin->len == bin->cap) {
+		size_t cap = bin->cap ? bin->cap * 2 : SWR_BIN_BASE_SIZE;
+		uint32_t *items = realloc(bin->items, sizeof(uint32_t) * cap);
+		if (!items) {
+			return 0;
+		}
+		bin->items = items;
+		bin->cap = cap;
+	}
+	bin->items[bin->len++] = index;
+	return 1;
+}
+
+/**
+ * Bin worker's share of primitives into its own per-tile bins.
+ */
+static int
+bin_prims(struct Worker *worker)
+{
+	size_t first = swr.prim_count * worker->id / swr.worker_count;
+	size_t last = swr.prim_count * (worker->id + 1) / swr.worker_count;
+	for (size_t i = first; i < last; i++) {
+		const struct Prim *prim = &swr.prims[i];
+		unsigned tx0 = prim->x0 / SWR_TILE_SIZE;
+		unsigned ty0 = prim->y0 / SWR_TILE_SIZE;
+		unsigned tx1 = (prim->x1 - 1) / SWR_TILE_SIZE;
+		unsigned ty1 = (prim->y1 - 1) / SWR_TILE_SIZE;
+		for (unsigned ty = ty0; ty <= ty1; ty++) {
+			for (unsigned tx = tx0; tx <= tx1; tx++) {
+				struct Bin *bin = &worker->bins[ty * swr.tiles_x + tx];
+				if (!bin_push(bin, i)) {
+					return 0;
+				}
+			}
+		}
+	}
+	return 1;
+}
+
+/**
+ * Rasterize tiles until there are none left.
+ *
+ * Bins of workers are visited in worker order, which, given that each
+ * worker binned a contiguous range of primitives, preserves submission
+ * order within the tile.
+ */
+static int
+raster_tiles(void)
+{
+	unsigned tile_count = swr.tiles_x * swr.tiles_y;
+	unsigned tile;
+	while ((tile = SDL_AtomicAdd(&swr.next_tile, 1)) < tile_count) {
+		int tx0 = (tile % swr.tiles_x) * SWR_TILE_SIZE;
+		int ty0 = (tile / swr.tiles_x) * SWR_TILE_SIZE;
+		int tx1 = tx0 + SWR_TILE_SIZE;
+		int ty1 = ty0 + SWR_TILE_SIZE;
+		tx1 = tx1 > (int)swr.width ? (int)swr.width : tx1;
+		ty1 = ty1 > (int)swr.height ? (int)swr.height : ty1;
+
+		for (unsigned w = 0; w < swr.worker_count; w++) {
+			struct Bin *bin = &swr.workers[w].bins[tile];
+			for (size_t i = 0; i < bin->len; i++) {
+				raster_prim(
+					&swr.prims[bin->items[i]],
+					tx0,
+					ty0,
+					tx1,
+					ty1
+				);
+			}
+			bin->len = 0;
+		}
+	}
+	return 1;
+}
+
+static int
+worker_main(void *data)
+{
+	struct Worker *worker = data;
+	unsigned generation = 0;
+
+	SDL_LockMutex(swr.lock);
+	for (;;) {
+		while (swr.generation == generation && !swr.quit) {
+			SDL_CondWait(swr.start_cond, swr.lock);
+		}
+		if (swr.quit) {
+			break;
+		}
+		generation = swr.generation;
+		int phase = swr.phase;
+		SDL_UnlockMutex(swr.lock);
+
+		int ok = phase == PHASE_BIN ? bin_prims(worker) : raster_tiles();
+
+		SDL_LockMutex(swr.lock);
+		swr.failed |= !ok;
+		if (--swr.busy == 0) {
+			SDL_CondSignal(swr.done_cond);
+		}
+	}
+	SDL_UnlockMutex(swr.lock);
+
+	return 0;
+}
+
+/**
+ * Run a phase on all workers and wait for its completion.
+ */
+static void
+run_phase(int phase)
+{
+	SDL_LockMutex(swr.lock);
+	swr.phase = phase;
+	swr.busy = swr.worker_count;
+	swr.generation++;
+	SDL_CondBroadcast(swr.start_cond);
+	while (swr.busy > 0) {
+		SDL_CondWait(swr.done_cond, swr.lock);
+	}
+	SDL_UnlockMutex(swr.lock);
+}
+
+int
+swr_init(unsigned width, unsigned height)
+{
+	assert(!swr.initialized);
+	memset(&swr, 0, sizeof(struct SoftwareRenderer));
+
+	swr.width = width;
+	swr.height = height;
+	swr.tiles_x = (width + SWR_TILE_SIZE - 1) / SWR_TILE_SIZE;
+	swr.tiles_y = (height + SWR_TILE_SIZE - 1) / SWR_TILE_SIZE;
+
+	swr.pixels = calloc(width * height, sizeof(uint32_t));
+	if (!swr.pixels) {
+		error(ERR_NO_MEM);
+		goto error;
+	}
+
+	swr.lock = SDL_CreateMutex();
+	swr.start_cond = SDL_CreateCond();
+	swr.done_cond = SDL_CreateCond();
+	if (!swr.lock || !swr.start_cond || !swr.done_cond) {
+		error(ERR_SDL);
+		goto error;
+	}
+
+	// spawn a worker for each CPU core
+	int cpu_count = SDL_GetCPUCount();
+	swr.worker_count = cpu_count < 1 ? 1 : cpu_count;
+	if (swr.worker_count > SWR_MAX_THREADS) {
+		swr.worker_count = SWR_MAX_THREADS;
+	}
+	for (unsigned i = 0; i < swr.worker_count; i++) {
+		struct Worker *worker = &swr.workers[i];
+		worker->id = i;
+		worker->bins = calloc(swr.tiles_x * swr.tiles_y, sizeof(struct Bin));
+		if (!worker->bins) {
+			error(ERR_NO_MEM);
+			goto error;
+		}
+		worker->thread = SDL_CreateThread(worker_main, "swrender", worker);
+		if (!worker->thread) {
+			error(ERR_SDL);
+			goto error;
+		}
+	}
+
+	printf(
+		"software renderer: %ux%u, %u tiles, %u threads\n",
+		width,
+		height,
+		swr.tiles_x * swr.tiles_y,
+		swr.worker_count
+	);
+
+	swr.initialized = 1;
+	return 1;
+
+error:
+	swr_shutdown();
+	return 0;
+}
+
+void
+swr_shutdown(void)
+{
+	// stop the workers
+	if (swr.lock) {
+		SDL_LockMutex(swr.lock);
+		swr.quit = 1;
+		SDL_CondBroadcast(swr.start_cond);
+		SDL_UnlockMutex(swr.lock);
+	}
+	for (unsigned i = 0; i < SWR_MAX_THREADS; i++) {
+		struct Worker *worker = &swr.workers[i];
+		if (worker->thread) {
+			SDL_WaitThread(worker->thread, NULL);
+		}
+		if (worker->bins) {
+			for (unsigned t = 0; t < swr.tiles_x * swr.tiles_y; t++) {
+				free(worker->bins[t].items);
+			}
+			free(worker->bins);
+		}
+	}
+
+	if (swr.done_cond) {
+		SDL_DestroyCond(swr.done_cond);
+	}
+	if (swr.start_cond) {
+		SDL_DestroyCond(swr.start_cond);
+	}
+	if (swr.lock) {
+		SDL_DestroyMutex(swr.lock);
+	}
+	free(swr.prims);
+	free(swr.pixels);
+	memset(&swr, 0, sizeof(struct SoftwareRenderer));
+}
+
+void
+swr_clear(void)
+{
+	assert(swr.initialized);
+	memset(swr.pixels, 0, sizeof(uint32_t) * swr.width * swr.height);
+}
+
+int
+swr_flush(void)
+{
+	assert(swr.initialized);
+
+	if (swr.prim_count > 0 && !swr.failed) {
+		run_phase(PHASE_BIN);
+		SDL_AtomicSet(&swr.next_tile, 0);
+		run_phase(PHASE_RASTER);
+	}
+
+	int ok = !swr.failed;
+	if (!ok) {
+		// drop whatever was binned before the failure
+		for (unsigned i = 0; i < swr.worker_count; i++) {
+			for (unsigned t = 0; t < swr.tiles_x * swr.tiles_y; t++) {
+				swr.workers[i].bins[t].len = 0;
+			}
+		}
+		error(ERR_NO_MEM);
+	}
+	swr.prim_count = 0;
+	swr.failed = 0;
+
+	return ok;
+}
+
+const uint32_t*
+swr_get_pixels(void)
+{
+	assert(swr.initialized);
+	return swr.pixels;
+}
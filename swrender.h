@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct GlyphRect;
+struct Texture;
+
+/**
+ * Software rasterizer.
+ *
+ * Draws sprites, glyphs and widgets into an RGBA8 framebuffer in memory,
+ * using the same conventions as the OpenGL pipelines: coordinates are
+ * relative to the center of the screen with Y axis pointing up, textures
+ * are sampled with nearest filtering and blended with source alpha.
+ *
+ * Primitives are queued by `swr_draw_*()` functions and rasterized by
+ * `swr_flush()`, which bins them into screen tiles and rasterizes the tiles
+ * on a pool of worker threads.
+ */
+
+/**
+ * Initialize the software rasterizer.
+ */
+int
+swr_init(unsigned width, unsigned height);
+
+/**
+ * Shut down the software rasterizer.
+ */
+void
+swr_shutdown(void);
+
+/**
+ * Clear the framebuffer.
+ */
+void
+swr_clear(void);
+
+/**
+ * Queue a sprite, centered at given position and rotated around its center.
+ */
+void
+swr_draw_sprite(
+	const struct Texture *texture,
+	float x,
+	float y,
+	float width,
+	float height,
+	float angle
+);
+
+/**
+ * Queue a glyph, with its bottom-left corner at given position.
+ *
+ * The glyph distance field is sampled from given rectangle of the glyph
+ * atlas, scaled by `scale`, and must stay valid until the frame is flushed.
+ * Outline and glow effects are not supported.
+ */
+void
+swr_draw_glyph(
+	float x,
+	float y,
+	float scale,
+	const struct GlyphRect *rect
+);
+
+/**
+ * Queue a widget, with its top-left corner at given position.
+ */
+void
+swr_draw_widget(
+	const struct Texture *texture,
+	float x,
+	float y,
+	float width,
+	float height,
+	unsigned border_left,
+	unsigned border_right
+);
+
+/**
+ * Rasterize all queued primitives.
+ */
+int
+swr_flush(void);
+
+/**
+ * Get framebuffer pixels, stored top to bottom.
+ */
+const uint32_t*
+swr_get_pixels(void);
@@ -0,0 +1,295 @@
+#include "error.h"
+#include "texarray.h"
+#include "texture.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// smallest and largest size classes
+#define TEXTURE_ARRAY_MIN_SIZE 32
+#define TEXTURE_ARRAY_MAX_SIZE 2048
+
+// memory budget of a single array, which determines the number of layers of
+// each size class
+#define TEXTURE_ARRAY_BUDGET (4 * 1024 * 1024)
+#define TEXTURE_ARRAY_MAX_LAYERS 256
+
+struct TextureArray {
+	GLuint hnd;
+	unsigned size;
+	unsigned layer_count;
+	unsigned used_count;
+	struct TextureArray *next;
+	unsigned char used[];
+};
+
+static struct TextureArray *arrays = NULL;
+static size_t memory = 0;  // allocated for all the arrays, in bytes
+
+static unsigned
+size_class(unsigned width, unsigned height)
+{
+	unsigned dim = width > height ? width : height;
+	unsigned size = TEXTURE_ARRAY_MIN_SIZE;
+	while (size < dim) {
+		size *= 2;
+	}
+	return size;
+}
+
+int
+texture_array_fits(unsigned width, unsigned height)
+{
+	return size_class(width, height) <= TEXTURE_ARRAY_MAX_SIZE;
+}
+
+static struct TextureArray*
+array_new(unsigned size)
+{
+	// fit as many layers as the budget allows, within driver limits
+	GLint max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	unsigned layer_count = TEXTURE_ARRAY_BUDGET / (size * size * 4);
+	if (layer_count > TEXTURE_ARRAY_MAX_LAYERS) {
+		layer_count = TEXTURE_ARRAY_MAX_LAYERS;
+	}
+	if (layer_count > (unsigned)max_layers) {
+		layer_count = max_layers;
+	}
+	if (layer_count == 0) {
+		layer_count = 1;
+	}
+
+	struct TextureArray *array = calloc(
+		1,
+		sizeof(struct TextureArray) + layer_count
+	);
+	if (!array) {
+		error(ERR_NO_MEM);
+		return NULL;
+	}
+	array->size = size;
+	array->layer_count = layer_count;
+
+	glGenTextures(1, &array->hnd);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array->hnd);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage3D(
+		GL_TEXTURE_2D_ARRAY,
+		0,
+		GL_RGBA8,
+		size,
+		size,
+		layer_count,
+		0,
+		GL_RGBA,
+		GL_UNSIGNED_BYTE,
+		NULL
+	);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	if (!array->hnd || glGetError() != GL_NO_ERROR) {
+		error(ERR_OPENGL);
+		if (array->hnd) {
+			glDeleteTextures(1, &array->hnd);
+		}
+		free(array);
+		return NULL;
+	}
+
+	memory += (size_t)size * size * 4 * layer_count;
+	printf(
+		"created %ux%u texture array with %u layers\n",
+		size,
+		size,
+		layer_count
+	);
+
+	array->next = arrays;
+	arrays = array;
+	return array;
+}
+
+/**
+ * Unlink an array from the list and destroy it.
+ */
+static void
+array_release(struct TextureArray *array)
+{
+	struct TextureArray **link = &arrays;
+	while (*link != array) {
+		link = &(*link)->next;
+	}
+	*link = array->next;
+	memory -= (size_t)array->size * array->size * 4 * array->layer_count;
+	glDeleteTextures(1, &array->hnd);
+	free(array);
+}
+
+/**
+ * Find `count` consecutive free layers in given array.
+ */
+static int
+find_free_layers(
+	const struct TextureArray *array,
+	unsigned count,
+	unsigned *r_first
+) {
+	unsigned run = 0;
+	for (unsigned layer = 0; layer < array->layer_count; layer++) {
+		run = array->used[layer] ? 0 : run + 1;
+		if (run == count) {
+			*r_first = layer + 1 - count;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int
+texture_array_add(
+	unsigned width,
+	unsigned height,
+	const void *pixels,
+	GLuint *r_hnd,
+	unsigned *r_layer
+) {
+	assert(pixels != NULL);
+	return texture_array_add_layers(
+		width,
+		height,
+		1,
+		&pixels,
+		r_hnd,
+		r_layer
+	);
+}
+
+int
+texture_array_add_layers(
+	unsigned width,
+	unsigned height,
+	unsigned count,
+	const void *const *pixels,
+	GLuint *r_hnd,
+	unsigned *r_first
+) {
+	assert(pixels != NULL);
+	assert(r_hnd != NULL);
+	assert(r_first != NULL);
+	assert(count > 0);
+
+	assert(texture_array_fits(width, height));
+
+	unsigned size = size_class(width, height);
+
+	// find an array of the same size class with enough consecutive free
+	// layers, or create a new one
+	unsigned first = 0;
+	struct TextureArray *array = arrays;
+	while (array &&
+	       (array->size != size ||
+	        array->layer_count - array->used_count < count ||
+	        !find_free_layers(array, count, &first))) {
+		array = array->next;
+	}
+	if (!array) {
+		if (!(array = array_new(size))) {
+			return 0;
+		} else if (!find_free_layers(array, count, &first)) {
+			fprintf(
+				stderr,
+				"%u layers exceed the capacity of %ux%u "
+				"texture arrays\n",
+				count,
+				size,
+				size
+			);
+			error(ERR_OPENGL);
+			array_release(array);
+			return 0;
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array->hnd);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (unsigned i = 0; i < count; i++) {
+		glTexSubImage3D(
+			GL_TEXTURE_2D_ARRAY,
+			0,
+			0,
+			0,
+			first + i,
+			width,
+			height,
+			1,
+			GL_RGBA,
+			GL_UNSIGNED_BYTE,
+			texture_stage_pixels(pixels[i], width * height * 4)
+		);
+		texture_unstage_pixels();
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	if (glGetError() != GL_NO_ERROR) {
+		error(ERR_OPENGL);
+		if (array->used_count == 0) {
+			array_release(array);
+		}
+		return 0;
+	}
+
+	for (unsigned i = 0; i < count; i++) {
+		array->used[first + i] = 1;
+	}
+	array->used_count += count;
+	*r_hnd = array->hnd;
+	*r_first = first;
+	return 1;
+}
+
+static struct TextureArray*
+find_array(GLuint hnd)
+{
+	struct TextureArray *array = arrays;
+	while (array && array->hnd != hnd) {
+		array = array->next;
+	}
+	assert(array != NULL);
+	return array;
+}
+
+void
+texture_array_remove(GLuint hnd, unsigned layer)
+{
+	struct TextureArray *array = find_array(hnd);
+	assert(layer < array->layer_count && array->used[layer]);
+
+	array->used[layer] = 0;
+	if (--array->used_count == 0) {
+		array_release(array);
+	}
+}
+
+size_t
+texture_array_get_layer_size(GLuint hnd)
+{
+	const struct TextureArray *array = find_array(hnd);
+	return (size_t)array->size * array->size * 4;
+}
+
+unsigned
+texture_array_get_used(GLuint hnd)
+{
+	return find_array(hnd)->used_count;
+}
+
+size_t
+texture_array_get_memory(void)
+{
+	return memory;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <stddef.h>
+
+/**
+ * Texture array pool.
+ *
+ * Images are uploaded into layers of `GL_TEXTURE_2D_ARRAY` textures, one
+ * set of arrays for each size class, i.e. power of two large enough to hold
+ * both image dimensions. Each image is stored at the origin of its layer
+ * and the rest of the layer is left undefined, thus shaders must clamp the
+ * texel coordinates to the size of the image.
+ *
+ * Textures sharing an array can be drawn by a single instanced call, with
+ * the layer index passed per instance.
+ */
+
+/**
+ * Check whether an image of given size fits in any size class.
+ */
+int
+texture_array_fits(unsigned width, unsigned height);
+
+/**
+ * Upload RGBA8 pixels into a free layer of an array of suitable size class.
+ */
+int
+texture_array_add(
+	unsigned width,
+	unsigned height,
+	const void *pixels,
+	GLuint *r_hnd,
+	unsigned *r_layer
+);
+
+/**
+ * Upload a sequence of RGBA8 images of the same size into consecutive layers
+ * of a single array, e.g. the frames of an animation.
+ *
+ * The first layer is returned in `r_first`.
+ */
+int
+texture_array_add_layers(
+	unsigned width,
+	unsigned height,
+	unsigned count,
+	const void *const *pixels,
+	GLuint *r_hnd,
+	unsigned *r_first
+);
+
+/**
+ * Release a layer, destroying the array it belongs to if it becomes empty.
+ */
+void
+texture_array_remove(GLuint hnd, unsigned layer);
+
+/**
+ * Get the size of the layers of an array, in bytes, which is the memory
+ * taken by each image stored in it, whatever its size.
+ */
+size_t
+texture_array_get_layer_size(GLuint hnd);
+
+/**
+ * Get the number of layers of an array in use; its memory is freed only
+ * once none is.
+ */
+unsigned
+texture_array_get_used(GLuint hnd);
+
+/**
+ * Get the memory allocated for all the arrays, in bytes.
+ */
+size_t
+texture_array_get_memory(void);
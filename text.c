@@ -1,12 +1,63 @@
 #include "font.h"
 #include "text.h"
-#include <GL/glew.h>
 #include <assert.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define REPLACEMENT_CHAR 0xfffd
+
+#define TEXT_INITIAL_CAPACITY 16
+#define TEXT_FMT_BUFFER_SIZE 256
+
+/**
+ * Decode the UTF-8 sequence at `*str`, advancing past it.
+ */
+static uint32_t
+decode_utf8(const char **str)
+{
+	static const uint32_t min_code[] = { 0, 0, 0x80, 0x800, 0x10000 };
+	const unsigned char *s = (const unsigned char*)*str;
+	uint32_t code;
+	unsigned len;
+
+	if (s[0] < 0x80) {
+		*str += 1;
+		return s[0];
+	} else if ((s[0] & 0xe0) == 0xc0) {
+		code = s[0] & 0x1f;
+		len = 2;
+	} else if ((s[0] & 0xf0) == 0xe0) {
+		code = s[0] & 0x0f;
+		len = 3;
+	} else if ((s[0] & 0xf8) == 0xf0) {
+		code = s[0] & 0x07;
+		len = 4;
+	} else {
+		*str += 1;
+		return REPLACEMENT_CHAR;
+	}
+
+	for (unsigned i = 1; i < len; i++) {
+		if ((s[i] & 0xc0) != 0x80) {
+			// truncated sequence, resume from the offending byte
+			*str += i;
+			return REPLACEMENT_CHAR;
+		}
+		code = (code << 6) | (s[i] & 0x3f);
+	}
+	*str += len;
+
+	// reject overlong encodings, surrogates and values out of range
+	if (code < min_code[len] ||
+	    code > 0x10ffff ||
+	    (code >= 0xd800 && code <= 0xdfff)) {
+		return REPLACEMENT_CHAR;
+	}
+	return code;
+}
+
 struct Text*
 text_new(struct Font *font)
 {
@@ -18,43 +69,59 @@ text_new(struct Font *font)
 	}
 	text->font = font;
 	text->len = 0;
+	text->capacity = 0;
 	text->width = 0;
 	text->height = 0;
-	text->vao = text->coords = text->chars = 0;
-
-	// generate vertex array
-	glGenVertexArrays(1, &text->vao);
-	glBindVertexArray(text->vao);
+	text->outline = 0;
+	text->glow = 0;
+	text->chars = NULL;
+	text->coords = NULL;
+	text->metrics = NULL;
 
-	// generate vertex buffers
-	// NOTE: buffers are initialized when `text_set_string()` is called
-	glGenBuffers(1, &text->coords);
-	glGenBuffers(1, &text->chars);
+	// NOTE: no GPU resources are owned by the text, glyph instances are
+	// written to renderer's stream buffer when the text is drawn
 
-	// setup coords attribute array
-	glBindBuffer(GL_ARRAY_BUFFER, text->coords);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-	glVertexAttribDivisor(0, 1);
+	return text;
+}
 
-	// setup character indices attribute array
-	// NOTE: each index is one byte long (the character itself), thus,
-	// anything except ASCII is not supported
-	glBindBuffer(GL_ARRAY_BUFFER, text->chars);
-	glEnableVertexAttribArray(1);
-	glVertexAttribIPointer(1, 1, GL_UNSIGNED_BYTE, 0, (GLvoid*)0);
-	glVertexAttribDivisor(1, 1);
+/**
+ * Grow the character arrays to hold at least `len` characters.
+ */
+static int
+reserve(struct Text *text, size_t len)
+{
+	if (len <= text->capacity) {
+		return 1;
+	}
 
-	if (!text->vao || !text->chars || !text->coords ||
-	    glGetError() != GL_NO_ERROR) {
-		text_destroy(text);
-		text = NULL;
+	// grow geometrically, so that strings of varying length settle on a
+	// capacity after a few updates
+	size_t cap = text->capacity ? text->capacity : TEXT_INITIAL_CAPACITY;
+	while (cap < len) {
+		cap *= 2;
 	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	uint32_t *chars = realloc(text->chars, sizeof(uint32_t) * cap);
+	if (!chars) {
+		return 0;
+	}
+	text->chars = chars;
+	GLfloat (*coords)[2] = realloc(text->coords, sizeof(GLfloat) * 2 * cap);
+	if (!coords) {
+		return 0;
+	}
+	text->coords = coords;
+	struct Character *metrics = realloc(
+		text->metrics,
+		sizeof(struct Character) * cap
+	);
+	if (!metrics) {
+		return 0;
+	}
+	text->metrics = metrics;
 
-	return text;
+	text->capacity = cap;
+	return 1;
 }
 
 int
@@ -63,73 +130,93 @@ text_set_string(struct Text *text, const char *str)
 	assert(text != NULL);
 	assert(str != NULL);
 
-	text->len = strlen(str);
+	// the string holds at most as many characters as bytes
+	if (!reserve(text, strlen(str))) {
+		return 0;
+	}
+
+	// decode the string to code points, finding the first one which
+	// differs from the previous string
+	size_t len = 0, first = text->len;
+	while (*str) {
+		uint32_t code = decode_utf8(&str);
+		int changed = len >= text->len || text->chars[len] != code;
+		if (changed && len < first) {
+			first = len;
+		}
+		text->chars[len++] = code;
+	}
+	if (len < first) {
+		first = len;
+	}
+	if (first == len && len == text->len) {
+		return 1;
+	}
+	text->len = len;
 
-	// setup the buffer of character indices, which in turn are character
-	// themselves
-	// NOTE: this doesn't support anything except ASCII
-	glBindBuffer(GL_ARRAY_BUFFER, text->chars);
-	glBufferData(GL_ARRAY_BUFFER, text->len, str, GL_STATIC_DRAW);
+	// look up the metrics of changed characters only
+	for (size_t c = first; c < len; c++) {
+		struct Character *ch = &text->metrics[c];
+		if (!font_get_char(text->font, text->chars[c], ch)) {
+			memset(ch, 0, sizeof(struct Character));
+		}
+	}
 
 	// compute character coords relative to the baseline
-	GLfloat coords[text->len][2];
-	text->width = text->height = 0;
-	for (size_t c = 0; c < text->len; c++) {
-		const struct Character *ch = font_get_char(
-			text->font,
-			str[c]
-		);
-		coords[c][0] = text->width;
+	GLfloat (*coords)[2] = text->coords;
+	float width = 0;
+	text->height = 0;
+	for (size_t c = 0; c < len; c++) {
+		const struct Character *ch = &text->metrics[c];
+		coords[c][0] = width + ch->bearing[0];
 		coords[c][1] = ch->bearing[1] - ch->size[1];
-		text->width += ch->advance / 64.0;
-		text->height = ch->size[1] > text->height ? ch->size[1] : text->height;
+		width += ch->advance / 64.0;
+		if (ch->size[1] > text->height) {
+			text->height = ch->size[1];
+		}
 	}
+	text->width = width;
 
 	// align the Y coord so that all glyphs have negative coordinates
 	int offset = 0;
-	for (size_t c = 0; c < text->len; c++) {
+	for (size_t c = 0; c < len; c++) {
 		int c_offset = text->height - coords[c][1];
 		if (abs(c_offset) > abs(offset)) {
 			offset = c_offset;
 		}
 	}
-	for (size_t c = 0; c < text->len; c++) {
+	for (size_t c = 0; c < len; c++) {
 		coords[c][1] -= offset;
 	}
 
-	// update the character coordinates buffer
-	glBindBuffer(GL_ARRAY_BUFFER, text->coords);
-	glBufferData(
-		GL_ARRAY_BUFFER,
-		sizeof(float) * text->len * 2,
-		coords,
-		GL_STATIC_DRAW
-	);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	return glGetError() == GL_NO_ERROR;
+	return 1;
 }
 
 int
 text_set_fmt(struct Text *text, const char *fmt, ...)
 {
-	va_list ap, ap_copy;
+	// format into a stack buffer, which fits most strings in one pass
+	char buf[TEXT_FMT_BUFFER_SIZE];
+	va_list ap;
 	va_start(ap, fmt);
-
-	va_copy(ap_copy, ap);
-	size_t len = vsnprintf(NULL, 0, fmt, ap_copy) + 1;
-	va_end(ap_copy);
-	char str[len + 1];
-	str[len] = 0;
-
-	int ok = 1;
-	va_copy(ap_copy, ap);
-	if (vsnprintf(str, len, fmt, ap)) {
-		ok = text_set_string(text, str);
+	int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (len < 0) {
+		return 0;
+	} else if ((size_t)len < sizeof(buf)) {
+		return text_set_string(text, buf);
 	}
-	va_end(ap_copy);
 
+	// format again into a buffer large enough
+	char *str = malloc(len + 1);
+	if (!str) {
+		return 0;
+	}
+	va_start(ap, fmt);
+	vsnprintf(str, len + 1, fmt, ap);
 	va_end(ap);
+	int ok = text_set_string(text, str);
+	free(str);
 	return ok;
 }
 
@@ -137,9 +224,9 @@ void
 text_destroy(struct Text *text)
 {
 	if (text) {
-		glDeleteBuffers(1, &text->chars);
-		glDeleteBuffers(1, &text->coords);
-		glDeleteVertexArrays(1, &text->vao);
+		free(text->chars);
+		free(text->coords);
+		free(text->metrics);
 		free(text);
 	}
 }
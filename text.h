@@ -1,26 +1,37 @@
 #pragma once
 
+#include <GL/glew.h>
+#include <stddef.h>
+#include <stdint.h>
+
 struct Text {
 	struct Font *font;
 	size_t len;
-	GLuint vao;
-	GLuint coords;
-	GLuint chars;
+	size_t capacity;  // of the arrays below, in characters
+	uint32_t *chars;  // Unicode code points
+	GLfloat (*coords)[2];
+	struct Character *metrics;  // of each character, at font size
 	unsigned width;
 	unsigned height;
+	float outline;  // width of the black outline, in pixels
+	float glow;     // width of the glow around the outline, in pixels
 };
 
 struct Text*
 text_new(struct Font *font);
 
+/**
+ * Set the string of the text, which is UTF-8 encoded.
+ *
+ * Invalid sequences are replaced by U+FFFD replacement character. Only the
+ * characters which differ from the previous string are looked up in the
+ * font, thus updating counters and timers every frame is cheap.
+ */
 int
 text_set_string(struct Text *text, const char *str);
 
 int
 text_set_fmt(struct Text *text, const char *fmt, ...);
 
-int
-text_render(struct Text *text);
-
 void
 text_destroy(struct Text *text);
@@ -1,166 +1,86 @@
+#include "archive.h"
 #include "error.h"
+#include "image.h"
 #include "memory.h"
 #include "sprite.h"
+#include "texarray.h"
 #include "texture.h"
 #include <assert.h>
-#include <png.h>
-#include <setjmp.h>
 #include <stdlib.h>
+#include <string.h>
 
-static void*
-read_image(const char *filename, unsigned int *r_width, unsigned int *r_height)
-{
-	assert(filename != NULL);
-
-	void *data = NULL;
-	png_structp png_ptr = NULL;
-	png_infop info_ptr = NULL;
-	png_bytepp rows = NULL;
-
-	// open the given file
-	FILE *fp = fopen(filename, "rb");
-	if (!fp) {
-		error(ERR_FILE_READ);
-		return NULL;
-	}
-
-	// attempt to read 8 bytes and check whether we're reading a PNG file
-	size_t hdr_size = 8;
-	unsigned char hdr[hdr_size];
-	if (fread(hdr, 1, hdr_size, fp) < hdr_size ||
-	    png_sig_cmp(hdr, 0, hdr_size) != 0) {
-		error(ERR_FILE_BAD);
-		goto error;
-	}
-
-	// allocate libpng structs
-	png_ptr = png_create_read_struct(
-		PNG_LIBPNG_VER_STRING,
-		NULL,
-		NULL,
-		NULL
-	);
-	if (!png_ptr) {
-		error(ERR_LIBPNG);
-		goto error;
-	}
-
-	info_ptr = png_create_info_struct(png_ptr);
-	if (!info_ptr) {
-		error(ERR_LIBPNG);
-
-	}
-
-	// set the error handling longjmp point
-	if (setjmp(png_jmpbuf(png_ptr))) {
-		error(ERR_FILE_BAD);
-		goto error;
-	}
+static int storage = TEXTURE_STORAGE_GPU;
 
-	// init file reading IO
-	png_init_io(png_ptr, fp);
-	png_set_sig_bytes(png_ptr, hdr_size);
-
-	// read image information
-	png_read_info(png_ptr, info_ptr);
-
-	// get image info
-	int color_type = info_ptr->color_type;
-	int bit_depth = info_ptr->bit_depth;
-
-	// transform paletted images to RGB
-	if (color_type == PNG_COLOR_TYPE_PALETTE) {
-		png_set_palette_to_rgb(png_ptr);
-	}
+// pixel unpack buffer staging the uploads, if any
+static GLuint upload_buffer = 0;
 
-	// transform packed grayscale images to 8bit
-	if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
-		png_set_gray_1_2_4_to_8(png_ptr);
-	} else if (color_type == PNG_COLOR_TYPE_GRAY ||
-	           color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
-		png_set_gray_to_rgb(png_ptr);
-	}
-
-	// strip 16bit images down to 8bit
-	else if (bit_depth == 16) {
-		png_set_strip_16(png_ptr);
-	}
-	// expand 1-byte packed pixels
-	else if (bit_depth < 8) {
-		png_set_packing(png_ptr);
-	}
-
-	// add full alpha channel
-	if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
-		png_set_tRNS_to_alpha(png_ptr);
-	}
+void
+texture_set_storage(int flags)
+{
+	assert(flags != 0);
+	storage = flags;
+}
 
-	// retrieve image size
-	int width = png_get_image_width(png_ptr, info_ptr);
-	int height = png_get_image_height(png_ptr, info_ptr);
+int
+texture_get_storage(void)
+{
+	return storage;
+}
 
-	if (r_width) {
-		*r_width = width;
-	}
-	if (r_height) {
-		*r_height = height;
-	}
+void
+texture_set_upload_buffer(GLuint pbo)
+{
+	upload_buffer = pbo;
+}
 
-	// allocate space for image data
-	size_t rowbytes = png_get_rowbytes(png_ptr, info_ptr);
-	data = malloc(height * rowbytes);
-	if (!data) {
-		error(ERR_NO_MEM);
-		goto error;
+const void*
+texture_stage_pixels(const void *pixels, size_t size)
+{
+	if (!upload_buffer) {
+		return pixels;
 	}
 
-	// setup an array of image row pointers
-	rows = malloc(height * sizeof(png_bytep));
-	if (!rows) {
-		error(ERR_NO_MEM);
-		goto error;
+	// orphan the storage used by previous uploads, so that the copy doesn't
+	// wait for them to complete
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_buffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+	void *dst = glMapBufferRange(
+		GL_PIXEL_UNPACK_BUFFER,
+		0,
+		size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+	);
+	if (!dst) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return pixels;
 	}
-	for (size_t r = 0; r < height; r++) {
-		rows[r] = data + rowbytes * r;
+	memcpy(dst, pixels, size);
+	if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return pixels;
 	}
 
-	// read image data
-	png_read_image(png_ptr, rows);
-
-cleanup:
-	free(rows);
-	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-	fclose(fp);
-	return data;
-
-error:
-	free(data);
-	data = NULL;
-	goto cleanup;
+	// with a pixel unpack buffer bound, the pointer passed to upload calls
+	// is an offset within it
+	return NULL;
 }
 
-struct Texture*
-texture_from_file(const char *filename)
+void
+texture_unstage_pixels(void)
 {
-	assert(filename != NULL);
-
-	// allocate texture struct
-	struct Texture *texture = make(struct Texture);
-	if (!texture) {
-		return NULL;
-	}
-
-	// read PNG image
-	void *image_data = read_image(
-		filename,
-		&texture->width,
-		&texture->height
-	);
-	if (!image_data) {
-		goto error;
+	if (upload_buffer) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 	}
+}
 
-	// create and initialize OpenGL texture
+/**
+ * Upload RGBA8 pixels to a rectangle texture of its own.
+ */
+static int
+upload_rectangle(struct Texture *texture, const void *pixels)
+{
+	size_t size = texture->width * texture->height * 4;
+	texture->target = GL_TEXTURE_RECTANGLE;
 	glGenTextures(1, &texture->hnd);
 	glBindTexture(GL_TEXTURE_RECTANGLE, texture->hnd);
 	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -179,11 +99,102 @@ texture_from_file(const char *filename)
 		0,
 		GL_RGBA,
 		GL_UNSIGNED_BYTE,
-		image_data
+		texture_stage_pixels(pixels, size)
 	);
+	texture_unstage_pixels();
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	if (glGetError() != GL_NO_ERROR || !texture->hnd) {
 		error(ERR_OPENGL);
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Get the RGBA8 pixels of an image, from the mounted archive if it holds
+ * the image, otherwise decoding its file.
+ *
+ * Decoded pixels are returned also in `r_owned`, to be freed by the caller.
+ */
+static const void*
+get_image(
+	const char *filename,
+	unsigned *r_width,
+	unsigned *r_height,
+	void **r_owned
+) {
+	const void *pixels = archive_get_image(filename, r_width, r_height);
+	*r_owned = pixels ? NULL : image_read_png(filename, r_width, r_height);
+	return pixels ? pixels : *r_owned;
+}
+
+struct Texture*
+texture_from_file(const char *filename)
+{
+	assert(filename != NULL);
+
+	// read PNG image
+	unsigned width, height;
+	void *owned;
+	const void *pixels = get_image(filename, &width, &height, &owned);
+	if (!pixels) {
+		return NULL;
+	} else if (owned) {
+		return texture_from_pixels(width, height, owned);
+	}
+	return texture_from_memory(width, height, pixels);
+}
+
+/**
+ * Create a texture, taking the ownership of `owned` pixels, if given.
+ */
+static struct Texture*
+create_texture(
+	unsigned width,
+	unsigned height,
+	const void *pixels,
+	void *owned
+) {
+	// allocate texture struct
+	struct Texture *texture = make(struct Texture);
+	if (!texture) {
+		free(owned);
+		return NULL;
+	}
+	texture->width = width;
+	texture->height = height;
+
+	// keep the pixels around for CPU consumers
+	void *image_data = owned;
+	if (storage & TEXTURE_STORAGE_CPU) {
+		assert(owned != NULL);
+		texture->pixels = image_data;
+		image_data = NULL;
+	}
+	if (!(storage & TEXTURE_STORAGE_GPU)) {
+		return texture;
+	}
+
+	// upload to an array texture if requested, falling back to a texture
+	// of its own for images too big for any size class
+	if ((storage & TEXTURE_STORAGE_ARRAY) &&
+	    texture_array_fits(texture->width, texture->height)) {
+		texture->target = GL_TEXTURE_2D_ARRAY;
+		int ok = texture_array_add(
+			texture->width,
+			texture->height,
+			pixels,
+			&texture->hnd,
+			&texture->layer
+		);
+		if (!ok) {
+			goto error;
+		}
+		goto cleanup;
+	}
+
+	// create and initialize OpenGL texture
+	if (!upload_rectangle(texture, pixels)) {
 		goto error;
 	}
 
@@ -197,11 +208,142 @@ error:
 	goto cleanup;
 }
 
+struct Texture*
+texture_from_pixels(unsigned width, unsigned height, void *pixels)
+{
+	assert(pixels != NULL);
+	return create_texture(width, height, pixels, pixels);
+}
+
+struct Texture*
+texture_from_memory(unsigned width, unsigned height, const void *pixels)
+{
+	assert(pixels != NULL);
+
+	// pixels kept in memory must be owned by the texture
+	if (storage & TEXTURE_STORAGE_CPU) {
+		void *owned = copy(pixels, width * height * 4);
+		if (!owned) {
+			return NULL;
+		}
+		return create_texture(width, height, owned, owned);
+	}
+	return create_texture(width, height, pixels, NULL);
+}
+
+int
+texture_sequence_from_files(
+	const char *const *filenames,
+	unsigned count,
+	struct Texture **r_textures
+) {
+	assert(filenames != NULL);
+	assert(r_textures != NULL);
+	assert(count > 0);
+
+	int ok = 1;
+	const void *images[count];
+	void *owned[count];
+	memset(owned, 0, sizeof(owned));
+	memset(r_textures, 0, sizeof(struct Texture*) * count);
+
+	// read all the images, which must be of the same size
+	for (unsigned i = 0; i < count; i++) {
+		struct Texture *texture = r_textures[i] = make(struct Texture);
+		if (!texture) {
+			goto error;
+		}
+		images[i] = get_image(
+			filenames[i],
+			&texture->width,
+			&texture->height,
+			&owned[i]
+		);
+		if (!images[i]) {
+			goto error;
+		} else if (texture->width != r_textures[0]->width ||
+		           texture->height != r_textures[0]->height) {
+			fprintf(
+				stderr,
+				"size of `%s` differs from the one of `%s`\n",
+				filenames[i],
+				filenames[0]
+			);
+			error(ERR_FILE_BAD);
+			goto error;
+		}
+	}
+	unsigned width = r_textures[0]->width;
+	unsigned height = r_textures[0]->height;
+
+	// upload to consecutive layers of an array, falling back to textures
+	// of their own for images too big for any size class
+	if ((storage & TEXTURE_STORAGE_GPU) &&
+	    texture_array_fits(width, height)) {
+		GLuint hnd = 0;
+		unsigned first = 0;
+		ok = texture_array_add_layers(
+			width,
+			height,
+			count,
+			images,
+			&hnd,
+			&first
+		);
+		if (!ok) {
+			goto error;
+		}
+		for (unsigned i = 0; i < count; i++) {
+			r_textures[i]->target = GL_TEXTURE_2D_ARRAY;
+			r_textures[i]->hnd = hnd;
+			r_textures[i]->layer = first + i;
+		}
+	} else if (storage & TEXTURE_STORAGE_GPU) {
+		for (unsigned i = 0; i < count; i++) {
+			if (!upload_rectangle(r_textures[i], images[i])) {
+				goto error;
+			}
+		}
+	}
+
+	// keep the pixels around for CPU consumers, copying those which are
+	// not owned
+	if (storage & TEXTURE_STORAGE_CPU) {
+		for (unsigned i = 0; i < count; i++) {
+			if (!owned[i] &&
+			    !(owned[i] = copy(images[i], width * height * 4))) {
+				goto error;
+			}
+			r_textures[i]->pixels = owned[i];
+			owned[i] = NULL;
+		}
+	}
+
+cleanup:
+	for (unsigned i = 0; i < count; i++) {
+		free(owned[i]);
+	}
+	return ok;
+
+error:
+	for (unsigned i = 0; i < count; i++) {
+		texture_destroy(r_textures[i]);
+		r_textures[i] = NULL;
+	}
+	ok = 0;
+	goto cleanup;
+}
+
 void
 texture_destroy(struct Texture *texture)
 {
 	if (texture) {
-		glDeleteTextures(1, &texture->hnd);
+		if (texture->hnd && texture->target == GL_TEXTURE_2D_ARRAY) {
+			texture_array_remove(texture->hnd, texture->layer);
+		} else if (texture->hnd) {
+			glDeleteTextures(1, &texture->hnd);
+		}
+		free(texture->pixels);
 		destroy(texture);
 	}
 }
\ No newline at end of file
@@ -1,12 +1,95 @@
 #pragma once
 
+#include <GL/glew.h>
+#include <stddef.h>
+
+/**
+ * Texture storage flags.
+ */
+enum {
+	TEXTURE_STORAGE_GPU = 1,         // upload to an OpenGL texture
+	TEXTURE_STORAGE_CPU = 1 << 1,    // keep RGBA8 pixels in memory
+	TEXTURE_STORAGE_ARRAY = 1 << 2,  // prefer a layer of an array texture
+};
+
 struct Texture {
 	GLuint hnd;
+	GLenum target;   // `GL_TEXTURE_RECTANGLE` or `GL_TEXTURE_2D_ARRAY`
+	unsigned layer;  // layer within the array texture
 	unsigned width, height;
+	void *pixels;
 };
 
+/**
+ * Set the storage of subsequently created textures.
+ *
+ * Defaults to `TEXTURE_STORAGE_GPU`.
+ */
+void
+texture_set_storage(int flags);
+
+/**
+ * Get current texture storage flags.
+ */
+int
+texture_get_storage(void);
+
+/**
+ * Set the pixel unpack buffer through which subsequent uploads are staged,
+ * or 0 for uploading straight from client memory.
+ *
+ * Staged uploads return as soon as the pixels are copied to the buffer,
+ * while the driver transfers them to the texture asynchronously.
+ */
+void
+texture_set_upload_buffer(GLuint pbo);
+
+/**
+ * Copy pixels to the upload buffer, if any, leaving it bound.
+ *
+ * Returns the pointer to pass to texture upload calls in place of `pixels`,
+ * which must be followed by `texture_unstage_pixels()`.
+ */
+const void*
+texture_stage_pixels(const void *pixels, size_t size);
+
+void
+texture_unstage_pixels(void);
+
 struct Texture*
 texture_from_file(const char *filename);
 
+/**
+ * Create a texture from RGBA8 pixels, stored top to bottom.
+ *
+ * Takes the ownership of `pixels`, which must be allocated with `malloc()`.
+ */
+struct Texture*
+texture_from_pixels(unsigned width, unsigned height, void *pixels);
+
+/**
+ * Create a texture from RGBA8 pixels, stored top to bottom, without taking
+ * their ownership.
+ *
+ * The pixels are copied only if kept in memory, e.g. those of a mounted
+ * archive are uploaded straight from its mapping.
+ */
+struct Texture*
+texture_from_memory(unsigned width, unsigned height, const void *pixels);
+
+/**
+ * Load a sequence of images of the same size, e.g. animation frames.
+ *
+ * When stored on the GPU, the images are uploaded to consecutive layers of
+ * a single array texture if they fit in it, so that a shader can step
+ * through them by offsetting the layer of the first one.
+ */
+int
+texture_sequence_from_files(
+	const char *const *filenames,
+	unsigned count,
+	struct Texture **r_textures
+);
+
 void
-texture_destroy(struct Texture *texture);
\ No newline at end of file
+texture_destroy(struct Texture *texture);
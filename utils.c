@@ -4,4 +4,15 @@ int
 ptr_cmp(const void *a, const void *b)
 {
 	return a == b ? 0 : 1;
-}
\ No newline at end of file
+}
+
+uint64_t
+hash_fnv1a(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
@@ -1,4 +1,18 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Initial value for `hash_fnv1a()`.
+ */
+#define HASH_FNV1A_INIT 0xcbf29ce484222325ULL
+
 int
-ptr_cmp(const void *a, const void *b);
\ No newline at end of file
+ptr_cmp(const void *a, const void *b);
+
+/**
+ * Compute 64-bit FNV-1a hash of given data, continuing from given hash.
+ */
+uint64_t
+hash_fnv1a(uint64_t hash, const void *data, size_t size);
@@ -4,7 +4,6 @@
 #include <stddef.h>
 
 struct Widget {
-	GLuint vao;
 	struct Texture *texture;
 	unsigned int width, height;
 	struct {